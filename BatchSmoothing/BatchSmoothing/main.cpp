@@ -0,0 +1,327 @@
+/***********************************************************************************
+ * main.c written by Timothy Hennessy
+ *
+ * Description: Smooths many images at once.  Decode, smoothing and encode
+ * run as separate pipeline stages connected by bounded queues, each stage
+ * with its own number of threads, so every core stays busy across
+ * thousands of images while the queues keep memory bounded.
+ *
+ * Input is either a directory, in which case every image in it is
+ * smoothed, or a manifest file with one "input_path [output_path]" per
+ * line.  Outputs without an explicit path go to the output directory
+ * under the input's file name.
+ *
+ * compile: see README.txt for details.
+ * execute: ./a.out [-r radius] [-D decoders] [-S smoothers] [-E encoders] [-q depth] [-M idle_mb]
+ *          <num> path/<input_dir_or_manifest> path/<output_dir>
+ *********************************************************************************/
+#include <ctime>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <memory>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include "benchmark.hpp"
+#include "boxAverage.hpp"
+#include "bufferPool.hpp"
+#include "cpuTopology.hpp"
+#include "profile.hpp"
+#include "rawImage.hpp"
+#include "boundedQueue.hpp"
+#include "timer.hpp"
+using namespace cv;
+using namespace std;
+
+struct Job
+{
+    string input, output;
+    Mat image;
+    shared_ptr<MappedImage> mapping;  // keeps a .bgr input mapped
+};
+
+int NUM_AVERAGES = 0;             // averaging operations per image
+int RADIUS = 1;                   // neighborhood is (2 * RADIUS + 1)^2
+BoundedQueue<Job> *JOBS;          // paths waiting to be decoded
+BoundedQueue<Job> *DECODED;       // decoded images waiting to be smoothed
+BoundedQueue<Job> *SMOOTHED;      // smoothed images waiting to be encoded
+BufferPool *BUFFERS;              // smoothing results and spares
+atomic<int> FAILED(0), WRITTEN(0);
+
+string baseName(const string& path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+/********************************* listJobs *******************************
+ * bool listJobs(const string& input, const string& outDir,
+ *               vector<Job>& jobs)
+ *
+ * Description: Builds the list of input/output paths from a directory or
+ * a manifest file.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * input         in          Directory of images or manifest file.
+ * outDir        in          Directory for outputs without explicit path.
+ * jobs          out         One entry per image, in listing order.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * bool          value       False if input could not be read.
+ **************************************************************************/
+bool listJobs(const string& input, const string& outDir, vector<Job>& jobs)
+{
+    struct stat info;
+    if (stat(input.c_str(), &info) != 0)
+        return false;
+    if (S_ISDIR(info.st_mode))
+    {
+        DIR *dir = opendir(input.c_str());
+        struct dirent *entry;
+        if (!dir)
+            return false;
+        while ((entry = readdir(dir)) != NULL)
+        {
+            Job job;
+            if (!hasImageExtension(entry->d_name))
+                continue;
+            job.input = input + "/" + entry->d_name;
+            job.output = outDir + "/" + entry->d_name;
+            jobs.push_back(job);
+        }
+        closedir(dir);
+        return true;
+    }
+    ifstream manifest(input.c_str());
+    string line;
+    if (!manifest)
+        return false;
+    while (getline(manifest, line))
+    {
+        Job job;
+        istringstream fields(line);
+        if (!(fields >> job.input) || job.input[0] == '#')
+            continue;
+        if (!(fields >> job.output))
+            job.output = outDir + "/" + baseName(job.input);
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+/********************************* decode *********************************
+ * void *decode(void *p)
+ *
+ * Description: Decode stage.  Reads images named by JOBS into DECODED.
+ * Unreadable images are counted as failures and dropped.
+ **************************************************************************/
+void *decode(void *p)
+{
+    Job job;
+    while (JOBS->pop(job))
+    {
+        job.mapping.reset(new MappedImage());
+        job.image = readImage(job.input, *job.mapping);
+        if (!job.image.data)
+        {
+            cout << "No image data: " << job.input << endl;
+            FAILED++;
+            continue;
+        }
+        DECODED->push(job);
+    }
+    return NULL;
+}
+
+// arg is the kernel scratch of the calling smooth thread
+void boxPass(void *arg, const Mat& src, Mat& dst)
+{
+    boxAverage(src, dst, RADIUS, *(AverageScratch *) arg);
+}
+
+/********************************* smooth *********************************
+ * void *smooth(void *p)
+ *
+ * Description: Smoothing stage.  Runs NUM_AVERAGES averaging operations
+ * on each image from DECODED, alternating between a result and a spare
+ * buffer from BUFFERS, and hands the result to SMOOTHED.  The decoded
+ * image is only read, and is released together with its mapping here.
+ * The kernel scratch lives as long as the thread.
+ **************************************************************************/
+void *smooth(void *p)
+{
+    Job job;
+    Mat result, spare;
+    AverageScratch scratch;
+    while (DECODED->pop(job))
+    {
+        PROFILE_SCOPE("smooth");
+        result = BUFFERS->acquire(job.image.rows, job.image.cols, job.image.type());
+        spare = BUFFERS->acquire(job.image.rows, job.image.cols, job.image.type());
+        runPasses(boxPass, &scratch, job.image, result, spare, NUM_AVERAGES);
+        BUFFERS->release(spare);
+        job.image = result;
+        job.mapping.reset();
+        SMOOTHED->push(job);
+    }
+    return NULL;
+}
+
+/********************************* encode *********************************
+ * void *encode(void *p)
+ *
+ * Description: Encode stage.  Writes every image from SMOOTHED and hands
+ * its buffer back to BUFFERS.
+ **************************************************************************/
+void *encode(void *p)
+{
+    Job job;
+    while (SMOOTHED->pop(job))
+    {
+        if (writeImage(job.output, job.image))
+            WRITTEN++;
+        else
+        {
+            cout << "Could not write: " << job.output << endl;
+            FAILED++;
+        }
+        BUFFERS->release(job.image);
+    }
+    return NULL;
+}
+
+/******************************** runStage ********************************
+ * void runStage(vector<pthread_t>& threads, void *(*stage)(void *))
+ *
+ * Description: Starts every thread of one stage.
+ **************************************************************************/
+void runStage(vector<pthread_t>& threads, void *(*stage)(void *))
+{
+    size_t t;
+    for (t = 0; t < threads.size(); t++)
+        pthread_create(&threads[t], NULL, stage, NULL);
+}
+
+void joinStage(vector<pthread_t>& threads)
+{
+    size_t t;
+    for (t = 0; t < threads.size(); t++)
+        pthread_join(threads[t], NULL);
+}
+
+int main(int argc, char** argv)
+{
+    int opt, depth = 4;
+    int idleMegabytes = DEFAULT_IDLE_LIMIT_MB;  // free pool blocks kept
+    int decoders = 2, encoders = 2;
+    int smoothers = hardwareThreads();
+    vector<Job> jobs;
+    size_t j;
+    
+    while ((opt = getopt(argc, argv, "r:D:S:E:q:M:")) != -1)
+    {
+        if (opt == 'r')
+            RADIUS = atoi(optarg);
+        else if (opt == 'D')
+            decoders = atoi(optarg);
+        else if (opt == 'S')
+            smoothers = atoi(optarg);
+        else if (opt == 'E')
+            encoders = atoi(optarg);
+        else if (opt == 'q')
+            depth = atoi(optarg);
+        else if (opt == 'M')
+            idleMegabytes = atoi(optarg);
+        else
+        {
+            cout << "usage: " << argv[0];
+            cout << " [-r radius] [-D decoders] [-S smoothers] [-E encoders] [-q depth] [-M idle_mb]";
+            cout << " number_of_avgs input_dir_or_manifest output_dir" << endl;
+            return -1;
+        }
+    }
+    
+    // Ensure command line arguments were read successfully
+    if (argc - optind != 3)
+    {
+        cout << "usage: " << argv[0];
+        cout << " [-r radius] [-D decoders] [-S smoothers] [-E encoders] [-q depth] [-M idle_mb]";
+        cout << " number_of_avgs input_dir_or_manifest output_dir" << endl;
+        return -1;
+    }
+    NUM_AVERAGES = atoi(argv[optind]);
+    string input = argv[optind + 1];
+    string outDir = argv[optind + 2];
+    
+    if (RADIUS < 1)
+    {
+        cout << "Radius must be > 0\n " << endl;
+        return -1;
+    }
+    else if (NUM_AVERAGES < 0)
+    {
+        cout << "Number of averaging iterations must be > 0\n " << endl;
+        return -1;
+    }
+    else if (decoders < 1 || smoothers < 1 || encoders < 1 || depth < 1)
+    {
+        cout << "Stage thread counts and queue depth must be > 0\n " << endl;
+        return -1;
+    }
+    else if (idleMegabytes < 0)
+    {
+        cout << "Idle buffer limit must be >= 0\n " << endl;
+        return -1;
+    }
+    else if (!listJobs(input, outDir, jobs))
+    {
+        cout << "Could not read input directory or manifest: " << input << endl;
+        return -1;
+    }
+    
+    // Images in flight never exceed the threads plus the queue depths, and
+    // free blocks of sizes no longer seen are dropped past the idle limit
+    BoundedQueue<Job> jobQueue(depth), decoded(depth), smoothed(depth);
+    BufferPool buffers((size_t) idleMegabytes * 1048576);
+    JOBS = &jobQueue;
+    DECODED = &decoded;
+    SMOOTHED = &smoothed;
+    BUFFERS = &buffers;
+    vector<pthread_t> decodeThreads(decoders), smoothThreads(smoothers),
+                      encodeThreads(encoders);
+    
+    double begin = monotonicSeconds();
+    runStage(decodeThreads, decode);
+    runStage(smoothThreads, smooth);
+    runStage(encodeThreads, encode);
+    for (j = 0; j < jobs.size(); j++)
+        jobQueue.push(jobs[j]);
+    
+    // Close each queue once every producer of it has finished
+    jobQueue.close();
+    joinStage(decodeThreads);
+    decoded.close();
+    joinStage(smoothThreads);
+    smoothed.close();
+    joinStage(encodeThreads);
+    double elapsed_secs = monotonicSeconds() - begin;
+    
+    cout << WRITTEN << " of " << jobs.size() << " images smoothed (" << NUM_AVERAGES;
+    cout << " averages each) in " << elapsed_secs << " seconds";
+    if (elapsed_secs > 0.0)
+        cout << ", " << WRITTEN / elapsed_secs << " images/second";
+    cout << endl;
+    buffers.printStats(cout);
+    PROFILE_REPORT("BatchSmoothing");
+    
+    return FAILED > 0 ? -1 : 0;
+}
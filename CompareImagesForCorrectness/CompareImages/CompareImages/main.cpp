@@ -1,93 +1,111 @@
+#include <unistd.h>
 #include <opencv2/opencv.hpp>
 #include <iostream>
+#include "cpuTopology.hpp"
+#include "imageDiff.hpp"
+#include "profile.hpp"
+#include "rawImage.hpp"
 using namespace std;
 using namespace cv;
 
-#define FALSE    0
-#define TRUE     1
-
 int main(int argc, char *argv[])
 {
-    char *seqImg = argv[1];
-    char *parImg = argv[2];
-    int i,j, rows, cols;
-    int bIdentical;
-    int count = 0;
-    Vec3b seqIntensity;
-    Vec3b parIntensity;
-    Mat sequential = imread(seqImg, 1);
-    Mat parallel   = imread(parImg, 1);
-    
+    int opt, c;
+    int tolerance = 0;                 // -t, largest error still accepted
+    int threads = hardwareThreads();   // -j
+    bool earlyExit = false;            // -e, stop at the first difference
+    int maxError = 0;
+    DiffReport report;
+    MappedImage seqMap, parMap;
+
+    while ((opt = getopt(argc, argv, "et:j:")) != -1)
+    {
+        if (opt == 'e')
+            earlyExit = true;
+        else if (opt == 't')
+            tolerance = atoi(optarg);
+        else if (opt == 'j')
+            threads = atoi(optarg);
+        else
+        {
+            cout << "usage: " << argv[0];
+            cout << " [-e] [-t tolerance] [-j threads] path_to_sequential_image path_to_parallel_image" << endl;
+            return -1;
+        }
+    }
+
     // Ensure command line arguments were read successfully
-    if (argc != 3)
+    if (argc - optind != 2)
     {
         cout << "usage: " << argv[0];
-        cout << " path_to_sequential_image path_to_parallel_image" << endl;
+        cout << " [-e] [-t tolerance] [-j threads] path_to_sequential_image path_to_parallel_image" << endl;
         return -1;
     }
-    else if (!seqImg || !sequential.data || !parImg || !parallel.data)
+    char *seqImg = argv[optind];
+    char *parImg = argv[optind + 1];
+    Mat sequential = readImage(seqImg, seqMap);
+    Mat parallel   = readImage(parImg, parMap);
+
+    if (!seqImg || !sequential.data || !parImg || !parallel.data)
     {
         cout << "No image data \n" << endl;
         cout << "usage: " << argv[0];
-        cout << " path_to_sequential_image path_to_parallel_image" << endl;
+        cout << " [-e] [-t tolerance] [-j threads] path_to_sequential_image path_to_parallel_image" << endl;
         return -1;
     }
-    
+    else if (tolerance < 0 || threads < 1)
+    {
+        cout << "Tolerance must be >= 0 and threads > 0\n " << endl;
+        return -1;
+    }
+
     // Must be same size to be identical
     if (sequential.rows != parallel.rows || sequential.cols != parallel.cols)
     {
         cout << "Error: Images are not of same dimensions." << endl;
         return -1;
     }
-    
-    // Ensure images are 3 channel BGR aka jpg format
-    if (sequential.depth() != CV_8U || parallel.depth() != CV_8U)
+
+    // Ensure images are 8-bit with the same channels
+    if (sequential.depth() != CV_8U || sequential.type() != parallel.type()
+        || sequential.channels() > 4)
     {
         cout << "Error: improper image type." << endl;
         return -1;
     }
-    
-    rows = sequential.rows;
-    cols = parallel.cols;
 
-    // Compare each images pixel to determine if identical
-    bIdentical = TRUE;
-    for (i = 0; i < rows; i++)
+    // Compare all rows in parallel
+    ThreadPool pool(threads);
     {
-        for (j = 0; j < cols; j++)
-        {
-            seqIntensity = sequential.at<Vec3b>(i, j);
-            parIntensity = parallel.at<Vec3b>(i, j);
-            if (seqIntensity != parIntensity) { bIdentical = FALSE; break; }
-            /*
-            if (seqIntensity.val[0] != parIntensity.val[0])
-            {
-                cout << seqIntensity.val[0] << " != " << parIntensity.val[0] << endl;
-                count++;
-            }
-            if (seqIntensity.val[1] != parIntensity.val[1])
-            {
-                cout << seqIntensity.val[1] << " != " << parIntensity.val[1] << endl;
-                count++;
-            }
-            if (seqIntensity.val[2] != parIntensity.val[2])
-            {
-                cout << seqIntensity.val[2] << " != " << parIntensity.val[2] << endl;
-                count++;
-            }
-             */
-        }
+        PROFILE_SCOPE("diff");
+        diffImages(sequential, parallel, pool, earlyExit, report);
     }
-    
+    PROFILE_REPORT("CompareImages");
+
     // Determine result
-    if (bIdentical)
+    if (report.mismatches == 0)
     {
         cout << "Images are identical!" << endl;
+        return 0;
     }
-    else
+    cout << "Images are not identical:(" << endl;
+    if (!report.complete)
+        return 1;
+
+    cout << "mismatched pixels: " << report.mismatches << " of " << sequential.total();
+    cout << " (" << 100.0 * report.mismatches / sequential.total() << "%)" << endl;
+    cout << "max error per channel:";
+    for (c = 0; c < report.channels; c++)
     {
-        cout << "Images are not identical:(" << endl;
+        cout << " " << report.maxError[c];
+        maxError = max(maxError, report.maxError[c]);
     }
+    cout << endl;
+    cout << "MSE: " << report.mse << "  PSNR: " << report.psnr << " dB" << endl;
+    cout << "differences within: " << report.bounds.width << " x " << report.bounds.height;
+    cout << " at (" << report.bounds.x << ", " << report.bounds.y << ")" << endl;
+    if (tolerance > 0)
+        cout << (maxError <= tolerance ? "within" : "exceeds") << " tolerance " << tolerance << endl;
 
-    return 0;
+    return maxError <= tolerance ? 0 : 1;
 }
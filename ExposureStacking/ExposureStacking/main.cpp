@@ -0,0 +1,248 @@
+/***********************************************************************************
+ * main.c written by Timothy Hennessy
+ *
+ * Description: Averages N aligned exposures of one scene into one image to
+ * reduce noise.  Decoder threads read the frames while the main thread
+ * adds each one into an ExposureStack, split into row bands on a thread
+ * pool.  Memory is one accumulator plus the frames in flight, however
+ * many frames are stacked.
+ *
+ * Input is either a directory, in which case every image in it is
+ * stacked, or a manifest file with one image path per line.
+ *
+ * compile: see README.txt for details.
+ * execute: ./a.out [-j threads] [-D decoders] [-q depth] [-u]
+ *          path/<input_dir_or_manifest> path/<output_image>
+ *********************************************************************************/
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include "boundedQueue.hpp"
+#include "cpuTopology.hpp"
+#include "profile.hpp"
+#include "exposureStack.hpp"
+#include "rawImage.hpp"
+#include "threadPool.hpp"
+#include "timer.hpp"
+using namespace cv;
+using namespace std;
+
+struct Exposure
+{
+    string path;
+    Mat image;
+    shared_ptr<MappedImage> mapping;  // keeps a .bgr frame mapped
+};
+
+int READ_FLAGS = 1;                   // imread flags, IMREAD_UNCHANGED with -u
+BoundedQueue<Exposure> *PATHS;        // frames waiting to be decoded
+BoundedQueue<Exposure> *DECODED;      // frames waiting to be added
+atomic<int> FAILED(0);
+
+/******************************** listFrames ******************************
+ * bool listFrames(const string& input, vector<string>& paths)
+ *
+ * Description: Lists the frames of a directory, sorted by name, or of a
+ * manifest file.  Lines of a manifest starting with # are skipped.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * bool          value       False if input could not be read.
+ **************************************************************************/
+bool listFrames(const string& input, vector<string>& paths)
+{
+    struct stat info;
+    if (stat(input.c_str(), &info) != 0)
+        return false;
+    if (S_ISDIR(info.st_mode))
+    {
+        DIR *dir = opendir(input.c_str());
+        struct dirent *entry;
+        if (!dir)
+            return false;
+        while ((entry = readdir(dir)) != NULL)
+            if (hasImageExtension(entry->d_name))
+                paths.push_back(input + "/" + entry->d_name);
+        closedir(dir);
+        sort(paths.begin(), paths.end());
+        return true;
+    }
+    ifstream manifest(input.c_str());
+    string line;
+    if (!manifest)
+        return false;
+    while (getline(manifest, line))
+    {
+        line.erase(0, line.find_first_not_of(" \t"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (!line.empty() && line[0] != '#')
+            paths.push_back(line);
+    }
+    return true;
+}
+
+/********************************* decode *********************************
+ * void *decode(void *p)
+ *
+ * Description: Decoder thread.  Reads the frames named by PATHS into
+ * DECODED.  Unreadable frames are counted as failures and dropped.
+ **************************************************************************/
+void *decode(void *p)
+{
+    Exposure frame;
+    while (PATHS->pop(frame))
+    {
+        frame.mapping.reset(new MappedImage());
+        frame.image = readImage(frame.path, *frame.mapping, READ_FLAGS);
+        if (!frame.image.data)
+        {
+            cout << "No image data: " << frame.path << endl;
+            FAILED++;
+            continue;
+        }
+        DECODED->push(frame);
+    }
+    return NULL;
+}
+
+/******************************** feedPaths *******************************
+ * Pushes every path into PATHS, then closes it, from its own thread so
+ * the main thread is free to accumulate.
+ **************************************************************************/
+void *feedPaths(void *p)
+{
+    vector<string>& paths = *(vector<string> *) p;
+    Exposure frame;
+    size_t i;
+    for (i = 0; i < paths.size(); i++)
+    {
+        frame.path = paths[i];
+        PATHS->push(frame);
+    }
+    PATHS->close();
+    return NULL;
+}
+
+/******************************* closeDecoded *****************************
+ * Closes DECODED once every decoder has finished, from its own thread so
+ * the main thread can keep draining it meanwhile.
+ **************************************************************************/
+void *closeDecoded(void *p)
+{
+    vector<pthread_t>& threads = *(vector<pthread_t> *) p;
+    size_t t;
+    for (t = 0; t < threads.size(); t++)
+        pthread_join(threads[t], NULL);
+    DECODED->close();
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    int opt, t;
+    int threads = hardwareThreads();  // -j, accumulation threads
+    int decoders = 2;                 // -D, frames decoded at once
+    int depth = 2;                    // -q, decoded frames waiting
+    vector<string> paths;
+    ExposureStack stack;
+    StackStatus status;
+    Exposure frame;
+    Mat result;
+
+    while ((opt = getopt(argc, argv, "j:D:q:u")) != -1)
+    {
+        if (opt == 'j')
+            threads = atoi(optarg);
+        else if (opt == 'D')
+            decoders = atoi(optarg);
+        else if (opt == 'q')
+            depth = atoi(optarg);
+        else if (opt == 'u')
+            READ_FLAGS = IMREAD_UNCHANGED;
+        else
+        {
+            cout << "usage: " << argv[0];
+            cout << " [-j threads] [-D decoders] [-q depth] [-u] input_dir_or_manifest output_image" << endl;
+            return -1;
+        }
+    }
+
+    // Ensure command line arguments were read successfully
+    if (argc - optind != 2)
+    {
+        cout << "usage: " << argv[0];
+        cout << " [-j threads] [-D decoders] [-q depth] [-u] input_dir_or_manifest output_image" << endl;
+        return -1;
+    }
+    string input = argv[optind];
+    string output = argv[optind + 1];
+
+    if (threads < 1 || decoders < 1 || depth < 1)
+    {
+        cout << "Threads, decoders and queue depth must be > 0\n " << endl;
+        return -1;
+    }
+    else if (!listFrames(input, paths) || paths.empty())
+    {
+        cout << "No frames in input directory or manifest: " << input << endl;
+        return -1;
+    }
+
+    // Frames in memory never exceed the decoders plus the queue depth plus
+    // the one being added
+    ThreadPool pool(threads);
+    BoundedQueue<Exposure> pathQueue(depth), decoded(depth);
+    PATHS = &pathQueue;
+    DECODED = &decoded;
+    vector<pthread_t> decodeThreads(decoders);
+    pthread_t feeder;
+
+    double begin = monotonicSeconds();
+    pthread_create(&feeder, NULL, feedPaths, &paths);
+    for (t = 0; t < decoders; t++)
+        pthread_create(&decodeThreads[t], NULL, decode, NULL);
+
+    pthread_t closer;
+    pthread_create(&closer, NULL, closeDecoded, &decodeThreads);
+
+    while (decoded.pop(frame))
+    {
+        status = stack.add(frame.image, pool);
+        if (status != STACK_ADDED)
+        {
+            cout << "Skipped " << frame.path << ": " << stackStatusMessage(status) << endl;
+            FAILED++;
+        }
+        frame = Exposure();           // release the frame before waiting for the next
+    }
+    pthread_join(closer, NULL);
+    pthread_join(feeder, NULL);
+
+    if (!stack.mean(result, pool) || !writeImage(output, result))
+    {
+        cout << "Could not write: " << output << endl;
+        return -1;
+    }
+    double elapsed_secs = monotonicSeconds() - begin;
+
+    cout << stack.count() << " of " << paths.size() << " frames stacked in " << elapsed_secs;
+    cout << " seconds";
+    if (elapsed_secs > 0.0)
+        cout << ", " << stack.count() / elapsed_secs << " frames/second";
+    cout << endl;
+    cout << "accumulator " << stack.accumulatorBytes() / (1024.0 * 1024.0) << " MB, at most ";
+    cout << decoders + depth + 1 << " frames in flight" << endl;
+    PROFILE_REPORT("ExposureStacking");
+
+    return FAILED > 0 ? -1 : 0;
+}
@@ -6,178 +6,300 @@
  * version.
  *
  * compile: see README.txt for details.
- * execute: ./a.out <num> path/<input_image_name>.jpg path/<output_image_name>.jpg
+ * execute: ./a.out [-r radius] [-t tile] [-k iters] [-v] [-j threads] [-a] [-S] [-F] [-w every[,dir[,drop|block[,ext]]]] <num> path/<input_image_name>.jpg path/<output_image_name>.jpg
  *********************************************************************************/
 #include <ctime>
+#include <cstring>
 #include <pthread.h>
+#include <unistd.h>
 #include <opencv2/opencv.hpp>
 #include <iostream>
+#include <vector>
+#include "activeTiles.hpp"
+#include "boxAverage.hpp"
+#include "cpuTopology.hpp"
+#include "profile.hpp"
+#include "rawImage.hpp"
+#include "snapshotWriter.hpp"
+#include "temporalBlocking.hpp"
+#include "threadPool.hpp"
+#include "tileScheduler.hpp"
 using namespace cv;
 using namespace std;
-#define NUM_THREADS 10
-Mat IMAGE, RESULT_IMAGE;
+
+/*********************************  TeamRun  **********************************
+ * Everything one run shares between its team members.  Passed to every
+ * function explicitly, there are no global images, so nothing stops two
+ * runs from existing in one process (on separate pools, a team owns its
+ * pool for the duration of runParallel).  For many concurrent requests on
+ * one shared pool use SmoothingContext from the engine instead.
+ ******************************************************************************/
+struct TeamRun
+{
+    int threads;                  // team size, equal to the pool size
+    bool pin;                     // pin member tid to workerCpu(tid)
+    Mat input;                    // decoded (or mapped) input image
+    Mat image, result;            // ping-pong buffers, first touched by workers
+    int radius;                   // neighborhood is (2 * radius + 1)^2
+    int iterations;               // averaging operations
+    bool tiled;                   // temporal cache blocking
+    TileConfig tiles;
+    vector<TileWork> work;        // per thread tile buffers and kernel scratch
+    bool sparse;                  // skip stable tiles
+    bool untilStable;             // stop at a fixed point
+    ActiveTiles tracker;          // stable tiles, with sparse or untilStable
+    int stableAfter;              // averages after which nothing changed, or -1
+    int passes;                   // passes actually run
+    SnapshotWriter *snapshots;    // progress snapshots, or NULL
+    int snapshotEvery;
+    Barrier *barrier;             // separates passes
+    TileScheduler *scheduler;     // hands out tiles, records busy/idle time
+};
 
 
-/*********************** neighborhoodAverage ******************************
- * void neighborhoodAverage(const Mat& img, Mat& result, int r, int c)
+/*********************************   partition  ********************************
+ * void partition(TeamRun& run, long tid, const Mat& src, Mat& dst,
+ *                int iterations)
  *
- * Description: Computes average of a neighborhood centered at (r,c) and
- * stores average into result.
+ * Description: Partitions image averaging by dividing the image into 2D
+ * tiles amongst threads.  Every thread starts with its own share of tiles
+ * and steals from busier threads once its share is done.  When temporal
+ * blocking is on, every tile runs iterations iterations plus a halo.
  *
  * Process:
- * 1.) Set up variables for readability, computation, and indexing.
- * 2.) Assigns starting and ending values for indexes of neighborhood.
- * 3.) Iterate through neighborhood summing together every valid cell.
- * 4.) Compute each average and store in result.
+ * 1.) Fill this thread's deque and wait for every other thread to do so.
+ * 2.) Claim tiles from run.scheduler until none are left.
+ * 3.) Call boxAverageRect or smoothTile on each claimed tile, or let
+ *     run.tracker skip it if it is stable.
  *
  * Parameter     Direction   Description
- * ------------------------------------------------------------------------
- * img           in          OpenCV Mat data structure, contains pointer to
- *                           2D array containing image pixels.
- * result        out         OpenCV Mat data structure used to store result
- *                           of neighborhood average.
- * r             in          Row value for cell at center of neighborhood.
- * c             in          Col value for cell at center of neighborhood.
+ * ----------------------------------------------------------------------------
+ * run           in/out      shared state of this run.
+ * tid           in          thread tid used for division of work amongst
+ *                           threads.
+ * src           in          image before this pass.
+ * dst           out         image after this pass.
+ * iterations    in          iterations per tile, always 1 when not tiling.
+ *
+ * Returns       Method      Description
+ * ----------------------------------------------------------------------------
+ * N/A
+ ******************************************************************************/
+void partition(TeamRun& run, long tid, const Mat& src, Mat& dst, int iterations)
+{
+    int tile;
+    run.scheduler->beginPass((int) tid, tileCount(src.size(), run.tiles));
+    run.barrier->wait();
+    
+    // Conduct averaging operation
+    PROFILE_SCOPE("partition");
+    while (run.scheduler->next((int) tid, tile))
+    {
+        if (run.sparse || run.untilStable)
+            run.tracker.run(src, dst, tile, run.work[tid].scratch);
+        else if (iterations == 1)
+            boxAverageRect(src, dst, run.radius, tileRect(src.size(), run.tiles, tile),
+                           run.work[tid].scratch);
+        else
+            smoothTile(src, dst, run.radius, iterations, tileRect(src.size(), run.tiles, tile),
+                       run.work[tid]);
+    }
+}
+
+/********************************  firstTouch  *******************************
+ * void firstTouch(TeamRun& run, int tid)
+ *
+ * Description: Copies band tid of run.input into both ping-pong buffers.  The
+ * buffers are allocated but never written by the main thread, so each page
+ * is placed on the NUMA node of the worker that writes it first, i.e. the
+ * worker whose tiles cover it.
+ *
+ * Parameter     Direction   Description
+ * ----------------------------------------------------------------------------
+ * run           in/out      shared state of this run.
+ * tid           in          worker index in [0..run.threads).
  *
  * NOTES:
- * - Assumes the values for r and c are viable.  This function will not go
- *   out of bounds, but it will still try to compute the neighborhood
- *   centered at (r,c)
- **************************************************************************/
-void neighborhoodAverage(int r, int c)
+ * - Band tid is rows [rows * tid / threads, rows * (tid + 1) / threads),
+ *   which is where the scheduler's contiguous, row-major tile share of
+ *   worker tid lies.  Stolen tiles are the only remote accesses left.
+ ******************************************************************************/
+void firstTouch(TeamRun& run, int tid)
 {
-    CV_Assert(IMAGE.depth() == CV_8U);      // ensures pixel value range [0..255]
-    int startRow, endRow, startCol, endCol; // readability vars
-    int sumBlue = 0, sumGreen = 0,          // averaging computation
-    sumRed = 0, avgBlue, avgGreen, avgRed;
-    int count = 0;
-    Vec3b intensity;                        // stores 3-channel pixel data
-    int i, j;                               // loop indices
-    startRow = r - 1;
-    endRow   = r + 1;
-    startCol = c - 1;
-    endCol   = c + 1;
-    for (i = startRow; i <= endRow; i++)
-        for (j = startCol; j <= endCol; j++)
-        {
-            if (i < 0 || i > IMAGE.rows - 1) break;     // avoid out of bounds rows
-            if (j < 0 || j > IMAGE.cols - 1) continue;  // avoid out of bounds cols
-            intensity = IMAGE.template at<Vec3b>(i, j); // store channels in 3 element vector BGR
-            sumBlue  = sumBlue  + intensity.val[0];
-            sumGreen = sumGreen + intensity.val[1];
-            sumRed   = sumRed   + intensity.val[2];
-            count++; // keeps count of total values used in sum
-        }
-    avgBlue  = saturate_cast<uchar>(sumBlue / count);
-    avgGreen = saturate_cast<uchar>(sumGreen / count);
-    avgRed   = saturate_cast<uchar>(sumRed / count);
-    RESULT_IMAGE.template at<Vec3b>(r,c)[0] = avgBlue;
-    RESULT_IMAGE.template at<Vec3b>(r,c)[1] = avgGreen;
-    RESULT_IMAGE.template at<Vec3b>(r,c)[2] = avgRed;
+    int r;
+    int startRow = (int) ((long) run.input.rows * tid / run.threads);
+    int endRow = (int) ((long) run.input.rows * (tid + 1) / run.threads);
+    size_t rowBytes = run.input.cols * run.input.elemSize();
+    for (r = startRow; r < endRow; r++)
+    {
+        memcpy(run.image.ptr(r), run.input.ptr(r), rowBytes);
+        memcpy(run.result.ptr(r), run.input.ptr(r), rowBytes);
+    }
 }
 
-/*********************************   partition  ********************************
- * void *partition(void *p)
+/*********************************   iterate   *********************************
+ * void iterate(void *p, int tid)
  *
- * Description: Partitions image averaging by dividing rows amongst
- * threads.  Every thread calls neighborhoodAverage for each of its assigned
- * rows.
+ * Description: Entry point of every pool worker.  Runs all run.iterations
+ * iterations, waiting at run.barrier between passes.
  *
  * Process:
- * 1.) Divide work.
- * 2.) Call neighborhoodAverage.
- * 3.) Threads exit.
+ * 1.) Pin to a core if requested and first touch this worker's band.
+ * 2.) Pick source and destination buffer by pass parity, no copying.
+ * 3.) Call partition.
+ * 4.) Wait for every other thread to finish the pass and record idle time.
+ * 5.) When tracking tiles, have tid 0 update the active set and, with
+ *     run.untilStable, end all workers after the first pass that changed
+ *     nothing.
+ * 6.) Have tid 0 hand a snapshot to run.snapshots when one is due.
  *
  * Parameter     Direction   Description
  * ----------------------------------------------------------------------------
- * p             in          thread tid used for division of work amongst
- *                           threads.
- *
- * Returns       Method      Description
- * ----------------------------------------------------------------------------
- * N/A
+ * p             in/out      the TeamRun.
+ * tid           in          worker index in [0..run.threads).
  *
  * NOTES:
- * - Since all arrays are global, the arrays are visible to all functions in
- *   this file.
+ * - Even passes read run.image and write run.result, odd passes the reverse.
  ******************************************************************************/
-void *partition(void *p)
+void iterate(void *p, int tid)
 {
-    int i, j;
-    long tid = (long) p;
-    int numRows = IMAGE.rows / NUM_THREADS;
-    int remainingRows = IMAGE.rows % NUM_THREADS;
-    int startRow =  numRows * (int) tid;
-    int endRow;
-    // last thread is one less than NUM_THREADS [0..NUM_THREADS)
-    // last thread is assigned remaining number of rows, in the worst case is
-    // N - 1
-    if (tid == NUM_THREADS - 1)
-    {
-        endRow = numRows * (int) tid + numRows + remainingRows;
-    }
-    else
+    TeamRun& run = *(TeamRun *) p;
+    int pass, block, averageOps;
+    if (run.pin && !pinCurrentThread(tid) && tid == 0)
+        cout << "Could not pin threads, running unpinned" << endl;
+    firstTouch(run, tid);
+    run.barrier->wait();
+    for (pass = 0, averageOps = 0;
+         averageOps < run.iterations && !(run.untilStable && run.stableAfter >= 0); pass++)
     {
-        endRow = numRows * (int) tid + numRows;
+        block = run.tiled ? min(run.tiles.blockIters, run.iterations - averageOps) : 1;
+        if (run.snapshots)
+            block = min(block, run.snapshotEvery - averageOps % run.snapshotEvery);
+        if (pass % 2 == 0)
+            partition(run, tid, run.image, run.result, block);
+        else
+            partition(run, tid, run.result, run.image, block);
+        averageOps += block;
+        {
+            PROFILE_SCOPE("barrier wait");
+            run.barrier->wait();
+        }
+        run.scheduler->endPass(tid);
+        
+        // One thread updates the active tiles while the others wait
+        if (run.sparse || run.untilStable)
+        {
+            if (tid == 0 && run.tracker.endPass() == 0 && run.stableAfter < 0)
+                run.stableAfter = averageOps - 1;
+            run.barrier->wait();
+        }
+        
+        // The buffer just written is only read until the pass after next
+        // writes it, which cannot start before tid 0 is done copying
+        if (tid == 0 && run.snapshots && run.snapshots->due(averageOps))
+            run.snapshots->submit(averageOps, pass % 2 == 0 ? run.result : run.image);
     }
-    
-    // Conduct averaging operation
-    for (i = startRow; i < endRow; i++)
-        for (j = 0; j < IMAGE.cols; j++)
-            neighborhoodAverage(i, j);
-
-    pthread_exit(NULL);
+    if (tid == 0)
+        run.passes = pass;
 }
 
 /*******************************   runParallel   ********************************
- * void runParallel()
+ * Mat& runParallel(ThreadPool& pool, TeamRun& run)
  *
- * Description: Initial thread management function.  Spins up threads.
+ * Description: Runs run.iterations averaging operations on the persistent
+ * pool.
  *
  * Process:
- * 1.) Create NUM_THREADS (constant in define.h) threads.
- * 2.) Send threads to partition function, aka entry point function.
- * 3.) Join all threads.
+ * 1.) Send every pool worker to iterate, aka entry point function.
+ * 2.) Wait for the team to finish.
+ * 3.) Return the buffer holding the final pass.
  *
  * Parameter     Direction   Description
  * ----------------------------------------------------------------------------
- * N/A
+ * pool          in          pool of run.threads workers.
+ * run           in/out      shared state of this run.
  *
  * Returns       Method      Description
  * ----------------------------------------------------------------------------
- * N/A
+ * Mat&          reference   run.image or run.result, whichever was written last.
  *
  * NOTES:
- * - See pthreads documentation for more specific information.
+ * - Threads are created once by the pool, not per iteration.
  ******************************************************************************/
-void runParallel()
+Mat& runParallel(ThreadPool& pool, TeamRun& run)
 {
-    long t;
-    void *status;
-    pthread_t tid[NUM_THREADS];
-    // Create threads and partition work
-    for (t = 0; t < NUM_THREADS; t++)
-        pthread_create(&tid[t], NULL, partition, (void *) t);
-    // Join threads
-    for (t = 0; t < NUM_THREADS; t++)
-        pthread_join(tid[t], &status);
+    pool.runTeam(iterate, &run);
+    return run.passes % 2 == 0 ? run.image : run.result;
 }
 
 int main(int argc, char** argv)
 {
-    int n = atoi(argv[1]);
-    char *imageName = argv[2];
-    char *outImage = argv[3];
-    int averageOps = 0;
+    int opt;
+    bool verbose = false;   // print per thread scheduler stats
+    MappedImage inputMap;   // a .bgr input is read in place
+    TeamRun run;
+    char *snapshotSpec = NULL;  // -w, progress snapshots
+    SnapshotConfig snapshotConfig = DEFAULT_SNAPSHOT_CONFIG;
+    run.threads = hardwareThreads();
+    run.pin = false;
+    run.radius = 1;
+    run.tiled = false;
+    run.tiles = DEFAULT_TILE_CONFIG;
+    run.sparse = false;
+    run.untilStable = false;
+    run.stableAfter = -1;
+    run.passes = 0;
+    run.snapshots = NULL;
     
-    // Read in image used in averaging operation
-    IMAGE = imread(imageName, 1);
+    while ((opt = getopt(argc, argv, "r:t:k:vj:aSFw:")) != -1)
+    {
+        if (opt == 'r')
+            run.radius = atoi(optarg);
+        else if (opt == 't')
+            run.tiles.tileRows = run.tiles.tileCols = atoi(optarg);
+        else if (opt == 'k')
+        {
+            run.tiles.blockIters = atoi(optarg);
+            run.tiled = true;
+        }
+        else if (opt == 'v')
+            verbose = true;
+        else if (opt == 'j')
+            run.threads = atoi(optarg);
+        else if (opt == 'a')
+            run.pin = true;
+        else if (opt == 'S')
+            run.sparse = true;
+        else if (opt == 'F')
+            run.untilStable = true;
+        else if (opt == 'w')
+            snapshotSpec = optarg;
+        else
+        {
+            cout << "usage: " << argv[0];
+            cout << " [-r radius] [-t tile] [-k iters] [-v] [-j threads] [-a] [-S] [-F] [-w every[,dir[,drop|block[,ext]]]] number_of_avgs path_to_image path_to_output" << endl;
+            return -1;
+        }
+    }
     
     // Ensure command line arguments were read successfully
-    if (argc != 4)
+    if (argc - optind != 3)
     {
         cout << "usage: " << argv[0];
-        cout << " number_of_avgs path_to_image path_to_output" << endl;
+        cout << " [-r radius] [-t tile] [-k iters] [-v] [-j threads] [-a] [-S] [-F] [-w every[,dir[,drop|block[,ext]]]] number_of_avgs path_to_image path_to_output" << endl;
+        return -1;
+    }
+    int n = atoi(argv[optind]);
+    char *imageName = argv[optind + 1];
+    char *outImage = argv[optind + 2];
+    
+    // Read in image used in averaging operation
+    run.input = readImage(imageName, inputMap);
+    run.iterations = n;
+    
+    if (run.radius < 1)
+    {
+        cout << "Radius must be > 0\n " << endl;
         return -1;
     }
     else if (n < 0)
@@ -185,39 +307,86 @@ int main(int argc, char** argv)
         cout << "Number of averaging iterations must be > 0\n " << endl;
         return -1;
     }
-    else if (!imageName || !IMAGE.data)
+    else if (run.tiles.tileRows < 1 || (run.tiled && run.tiles.blockIters < 1))
+    {
+        cout << "Tile size and iterations per tile must be > 0\n " << endl;
+        return -1;
+    }
+    else if (run.tiled && (run.sparse || run.untilStable))
+    {
+        cout << "-S and -F cannot be combined with -k\n " << endl;
+        return -1;
+    }
+    else if (snapshotSpec && !parseSnapshotConfig(snapshotSpec, snapshotConfig))
+    {
+        cout << "-w needs every[,dir[,drop|block[,ext]]] with every > 0\n " << endl;
+        return -1;
+    }
+    else if (run.threads < 1)
+    {
+        cout << "Number of threads must be > 0\n " << endl;
+        return -1;
+    }
+    else if (!imageName || !run.input.data)
     {
         cout << "No image data \n" << endl;
         cout << "usage: " << argv[0];
-        cout << " number_of_avgs path_to_image path_to_output" << endl;
+        cout << " [-r radius] [-t tile] [-k iters] [-v] [-j threads] [-a] [-S] [-F] [-w every[,dir[,drop|block[,ext]]]] number_of_avgs path_to_image path_to_output" << endl;
         return -1;
     }
     else if (!outImage)
     {
         cout << "Could not read output path\n" << endl;
         cout << "usage: " << argv[0];
-        cout << " number_of_avgs path_to_image path_to_output" << endl;
+        cout << " [-r radius] [-t tile] [-k iters] [-v] [-j threads] [-a] [-S] [-F] [-w every[,dir[,drop|block[,ext]]]] number_of_avgs path_to_image path_to_output" << endl;
         return -1;
     }
     
-    // Initialize by cloning image
-    RESULT_IMAGE = IMAGE.clone();
+    // Allocate only, workers fill the buffers from run.input (see firstTouch)
+    run.image.create(run.input.size(), run.input.type());
+    run.result.create(run.input.size(), run.input.type());
+    run.work.resize(run.threads);
+    run.tracker.reset(run.input.size(), run.tiles, run.radius);
     
-    // Conduct n averages of image and record time
-    clock_t begin = clock();
-    while (averageOps++ < n)
+    // Threads live for the whole run
+    ThreadPool pool(run.threads);
+    Barrier barrier(run.threads);
+    TileScheduler scheduler(run.threads);
+    run.barrier = &barrier;
+    run.scheduler = &scheduler;
+    if (snapshotSpec)
     {
-        // Creates threads, partitions and performs work
-        runParallel();
-        IMAGE = RESULT_IMAGE.clone();
+        run.snapshots = new SnapshotWriter(snapshotConfig);
+        run.snapshotEvery = snapshotConfig.every;
     }
+    
+    // Conduct n averages of image and record time
+    clock_t begin = clock();
+    Mat& result = runParallel(pool, run);
     clock_t end = clock();
     double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
     cout << n << " averages took: " << elapsed_secs;
     cout << " seconds" << endl;
-    cout << IMAGE.size() << endl;
+    cout << result.size() << endl;
+    if (run.stableAfter >= 0)
+        cout << "fixed point after " << run.stableAfter << " averages" << endl;
+    if (run.sparse || run.untilStable)
+    {
+        cout << "tiles run: " << run.tracker.tilesRun();
+        cout << " skipped: " << run.tracker.tilesSkipped() << endl;
+    }
+    if (verbose)
+        scheduler.printStats(cout);
+    if (run.snapshots)
+    {
+        run.snapshots->close();
+        cout << "snapshots written: " << run.snapshots->written() << " dropped: " << run.snapshots->dropped();
+        cout << " failed: " << run.snapshots->failed() << endl;
+        delete run.snapshots;
+    }
 
-    imwrite(outImage, IMAGE);
+    writeImage(outImage, result);
+    PROFILE_REPORT("ParallelImageSmoothing");
     
     return 0;
 }
@@ -1,20 +1,43 @@
 /***********************************************************************************
  * main.c written by Timothy Hennessy
  *
- * Description: Records performance for parallel image smoothing by
- * doubling the work and computing ratio.
+ * Description: Benchmarks the parallel engines on one image, doubling
+ * the number of averaging operations up to num, and prints one CSV row or
+ * JSON object per engine and iteration count.
  *
  * compile: see README.txt for details.
- * execute: ./a.out <num> path/<input_image_name>.jpg
+ * execute: ./a.out [-e engines] [-w warmups] [-n reps] [-f csv|json] [-j threads] <num> path/<input_image_name>.jpg
  *********************************************************************************/
-#include <ctime>
 #include <pthread.h>
+#include <unistd.h>
 #include <opencv2/opencv.hpp>
 #include <iostream>
+#include <vector>
+#include "benchmark.hpp"
+#include "bufferPool.hpp"
+#include "cpuTopology.hpp"
+#include "profile.hpp"
+#include "rawImage.hpp"
+#include "smoothingContext.hpp"
+#include "threadPool.hpp"
 using namespace cv;
 using namespace std;
-#define NUM_THREADS 10
-Mat IMAGE, RESULT_IMAGE, ORIGINAL;
+
+// One thread's share of a pass of the pthread engine
+struct PassBand
+{
+    const Mat *src;
+    Mat *dst;
+    long tid;
+    int threads;
+};
+
+// State of the pthread engine, kept between runs
+struct PthreadEngine
+{
+    int threads;
+    Mat spare;                    // second ping-pong buffer
+};
 
 
 /*********************** neighborhoodAverage ******************************
@@ -43,9 +66,9 @@ Mat IMAGE, RESULT_IMAGE, ORIGINAL;
  *   out of bounds, but it will still try to compute the neighborhood
  *   centered at (r,c)
  **************************************************************************/
-void neighborhoodAverage(int r, int c)
+void neighborhoodAverage(const Mat& img, Mat& result, int r, int c)
 {
-    CV_Assert(IMAGE.depth() == CV_8U);      // ensures pixel value range [0..255]
+    CV_Assert(img.depth() == CV_8U);        // ensures pixel value range [0..255]
     int startRow, endRow, startCol, endCol; // readability vars
     int sumBlue = 0, sumGreen = 0,          // averaging computation
     sumRed = 0, avgBlue, avgGreen, avgRed;
@@ -59,9 +82,9 @@ void neighborhoodAverage(int r, int c)
     for (i = startRow; i <= endRow; i++)
         for (j = startCol; j <= endCol; j++)
         {
-            if (i < 0 || i > IMAGE.rows - 1) break;     // avoid out of bounds rows
-            if (j < 0 || j > IMAGE.cols - 1) continue;  // avoid out of bounds cols
-            intensity = IMAGE.template at<Vec3b>(i, j); // store channels in 3 element vector BGR
+            if (i < 0 || i > img.rows - 1) break;     // avoid out of bounds rows
+            if (j < 0 || j > img.cols - 1) continue;  // avoid out of bounds cols
+            intensity = img.template at<Vec3b>(i, j); // store channels in 3 element vector BGR
             sumBlue  = sumBlue  + intensity.val[0];
             sumGreen = sumGreen + intensity.val[1];
             sumRed   = sumRed   + intensity.val[2];
@@ -70,9 +93,9 @@ void neighborhoodAverage(int r, int c)
     avgBlue  = saturate_cast<uchar>(sumBlue / count);
     avgGreen = saturate_cast<uchar>(sumGreen / count);
     avgRed   = saturate_cast<uchar>(sumRed / count);
-    RESULT_IMAGE.template at<Vec3b>(r,c)[0] = avgBlue;
-    RESULT_IMAGE.template at<Vec3b>(r,c)[1] = avgGreen;
-    RESULT_IMAGE.template at<Vec3b>(r,c)[2] = avgRed;
+    result.template at<Vec3b>(r,c)[0] = avgBlue;
+    result.template at<Vec3b>(r,c)[1] = avgGreen;
+    result.template at<Vec3b>(r,c)[2] = avgRed;
 }
 
 /*********************************   partition  ********************************
@@ -89,29 +112,27 @@ void neighborhoodAverage(int r, int c)
  *
  * Parameter     Direction   Description
  * ----------------------------------------------------------------------------
- * p             in          thread tid used for division of work amongst
- *                           threads.
+ * p             in          PassBand with the pass buffers and the thread
+ *                           tid used for division of work amongst threads.
  *
  * Returns       Method      Description
  * ----------------------------------------------------------------------------
  * N/A
- *
- * NOTES:
- * - Since all arrays are global, the arrays are visible to all functions in
- *   this file.
  ******************************************************************************/
 void *partition(void *p)
 {
     int i, j;
-    long tid = (long) p;
-    int numRows = IMAGE.rows / NUM_THREADS;
-    int remainingRows = IMAGE.rows % NUM_THREADS;
+    const PassBand& band = *(PassBand *) p;
+    const Mat& src = *band.src;
+    long tid = band.tid;
+    int numRows = src.rows / band.threads;
+    int remainingRows = src.rows % band.threads;
     int startRow =  numRows * (int) tid;
     int endRow;
-    // last thread is one less than NUM_THREADS [0..NUM_THREADS)
+    // last thread is one less than threads [0..threads)
     // last thread is assigned remaining number of rows, in the worst case is
     // N - 1
-    if (tid == NUM_THREADS - 1)
+    if (tid == band.threads - 1)
     {
         endRow = numRows * (int) tid + numRows + remainingRows;
     }
@@ -121,26 +142,31 @@ void *partition(void *p)
     }
     
     // Conduct averaging operation
-    for (i = startRow; i < endRow; i++)
-        for (j = 0; j < IMAGE.cols; j++)
-            neighborhoodAverage(i, j);
+    {
+        PROFILE_SCOPE("partition");
+        for (i = startRow; i < endRow; i++)
+            for (j = 0; j < src.cols; j++)
+                neighborhoodAverage(src, *band.dst, i, j);
+    }
     
     pthread_exit(NULL);
 }
 
 /*******************************   runParallel   ********************************
- * void runParallel()
+ * void runParallel(const Mat& src, Mat& dst, int threads)
  *
  * Description: Initial thread management function.  Spins up threads.
  *
  * Process:
- * 1.) Create NUM_THREADS (constant in define.h) threads.
+ * 1.) Create threads threads.
  * 2.) Send threads to partition function, aka entry point function.
  * 3.) Join all threads.
  *
  * Parameter     Direction   Description
  * ----------------------------------------------------------------------------
- * N/A
+ * src           in          image before this pass.
+ * dst           out         image after this pass.
+ * threads       in          number of threads to create.
  *
  * Returns       Method      Description
  * ----------------------------------------------------------------------------
@@ -149,74 +175,151 @@ void *partition(void *p)
  * NOTES:
  * - See pthreads documentation for more specific information.
  ******************************************************************************/
-void runParallel()
+void runParallel(const Mat& src, Mat& dst, int threads)
 {
     long t;
     void *status;
-    pthread_t tid[NUM_THREADS];
+    vector<pthread_t> tid(threads);
+    vector<PassBand> bands(threads);
     // Create threads and partition work
-    for (t = 0; t < NUM_THREADS; t++)
-        pthread_create(&tid[t], NULL, partition, (void *) t);
+    for (t = 0; t < threads; t++)
+    {
+        PROFILE_SCOPE("thread create");
+        bands[t].src = &src;
+        bands[t].dst = &dst;
+        bands[t].tid = t;
+        bands[t].threads = threads;
+        pthread_create(&tid[t], NULL, partition, &bands[t]);
+    }
     // Join threads
-    for (t = 0; t < NUM_THREADS; t++)
+    PROFILE_SCOPE("thread join");
+    for (t = 0; t < threads; t++)
         pthread_join(tid[t], &status);
 }
 
+/******************************* pthreadPass *******************************
+ * void pthreadPass(void *arg, const Mat& src, Mat& dst)
+ *
+ * Description: One pass of the original engine, threads created and
+ * joined per pass.
+ ******************************************************************************/
+void pthreadPass(void *arg, const Mat& src, Mat& dst)
+{
+    runParallel(src, dst, ((PthreadEngine *) arg)->threads);
+}
+
+/**************************** parallel engines *****************************
+ * SmoothFunction wrappers.  pthread is the original engine (arg is a
+ * PthreadEngine), pool is a SmoothingContext on a persistent ThreadPool.
+ ******************************************************************************/
+void runPthread(void *arg, const Mat& src, Mat& dst, int iterations)
+{
+    PthreadEngine *engine = (PthreadEngine *) arg;
+    runPasses(pthreadPass, engine, src, dst, engine->spare, iterations);
+}
+
+void runPool(void *arg, const Mat& src, Mat& dst, int iterations)
+{
+    SmoothingContext *context = (SmoothingContext *) arg;
+    context->params.iterations = iterations;
+    context->smooth(src, dst);
+}
+
+const BenchmarkEngine ENGINES[] =
+{
+    { "pthread", runPthread, NULL, 0 },  // arg and threads set in main
+    { "pool",    runPool,    NULL, 0 },
+};
+const int NUM_ENGINES = sizeof(ENGINES) / sizeof(ENGINES[0]);
+
 int main(int argc, char** argv)
 {
-    int n = atoi(argv[1]);
-    char *imageName = argv[2];
-    int t, averageOps = 1;
+    int opt, e, averageOps;
+    Mat image;
+    MappedImage inputMap;      // a .bgr input is used in place
+    BufferPool buffers;        // output and spare buffers of every run
+    BenchmarkConfig config = DEFAULT_BENCHMARK_CONFIG;
+    BenchmarkFormat format = BENCH_CSV;
+    vector<BenchmarkEngine> engines;
+    int threads = hardwareThreads(); // -j
     
-    // Read in image used in averaging operation
-    IMAGE = imread(imageName, 1);
+    while ((opt = getopt(argc, argv, "e:w:n:f:j:")) != -1)
+    {
+        if (opt == 'e' && selectEngines(optarg, ENGINES, NUM_ENGINES, engines))
+            continue;
+        else if (opt == 'w')
+            config.warmups = atoi(optarg);
+        else if (opt == 'n')
+            config.repetitions = atoi(optarg);
+        else if (opt == 'f' && parseBenchmarkFormat(optarg, format))
+            continue;
+        else if (opt == 'j')
+            threads = atoi(optarg);
+        else
+        {
+            cout << "usage: " << argv[0];
+            cout << " [-e pthread,pool] [-w warmups] [-n reps] [-f csv|json] [-j threads] number_of_avgs path_to_image" << endl;
+            return -1;
+        }
+    }
     
     // Ensure command line arguments were read successfully
-    if (argc != 3)
+    if (argc - optind != 2)
     {
         cout << "usage: " << argv[0];
-        cout << " number_of_avgs path_to_image path_to_output" << endl;
+        cout << " [-e pthread,pool] [-w warmups] [-n reps] [-f csv|json] [-j threads] number_of_avgs path_to_image" << endl;
         return -1;
     }
-    else if (n < 1)
+    int n = atoi(argv[optind]);
+    char *imageName = argv[optind + 1];
+    
+    // Read in image used in averaging operation
+    image = readImage(imageName, inputMap);
+    
+    if (n < 1)
     {
         cout << "Number of averaging iterations must be > 0\n " << endl;
         return -1;
     }
-    else if (!imageName || !IMAGE.data)
+    else if (config.warmups < 0 || config.repetitions < 1)
+    {
+        cout << "Warm-up runs must be >= 0 and repetitions > 0\n " << endl;
+        return -1;
+    }
+    else if (threads < 1)
+    {
+        cout << "Number of threads must be > 0\n " << endl;
+        return -1;
+    }
+    else if (!imageName || !image.data)
     {
         cout << "No image data \n" << endl;
         cout << "usage: " << argv[0];
-        cout << " number_of_avgs path_to_image path_to_output" << endl;
+        cout << " [-e pthread,pool] [-w warmups] [-n reps] [-f csv|json] [-j threads] number_of_avgs path_to_image" << endl;
         return -1;
     }
-    
-    RESULT_IMAGE = IMAGE.clone();
-    ORIGINAL = IMAGE.clone();
-    
-    // Conduct n averages of image and record time
-    double prev_elapsed_secs = 0.0, curr_elapsed_secs = 0.0, total_time = 0.0;
-    clock_t begin, end;
-    while (averageOps <= n)
+    if (engines.empty())
+        engines.assign(ENGINES, ENGINES + NUM_ENGINES);
+    PthreadEngine pthreadEngine;
+    pthreadEngine.threads = threads;
+    pthreadEngine.spare = buffers.acquire(image.rows, image.cols, image.type());
+    config.buffers = &buffers;
+    ThreadPool pool(threads);
+    SmoothingContext context(pool);
+    for (e = 0; e < (int) engines.size(); e++)
     {
-        begin = clock();
-        for (t = 0; t < averageOps; t++)
-        {
-            runParallel();
-            IMAGE = RESULT_IMAGE.clone();
-        }
-        end = clock();
-        curr_elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
-        if (averageOps > 0)
-        {
-            cout << averageOps << " : " << curr_elapsed_secs / prev_elapsed_secs;
-            cout << " : " << total_time << endl;
-        }
-        total_time += curr_elapsed_secs;
-        prev_elapsed_secs = curr_elapsed_secs;
-        averageOps *= 2; // double the amount of work
-        IMAGE = ORIGINAL.clone(); // reset to original image
+        engines[e].threads = threads;
+        engines[e].arg = engines[e].run == runPool ? (void *) &context : (void *) &pthreadEngine;
     }
     
+    // Double the amount of work up to n, every engine at every step
+    printBenchmarkHeader(cout, format);
+    for (averageOps = 1; averageOps <= n; averageOps *= 2)
+        for (e = 0; e < (int) engines.size(); e++)
+            printBenchmarkResult(cout, runBenchmark(engines[e], image, imageName, averageOps, config), format);
+    buffers.release(pthreadEngine.spare);
+    buffers.printStats(cerr);
+    PROFILE_REPORT("ParallelTiming");
+    
     return 0;
 }
@@ -1,14 +1,23 @@
 /*********************************************************************************
  * main.c written by Timothy Hennessy
  *
- * Description: Performs a doubling time operation and prints out the ratio.
+ * Description: Benchmarks the sequential engines on one image, doubling
+ * the number of averaging operations up to num, and prints one CSV row or
+ * JSON object per engine and iteration count.
  *
  * compile: see README.txt for details.
- * execute: ./a.out <num> path/<input_image_name>.jpg
+ * execute: ./a.out [-e engines] [-w warmups] [-n reps] [-f csv|json] <num> path/<input_image_name>.jpg
  ********************************************************************************/
-#include <ctime>
+#include <unistd.h>
 #include <opencv2/opencv.hpp>
 #include <iostream>
+#include "benchmark.hpp"
+#include "boxAverage.hpp"
+#include "bufferPool.hpp"
+#include "integralImage.hpp"
+#include "planarLayout.hpp"
+#include "profile.hpp"
+#include "rawImage.hpp"
 using namespace std;
 using namespace cv;
 
@@ -70,64 +79,142 @@ void neighborhoodAverage(const Mat& img, Mat& result, int r, int c)
     result.template at<Vec3b>(r,c)[2] = avgRed;
 }
 
+/****************************** originalPass ******************************
+ * void originalPass(void *arg, const Mat& src, Mat& dst)
+ *
+ * Description: One pass of the original per pixel neighborhoodAverage,
+ * kept as the baseline every other engine is measured against.
+ **************************************************************************/
+void originalPass(void *arg, const Mat& src, Mat& dst)
+{
+    int i, j;
+    for (i = 0; i < src.rows; i++)
+        for (j = 0; j < src.cols; j++)
+            neighborhoodAverage(src, dst, i, j);
+}
+
+void boxPass(void *arg, const Mat& src, Mat& dst)
+{
+    boxAverage(src, dst, 1, *(AverageScratch *) arg);
+}
+
+void integralPass(void *arg, const Mat& src, Mat& dst)
+{
+    SummedAreaTable *table = (SummedAreaTable *) arg;
+    buildSummedAreaTable(src, *table);
+    integralAverage(*table, dst, 1, 1);
+}
+
+/*************************** sequential engines ***************************
+ * SmoothFunction wrappers.  The spare ping-pong buffer (from the pool in
+ * main), the kernel scratch, the summed-area table and the planes are
+ * kept between runs so the timed region does not allocate.
+ **************************************************************************/
+Mat SPARE;
+AverageScratch SCRATCH;
+SummedAreaTable TABLE;
+PlanarWork PLANES;
+
+void runOriginal(void *arg, const Mat& src, Mat& dst, int iterations)
+{
+    runPasses(originalPass, NULL, src, dst, SPARE, iterations);
+}
+
+void runBox(void *arg, const Mat& src, Mat& dst, int iterations)
+{
+    runPasses(boxPass, &SCRATCH, src, dst, SPARE, iterations);
+}
+
+void runIntegral(void *arg, const Mat& src, Mat& dst, int iterations)
+{
+    runPasses(integralPass, &TABLE, src, dst, SPARE, iterations);
+}
+
+void runPlanar(void *arg, const Mat& src, Mat& dst, int iterations)
+{
+    smoothPlanar(src, dst, 1, iterations, PLANES);
+}
+
+const BenchmarkEngine ENGINES[] =
+{
+    { "original", runOriginal, NULL, 1 },
+    { "box",      runBox,      NULL, 1 },
+    { "integral", runIntegral, NULL, 1 },
+    { "planar",   runPlanar,   NULL, 1 },
+};
+const int NUM_ENGINES = sizeof(ENGINES) / sizeof(ENGINES[0]);
+
 int main(int argc, char** argv)
 {
-    int i, j, t, averageOps = 1;
-    int n = atoi(argv[1]);     // doubling limit
-    char *imageName = argv[2]; // input image
-    Mat image, averagedImage, original;
+    int opt, e, averageOps;
+    Mat image;
+    MappedImage inputMap;      // a .bgr input is used in place
+    BufferPool buffers;        // output and spare buffers of every run
+    BenchmarkConfig config = DEFAULT_BENCHMARK_CONFIG;
+    BenchmarkFormat format = BENCH_CSV;
+    vector<BenchmarkEngine> engines;
     
-    // Read in image used in averaging operation
-    image = imread(imageName, 1);
+    while ((opt = getopt(argc, argv, "e:w:n:f:")) != -1)
+    {
+        if (opt == 'e' && selectEngines(optarg, ENGINES, NUM_ENGINES, engines))
+            continue;
+        else if (opt == 'w')
+            config.warmups = atoi(optarg);
+        else if (opt == 'n')
+            config.repetitions = atoi(optarg);
+        else if (opt == 'f' && parseBenchmarkFormat(optarg, format))
+            continue;
+        else
+        {
+            cout << "usage: " << argv[0];
+            cout << " [-e original,box,integral,planar] [-w warmups] [-n reps] [-f csv|json] number_of_avgs path_to_image" << endl;
+            return -1;
+        }
+    }
     
     // Ensure command line arguments were read successfully
-    if (argc != 3)
+    if (argc - optind != 2)
     {
         cout << "usage: " << argv[0];
-        cout << " number_of_avgs path_to_image path_to_output" << endl;
+        cout << " [-e original,box,integral,planar] [-w warmups] [-n reps] [-f csv|json] number_of_avgs path_to_image" << endl;
         return -1;
     }
-    else if (n < 1)
+    int n = atoi(argv[optind]);        // doubling limit
+    char *imageName = argv[optind + 1]; // input image
+    
+    // Read in image used in averaging operation
+    image = readImage(imageName, inputMap);
+    
+    if (n < 1)
     {
         cout << "Number of averaging iterations must be > 0\n " << endl;
         return -1;
     }
+    else if (config.warmups < 0 || config.repetitions < 1)
+    {
+        cout << "Warm-up runs must be >= 0 and repetitions > 0\n " << endl;
+        return -1;
+    }
     else if (!imageName || !image.data)
     {
         cout << "No image data \n" << endl;
         cout << "usage: " << argv[0];
-        cout << " number_of_avgs path_to_image path_to_output" << endl;
+        cout << " [-e original,box,integral,planar] [-w warmups] [-n reps] [-f csv|json] number_of_avgs path_to_image" << endl;
         return -1;
     }
+    if (engines.empty())
+        engines.assign(ENGINES, ENGINES + NUM_ENGINES);
+    config.buffers = &buffers;
+    SPARE = buffers.acquire(image.rows, image.cols, image.type());
     
-    averagedImage = image.clone();
-    original = image.clone();
-
-    cout << "#    ratio   total" << endl;
-    clock_t begin, end;
-    double prev_elapsed_secs = 0.0, curr_elapsed_secs = 0.0, total_time = 0.0;
-    while (averageOps <= n)
-    {
-        begin = clock();
-        for (t = 0; t < averageOps; t++)
-        {
-            for (i = 0; i < image.rows; i++)
-                for (j = 0; j < image.cols; j++)
-                    neighborhoodAverage(image, averagedImage, i, j);
-            image = averagedImage.clone();
-        }
-        end = clock();
-        curr_elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
-        if (averageOps > 0)
-        {
-            cout << averageOps << " : " << curr_elapsed_secs / prev_elapsed_secs;
-            cout << " : " << total_time << endl;
-        }
-        total_time += curr_elapsed_secs;
-        prev_elapsed_secs = curr_elapsed_secs;
-        averageOps *= 2; // double the amount of work
-        image = original.clone(); // reset to original image
-    }
+    // Double the amount of work up to n, every engine at every step
+    printBenchmarkHeader(cout, format);
+    for (averageOps = 1; averageOps <= n; averageOps *= 2)
+        for (e = 0; e < (int) engines.size(); e++)
+            printBenchmarkResult(cout, runBenchmark(engines[e], image, imageName, averageOps, config), format);
+    buffers.release(SPARE);
+    buffers.printStats(cerr);
+    PROFILE_REPORT("SequentialTiming");
     
     return 0;
 }
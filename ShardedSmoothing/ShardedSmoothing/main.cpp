@@ -0,0 +1,232 @@
+/***********************************************************************************
+ * main.c written by Timothy Hennessy
+ *
+ * Description: Smooths one large image with several worker processes.
+ * Every worker owns a band of rows plus a halo of haloRows = k * radius
+ * rows on each side, runs k iterations on its band, then swaps the
+ * boundary rows of its band with its neighbors through a HaloTransport
+ * (POSIX shared memory or Unix domain sockets).  The result is byte for
+ * byte the same as a single process run.
+ *
+ * compile: see README.txt for details.
+ * execute: ./a.out [-r radius] [-P workers] [-k iters] [-T shm|socket]
+ *          <num> path/<input_image_name>.jpg path/<output_image_name>.jpg
+ *********************************************************************************/
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/types.h>
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include "boxAverage.hpp"
+#include "haloTransport.hpp"
+#include "profile.hpp"
+#include "rawImage.hpp"
+#include "timer.hpp"
+using namespace cv;
+using namespace std;
+
+/********************************  runShard  ********************************
+ * bool runShard(HaloTransport& transport, const Mat& image,
+ *               const vector<int>& bounds, int worker, int radius,
+ *               int iterations, int blockIters)
+ *
+ * Description: Body of worker process worker.  Smooths rows
+ * [bounds[worker], bounds[worker + 1]) of image and sends them to the
+ * parent.
+ *
+ * Process:
+ * 1.) Copy the band plus haloRows rows on each side (clipped to the image)
+ *     into a local buffer.
+ * 2.) Run blockIters iterations on the whole buffer.  Rows next to a halo
+ *     edge that is not an image edge go wrong by radius rows per iteration,
+ *     so after blockIters iterations exactly the halo is wrong and the
+ *     band is still right.
+ * 3.) Swap the outer haloRows rows of the band with the neighbors, which
+ *     makes the halo right again, and repeat until iterations are done.
+ *
+ * Parameter     Direction   Description
+ * ----------------------------------------------------------------------------
+ * transport     in          attached to worker.
+ * image         in          whole input, inherited from the parent.
+ * bounds        in          first row of every band, then image.rows.
+ * worker        in          band of this process.
+ * radius        in          neighborhood radius.
+ * iterations    in          averaging operations.
+ * blockIters    in          iterations between exchanges.
+ *
+ * Returns       Method      Description
+ * ----------------------------------------------------------------------------
+ * bool          value       False if the transport failed.
+ *
+ * NOTES:
+ * - Every band must hold at least haloRows rows, so a halo always comes
+ *   from the adjacent band alone.
+ ******************************************************************************/
+bool runShard(HaloTransport& transport, const Mat& image, const vector<int>& bounds,
+              int worker, int radius, int iterations, int blockIters)
+{
+    int haloRows = blockIters * radius;
+    int first = bounds[worker], last = bounds[worker + 1];
+    int top = max(0, first - haloRows), bottom = min(image.rows, last + haloRows);
+    bool hasUp = worker > 0, hasDown = worker < (int) bounds.size() - 2;
+    Mat buffers[2];
+    AverageScratch scratch;
+    int current = 0, averageOps = 0, block, t;
+    image.rowRange(top, bottom).copyTo(buffers[0]);
+    buffers[1].create(buffers[0].size(), buffers[0].type());
+    while (averageOps < iterations)
+    {
+        block = min(blockIters, iterations - averageOps);
+        {
+            PROFILE_SCOPE("average");
+            for (t = 0; t < block; t++)
+            {
+                boxAverage(buffers[current], buffers[1 - current], radius, scratch);
+                current = 1 - current;
+            }
+        }
+        averageOps += block;
+        if (averageOps == iterations)
+            break;
+
+        // Own band edges out, neighbor band edges into the halo
+        PROFILE_SCOPE("exchange");
+        Mat& band = buffers[current];
+        if (!transport.exchange(hasUp ? band.ptr(first - top) : NULL,
+                                hasDown ? band.ptr(last - haloRows - top) : NULL,
+                                hasUp ? band.ptr(0) : NULL,
+                                hasDown ? band.ptr(last - top) : NULL))
+            return false;
+    }
+    return transport.sendResult(buffers[current].rowRange(first - top, last - top));
+}
+
+int main(int argc, char** argv)
+{
+    int opt, w;
+    int radius = 1;
+    int workers = 4;              // -P, processes
+    int blockIters = 1;           // -k, iterations between exchanges
+    string transportName = "shm"; // -T
+    MappedImage inputMap;
+    Mat image, result;
+    vector<int> bounds;
+    vector<pid_t> children;
+    pid_t pid;
+
+    while ((opt = getopt(argc, argv, "r:P:k:T:")) != -1)
+    {
+        if (opt == 'r')
+            radius = atoi(optarg);
+        else if (opt == 'P')
+            workers = atoi(optarg);
+        else if (opt == 'k')
+            blockIters = atoi(optarg);
+        else if (opt == 'T')
+            transportName = optarg;
+        else
+        {
+            cout << "usage: " << argv[0];
+            cout << " [-r radius] [-P workers] [-k iters] [-T shm|socket] number_of_avgs path_to_image path_to_output" << endl;
+            return -1;
+        }
+    }
+
+    // Ensure command line arguments were read successfully
+    if (argc - optind != 3)
+    {
+        cout << "usage: " << argv[0];
+        cout << " [-r radius] [-P workers] [-k iters] [-T shm|socket] number_of_avgs path_to_image path_to_output" << endl;
+        return -1;
+    }
+    int n = atoi(argv[optind]);
+    char *imageName = argv[optind + 1];
+    char *outImage = argv[optind + 2];
+
+    // Read in image used in averaging operation
+    image = readImage(imageName, inputMap);
+    HaloTransport *transport = createHaloTransport(transportName);
+
+    if (radius < 1)
+    {
+        cout << "Radius must be > 0\n " << endl;
+        return -1;
+    }
+    else if (n < 0)
+    {
+        cout << "Number of averaging iterations must be > 0\n " << endl;
+        return -1;
+    }
+    else if (workers < 1 || blockIters < 1)
+    {
+        cout << "Workers and iterations per exchange must be > 0\n " << endl;
+        return -1;
+    }
+    else if (!transport)
+    {
+        cout << "Unknown transport " << transportName << ", use shm or socket\n " << endl;
+        return -1;
+    }
+    else if (!image.data)
+    {
+        cout << "No image data \n" << endl;
+        cout << "usage: " << argv[0];
+        cout << " [-r radius] [-P workers] [-k iters] [-T shm|socket] number_of_avgs path_to_image path_to_output" << endl;
+        return -1;
+    }
+    else if (workers > 1 && (long) image.rows / workers < (long) blockIters * radius)
+    {
+        cout << "Every worker needs at least k * radius = " << blockIters * radius;
+        cout << " rows, use fewer workers or a smaller -k\n " << endl;
+        return -1;
+    }
+
+    // Balanced bands, none shorter than rows / workers
+    for (w = 0; w <= workers; w++)
+        bounds.push_back((int) ((long) image.rows * w / workers));
+    result.create(image.size(), image.type());
+    if (!transport->setup(bounds, blockIters * radius, image.cols * image.elemSize()))
+    {
+        cout << "Could not set up the " << transportName << " transport" << endl;
+        return -1;
+    }
+
+    double begin = monotonicSeconds();
+    cout.flush();
+    for (w = 0; w < workers; w++)
+    {
+        pid = fork();
+        if (pid == 0)
+        {
+            transport->attach(w);
+            _exit(runShard(*transport, image, bounds, w, radius, n, blockIters) ? 0 : 1);
+        }
+        if (pid < 0)
+        {
+            cout << "Could not start worker " << w << endl;
+            return -1;
+        }
+        children.push_back(pid);
+    }
+    transport->attachParent();
+    bool ok = transport->finish(children, result);
+    double elapsed_secs = monotonicSeconds() - begin;
+    delete transport;
+    if (!ok)
+    {
+        cout << "A worker failed, no output written" << endl;
+        return -1;
+    }
+
+    cout << n << " averages on " << workers << " processes (" << transportName << ", exchange every ";
+    cout << blockIters << ") took: " << elapsed_secs << " seconds" << endl;
+    cout << result.size() << endl;
+
+    writeImage(outImage, result);
+    PROFILE_REPORT("ShardedSmoothing");
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+/***********************************************************************************
+ * activeTiles.cpp written by Timothy Hennessy
+ *
+ * Description: Per tile change tracking that skips stable tiles.
+ *********************************************************************************/
+#include <cstring>
+#include "activeTiles.hpp"
+#include "boxAverage.hpp"
+using namespace cv;
+using namespace std;
+
+ActiveTiles::ActiveTiles()
+    : tiles(DEFAULT_TILE_CONFIG), radius(1), across(0), down(0), reachX(0), reachY(0),
+      passes(0), ranTiles(0), skippedTiles(0)
+{
+}
+
+/*************************** ActiveTiles::reset ***************************
+ * void ActiveTiles::reset(const Size& size, const TileConfig& tiles,
+ *                         int radius)
+ *
+ * Description: Starts tracking a new run over an image of size, every
+ * tile active.
+ **************************************************************************/
+void ActiveTiles::reset(const Size& size, const TileConfig& tiles, int radius)
+{
+    this->size = size;
+    this->tiles = tiles;
+    this->radius = radius;
+    across = (size.width + tiles.tileCols - 1) / tiles.tileCols;
+    down = (size.height + tiles.tileRows - 1) / tiles.tileRows;
+    reachX = (radius + tiles.tileCols - 1) / tiles.tileCols;
+    reachY = (radius + tiles.tileRows - 1) / tiles.tileRows;
+    passes = 0;
+    ranTiles = skippedTiles = 0;
+    active.assign(across * down, 1);
+    changed.assign(across * down, 0);
+}
+
+/**************************** ActiveTiles::run ****************************
+ * bool ActiveTiles::run(const Mat& src, Mat& dst, int tile,
+ *                       AverageScratch& scratch)
+ *
+ * Description: Averages tile from src into dst if it is active and
+ * records whether any of its pixels changed.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * src           in          image of the last pass.
+ * dst           in/out      image of the pass before it, receives this
+ *                           pass.  Must not alias src.
+ * tile          in          tile index, row-major as in tileRect.
+ * scratch       in/out      kernel scratch of the calling thread.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * bool          value       False if the tile was stable and skipped.
+ *
+ * NOTES:
+ * - Threads may run different tiles of the same pass concurrently.
+ **************************************************************************/
+bool ActiveTiles::run(const Mat& src, Mat& dst, int tile, AverageScratch& scratch)
+{
+    Rect rect = tileRect(size, tiles, tile);
+    size_t offset = rect.x * src.elemSize(), rowBytes = rect.width * src.elemSize();
+    int r;
+    if (!active[tile])
+        return false;
+    boxAverageRect(src, dst, radius, rect, scratch);
+    for (r = rect.y; r < rect.y + rect.height; r++)
+    {
+        if (memcmp(src.ptr(r) + offset, dst.ptr(r) + offset, rowBytes) != 0)
+        {
+            changed[tile] = 1;
+            break;
+        }
+    }
+    return true;
+}
+
+/************************** ActiveTiles::endPass **************************
+ * int ActiveTiles::endPass()
+ *
+ * Description: Closes a pass, once all of its tiles have run.  Marks the
+ * tiles within reach of a changed tile active for the next pass.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * int           value       Tiles that changed in the pass, 0 at a fixed
+ *                           point.
+ **************************************************************************/
+int ActiveTiles::endPass()
+{
+    int numChanged = 0, tx, ty, x, y, t;
+    for (t = 0; t < across * down; t++)
+    {
+        numChanged += changed[t];
+        if (active[t])
+            ranTiles++;
+        else
+            skippedTiles++;
+    }
+    passes++;
+    for (ty = 0; ty < down; ty++)
+    {
+        for (tx = 0; tx < across; tx++)
+        {
+            t = ty * across + tx;
+            active[t] = passes < 2;
+            for (y = max(ty - reachY, 0); y <= min(ty + reachY, down - 1) && !active[t]; y++)
+                for (x = max(tx - reachX, 0); x <= min(tx + reachX, across - 1); x++)
+                    if (changed[y * across + x])
+                        active[t] = 1;
+        }
+    }
+    fill(changed.begin(), changed.end(), 0);
+    return numChanged;
+}
+
+long ActiveTiles::tilesRun() const
+{
+    return ranTiles;
+}
+
+long ActiveTiles::tilesSkipped() const
+{
+    return skippedTiles;
+}
@@ -0,0 +1,52 @@
+/***********************************************************************************
+ * activeTiles.hpp written by Timothy Hennessy
+ *
+ * Description: Sparse active-tile tracking.  Under the truncating average,
+ * flat or already smooth regions stop changing after enough passes, yet a
+ * plain pass rewrites every pixel anyway.  ActiveTiles records, per tile,
+ * whether any pixel changed in the last pass and only recomputes tiles
+ * with a changed tile within radius of them.
+ *
+ * A skipped tile is exact without being written: nothing it reads changed,
+ * so its new value equals its last one, and the destination buffer already
+ * holds that value from two passes ago (both ping-pong buffers agree on a
+ * tile once it stops changing).  The first two passes run every tile so
+ * that both buffers have been written once.
+ *
+ * A pass that changes no tile means the image reached a fixed point, every
+ * later pass returns the same image, so callers may stop there.
+ *
+ * Usage (run may be called from several threads, for different tiles):
+ *     tracker.reset(image.size(), tiles, radius);
+ *     for every pass:
+ *         for every tile: tracker.run(src, dst, tile, scratch);
+ *         if (tracker.endPass() == 0) the image is at a fixed point
+ *********************************************************************************/
+#ifndef ACTIVE_TILES_HPP
+#define ACTIVE_TILES_HPP
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "temporalBlocking.hpp"
+
+class ActiveTiles
+{
+public:
+    ActiveTiles();
+    void reset(const cv::Size& size, const TileConfig& tiles, int radius);
+    bool run(const cv::Mat& src, cv::Mat& dst, int tile, AverageScratch& scratch);
+    int endPass();
+    long tilesRun() const;
+    long tilesSkipped() const;
+private:
+    cv::Size size;
+    TileConfig tiles;
+    int radius;
+    int across, down;            // tiles per row and column
+    int reachX, reachY;          // tiles a radius reaches into, each way
+    int passes;                  // passes ended since reset
+    long ranTiles, skippedTiles; // totals since reset
+    std::vector<uchar> active;   // tile is recomputed in the current pass
+    std::vector<uchar> changed;  // tile changed in the current pass
+};
+
+#endif
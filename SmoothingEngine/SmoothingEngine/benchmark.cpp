@@ -0,0 +1,231 @@
+/***********************************************************************************
+ * benchmark.cpp written by Timothy Hennessy
+ *
+ * Description: Benchmark driver, statistics and CSV/JSON output.
+ *
+ * NOTES:
+ * - JSON output is one object per line (JSON Lines) so runs can simply be
+ *   appended to a history file.
+ *********************************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include "benchmark.hpp"
+#include "profile.hpp"
+#include "timer.hpp"
+using namespace cv;
+using namespace std;
+
+/******************************* runPasses ********************************
+ * void runPasses(PassFunction pass, void *arg, const Mat& src, Mat& dst,
+ *                Mat& spare, int iterations)
+ *
+ * Description: Builds a SmoothFunction out of a single pass by ping-
+ * ponging between dst and spare, so no image is copied or allocated
+ * inside the timed region once both buffers exist.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * pass          in          one averaging operation.
+ * arg           in          passed to pass.
+ * src           in          input image, never modified.
+ * dst           out         result after iterations passes.
+ * spare         in/out      scratch buffer, kept by the caller for reuse.
+ * iterations    in          number of passes, 0 copies src.
+ *
+ * NOTES:
+ * - The first pass writes whichever buffer makes the last one land in dst.
+ **************************************************************************/
+void runPasses(PassFunction pass, void *arg, const Mat& src, Mat& dst,
+               Mat& spare, int iterations)
+{
+    const Mat *in = &src;
+    Mat *out;
+    int t;
+    dst.create(src.size(), src.type());
+    spare.create(src.size(), src.type());
+    if (iterations == 0)
+        src.copyTo(dst);
+    for (t = 0; t < iterations; t++)
+    {
+        out = (iterations - 1 - t) % 2 == 0 ? &dst : &spare;
+        PROFILE_SCOPE("pass");
+        pass(arg, *in, *out);
+        in = out;
+    }
+}
+
+/****************************** runBenchmark ******************************
+ * BenchmarkResult runBenchmark(const BenchmarkEngine& engine,
+ *                              const Mat& image, const string& imageName,
+ *                              int iterations, const BenchmarkConfig& config)
+ *
+ * Description: Times engine running iterations averaging operations on
+ * image and summarizes the samples.
+ *
+ * Process:
+ * 1.) Run config.warmups untimed runs to fault in buffers and caches.
+ * 2.) Time config.repetitions runs with the monotonic wall clock.
+ * 3.) Sort the samples and compute median, p95, mean and stddev.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * engine        in          engine under test.
+ * image         in          input image, never modified.
+ * imageName     in          reported only.
+ * iterations    in          averaging operations per run.
+ * config        in          warm-up and repetition counts, buffer pool.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * BenchmarkResult value     samples and statistics.
+ *
+ * NOTES:
+ * - p95 is the nearest-rank percentile, stddev the sample (n - 1) one.
+ * - bytesMoved is the compulsory traffic of a pass, one read and one
+ *   write of the image per iteration.  Real traffic is higher when the
+ *   image does not fit in cache.
+ * - With config.buffers the output comes from the pool and goes back to
+ *   it, so every (engine, iterations) pair reuses the same buffer.
+ **************************************************************************/
+BenchmarkResult runBenchmark(const BenchmarkEngine& engine, const Mat& image,
+                             const string& imageName, int iterations,
+                             const BenchmarkConfig& config)
+{
+    BenchmarkResult result;
+    Mat output;
+    double begin, sum = 0.0, squares = 0.0;
+    int i, n = max(config.repetitions, 1);
+
+    if (config.buffers)
+        output = config.buffers->acquire(image.rows, image.cols, image.type());
+    for (i = 0; i < config.warmups; i++)
+        engine.run(engine.arg, image, output, iterations);
+    for (i = 0; i < n; i++)
+    {
+        begin = monotonicSeconds();
+        engine.run(engine.arg, image, output, iterations);
+        result.samples.push_back(monotonicSeconds() - begin);
+    }
+    if (config.buffers)
+        config.buffers->release(output);
+    sort(result.samples.begin(), result.samples.end());
+
+    for (i = 0; i < n; i++)
+        sum += result.samples[i];
+    result.meanSecs = sum / n;
+    for (i = 0; i < n; i++)
+        squares += (result.samples[i] - result.meanSecs) * (result.samples[i] - result.meanSecs);
+    result.stddevSecs = n > 1 ? sqrt(squares / (n - 1)) : 0.0;
+    result.medianSecs = n % 2 ? result.samples[n / 2]
+                              : 0.5 * (result.samples[n / 2 - 1] + result.samples[n / 2]);
+    result.p95Secs = result.samples[(int) ceil(0.95 * n) - 1];
+
+    result.engine = engine.name;
+    result.image = imageName;
+    result.rows = image.rows;
+    result.cols = image.cols;
+    result.channels = image.channels();
+    result.threads = engine.threads;
+    result.iterations = iterations;
+    result.megapixelsPerSec = result.medianSecs > 0.0
+        ? (double) image.total() * iterations / result.medianSecs / 1e6 : 0.0;
+    result.bytesMoved = 2.0 * image.total() * image.elemSize() * iterations;
+    return result;
+}
+
+/****************************** selectEngines *****************************
+ * bool selectEngines(const char *names, const BenchmarkEngine *engines,
+ *                    int count, vector<BenchmarkEngine>& selected)
+ *
+ * Description: Appends the engines named in the comma separated list
+ * names to selected, in list order.  Returns false on an unknown name.
+ **************************************************************************/
+bool selectEngines(const char *names, const BenchmarkEngine *engines, int count,
+                   vector<BenchmarkEngine>& selected)
+{
+    string list(names), name;
+    size_t start = 0, end;
+    int e;
+    while (start <= list.size())
+    {
+        end = list.find(',', start);
+        if (end == string::npos)
+            end = list.size();
+        name = list.substr(start, end - start);
+        for (e = 0; e < count && name != engines[e].name; e++)
+            ;
+        if (e == count)
+            return false;
+        selected.push_back(engines[e]);
+        start = end + 1;
+    }
+    return true;
+}
+
+bool parseBenchmarkFormat(const char *name, BenchmarkFormat& format)
+{
+    if (strcmp(name, "csv") == 0)
+        format = BENCH_CSV;
+    else if (strcmp(name, "json") == 0)
+        format = BENCH_JSON;
+    else
+        return false;
+    return true;
+}
+
+/*************************** printBenchmarkHeader *************************
+ * Description: Prints the CSV column names.  JSON needs no header.
+ **************************************************************************/
+void printBenchmarkHeader(ostream& out, BenchmarkFormat format)
+{
+    if (format == BENCH_CSV)
+    {
+        out << "engine,image,rows,cols,channels,threads,iterations,repetitions,";
+        out << "median_secs,p95_secs,mean_secs,stddev_secs,mpixels_per_sec,bytes_moved" << endl;
+    }
+}
+
+/*************************** printBenchmarkResult *************************
+ * Description: Prints result as one CSV row or one JSON object per line.
+ * The image name is quoted in both formats, quotes and backslashes in it
+ * are escaped for JSON.
+ **************************************************************************/
+void printBenchmarkResult(ostream& out, const BenchmarkResult& result,
+                          BenchmarkFormat format)
+{
+    string image;
+    size_t i;
+    for (i = 0; i < result.image.size(); i++)
+    {
+        if (result.image[i] == '"' || (format == BENCH_JSON && result.image[i] == '\\'))
+            image += format == BENCH_CSV ? '"' : '\\';
+        image += result.image[i];
+    }
+
+    out << setprecision(9);
+    if (format == BENCH_CSV)
+    {
+        out << result.engine << ",\"" << image << "\"," << result.rows << ",";
+        out << result.cols << "," << result.channels << "," << result.threads << ",";
+        out << result.iterations << "," << result.samples.size() << ",";
+        out << result.medianSecs << "," << result.p95Secs << "," << result.meanSecs << ",";
+        out << result.stddevSecs << "," << result.megapixelsPerSec << ",";
+        out << fixed << setprecision(0) << result.bytesMoved << endl;
+    }
+    else
+    {
+        out << "{\"engine\": \"" << result.engine << "\", \"image\": \"" << image << "\", ";
+        out << "\"rows\": " << result.rows << ", \"cols\": " << result.cols << ", ";
+        out << "\"channels\": " << result.channels << ", \"threads\": " << result.threads << ", ";
+        out << "\"iterations\": " << result.iterations << ", ";
+        out << "\"repetitions\": " << result.samples.size() << ", ";
+        out << "\"median_secs\": " << result.medianSecs << ", \"p95_secs\": " << result.p95Secs << ", ";
+        out << "\"mean_secs\": " << result.meanSecs << ", \"stddev_secs\": " << result.stddevSecs << ", ";
+        out << "\"mpixels_per_sec\": " << result.megapixelsPerSec << ", ";
+        out << "\"bytes_moved\": " << fixed << setprecision(0) << result.bytesMoved << "}" << endl;
+    }
+    out.unsetf(ios::floatfield);
+    out << setprecision(6);
+}
@@ -0,0 +1,65 @@
+/***********************************************************************************
+ * benchmark.hpp written by Timothy Hennessy
+ *
+ * Description: Benchmark driver shared by the timing tools.  Any engine is
+ * wrapped in a BenchmarkEngine (a run function plus its state), timed with
+ * the monotonic wall clock over warm-up runs and repetitions, and reported
+ * as one CSV row or JSON object per (engine, iterations) pair so results
+ * can be collected across commits to track regressions.
+ *********************************************************************************/
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "bufferPool.hpp"
+
+// Runs iterations averaging operations on src and leaves the result in
+// dst.  src must not be modified, dst is allocated by the engine.
+typedef void (*SmoothFunction)(void *arg, const cv::Mat& src, cv::Mat& dst, int iterations);
+// Runs one averaging operation from src into dst, both allocated.
+typedef void (*PassFunction)(void *arg, const cv::Mat& src, cv::Mat& dst);
+
+struct BenchmarkEngine
+{
+    const char *name;
+    SmoothFunction run;
+    void *arg;          // engine state, passed to run
+    int threads;        // reported only
+};
+
+struct BenchmarkConfig
+{
+    int warmups;        // untimed runs before the first sample
+    int repetitions;    // timed runs, one sample each
+    BufferPool *buffers;    // output buffer source, NULL lets the engine allocate
+};
+
+struct BenchmarkResult
+{
+    std::string engine, image;
+    int rows, cols, channels, threads, iterations;
+    std::vector<double> samples;    // seconds per run, sorted
+    double medianSecs, p95Secs, meanSecs, stddevSecs;
+    double megapixelsPerSec;        // pixels * iterations / median
+    double bytesMoved;              // one read and one write per iteration
+};
+
+enum BenchmarkFormat { BENCH_CSV, BENCH_JSON };
+
+const BenchmarkConfig DEFAULT_BENCHMARK_CONFIG = { 1, 5, NULL };
+
+void runPasses(PassFunction pass, void *arg, const cv::Mat& src, cv::Mat& dst,
+               cv::Mat& spare, int iterations);
+BenchmarkResult runBenchmark(const BenchmarkEngine& engine, const cv::Mat& image,
+                             const std::string& imageName, int iterations,
+                             const BenchmarkConfig& config);
+bool selectEngines(const char *names, const BenchmarkEngine *engines, int count,
+                   std::vector<BenchmarkEngine>& selected);
+bool parseBenchmarkFormat(const char *name, BenchmarkFormat& format);
+void printBenchmarkHeader(std::ostream& out, BenchmarkFormat format);
+void printBenchmarkResult(std::ostream& out, const BenchmarkResult& result,
+                          BenchmarkFormat format);
+
+#endif
@@ -0,0 +1,139 @@
+/***********************************************************************************
+ * boundedQueue.hpp written by Timothy Hennessy
+ *
+ * Description: Blocking FIFO with a fixed capacity, used to connect
+ * pipeline stages.  A full queue blocks its producers, which is what keeps
+ * memory bounded when a later stage is slower than an earlier one.
+ *********************************************************************************/
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+#include <pthread.h>
+#include <deque>
+
+template <typename T>
+class BoundedQueue
+{
+public:
+    BoundedQueue(int capacity) : capacity(capacity < 1 ? 1 : capacity), closed(false)
+    {
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&notFull, NULL);
+        pthread_cond_init(&notEmpty, NULL);
+    }
+
+    ~BoundedQueue()
+    {
+        pthread_cond_destroy(&notEmpty);
+        pthread_cond_destroy(&notFull);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    /************************** BoundedQueue::push ************************
+     * bool push(const T& item)
+     *
+     * Description: Appends item, blocking while the queue is full.
+     * Returns false, dropping item, if the queue was closed.
+     **********************************************************************/
+    bool push(const T& item)
+    {
+        pthread_mutex_lock(&mutex);
+        while ((int) items.size() >= capacity && !closed)
+            pthread_cond_wait(&notFull, &mutex);
+        if (closed)
+        {
+            pthread_mutex_unlock(&mutex);
+            return false;
+        }
+        items.push_back(item);
+        pthread_cond_signal(&notEmpty);
+        pthread_mutex_unlock(&mutex);
+        return true;
+    }
+
+    /************************ BoundedQueue::tryPush ***********************
+     * bool tryPush(const T& item)
+     *
+     * Description: Appends item only if there is room right now.  Returns
+     * false, dropping item, if the queue is full or closed.
+     **********************************************************************/
+    bool tryPush(const T& item)
+    {
+        bool pushed = false;
+        pthread_mutex_lock(&mutex);
+        if ((int) items.size() < capacity && !closed)
+        {
+            items.push_back(item);
+            pthread_cond_signal(&notEmpty);
+            pushed = true;
+        }
+        pthread_mutex_unlock(&mutex);
+        return pushed;
+    }
+
+    /************************** BoundedQueue::pop *************************
+     * bool pop(T& item)
+     *
+     * Description: Removes the oldest item, blocking while the queue is
+     * empty.  Returns false once the queue is closed and drained.
+     **********************************************************************/
+    bool pop(T& item)
+    {
+        pthread_mutex_lock(&mutex);
+        while (items.empty() && !closed)
+            pthread_cond_wait(&notEmpty, &mutex);
+        if (items.empty())
+        {
+            pthread_mutex_unlock(&mutex);
+            return false;
+        }
+        item = items.front();
+        items.pop_front();
+        pthread_cond_signal(&notFull);
+        pthread_mutex_unlock(&mutex);
+        return true;
+    }
+
+    /************************* BoundedQueue::tryPop ***********************
+     * bool tryPop(T& item)
+     *
+     * Description: Removes the oldest item only if there is one right now.
+     **********************************************************************/
+    bool tryPop(T& item)
+    {
+        bool popped = false;
+        pthread_mutex_lock(&mutex);
+        if (!items.empty())
+        {
+            item = items.front();
+            items.pop_front();
+            pthread_cond_signal(&notFull);
+            popped = true;
+        }
+        pthread_mutex_unlock(&mutex);
+        return popped;
+    }
+
+    /************************* BoundedQueue::close ************************
+     * void close()
+     *
+     * Description: No more items will be pushed.  Consumers drain what is
+     * left and then pop returns false.
+     **********************************************************************/
+    void close()
+    {
+        pthread_mutex_lock(&mutex);
+        closed = true;
+        pthread_cond_broadcast(&notEmpty);
+        pthread_cond_broadcast(&notFull);
+        pthread_mutex_unlock(&mutex);
+    }
+
+private:
+    std::deque<T> items;
+    int capacity;
+    bool closed;
+    pthread_mutex_t mutex;
+    pthread_cond_t notFull, notEmpty;
+};
+
+#endif
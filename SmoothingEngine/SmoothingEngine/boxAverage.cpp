@@ -0,0 +1,193 @@
+/***********************************************************************************
+ * boxAverage.cpp written by Timothy Hennessy
+ *
+ * Description: Separable running-sum box average.  A horizontal pass sums
+ * each row over the window by adding the entering pixel and subtracting the
+ * leaving one, then a vertical pass does the same with whole rows of
+ * horizontal sums.
+ *********************************************************************************/
+#include "boxAverage.hpp"
+#include "simdAverage.hpp"
+using namespace cv;
+using namespace std;
+
+/**************************** horizontalBoxSums ***************************
+ * void horizontalBoxSums(const uchar *row, int cols, int cn, int radius,
+ *                        int startCol, int endCol, int *out)
+ *
+ * Description: Sums every channel of row over [c - radius, c + radius]
+ * for each column c in [startCol, endCol), clipped to the row.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * row           in          Pointer to first pixel of an interleaved row.
+ * cols          in          Number of pixels in the row.
+ * cn            in          Number of channels per pixel.
+ * radius        in          Half width of the window.
+ * startCol      in          First column to produce.
+ * endCol        in          One past the last column to produce.
+ * out           out         (endCol - startCol) * cn running sums.
+ **************************************************************************/
+void horizontalBoxSums(const uchar *row, int cols, int cn, int radius,
+                       int startCol, int endCol, int *out)
+{
+    int c, k, first, last;
+    first = max(startCol - radius, 0);
+    last  = min(startCol + radius, cols - 1);
+    for (k = 0; k < cn; k++)
+        out[k] = 0;
+    for (c = first; c <= last; c++)
+        for (k = 0; k < cn; k++)
+            out[k] += row[c * cn + k];
+    for (c = startCol + 1; c < endCol; c++)
+    {
+        int *prev = out + (c - startCol - 1) * cn;
+        int *curr = prev + cn;
+        for (k = 0; k < cn; k++)
+            curr[k] = prev[k];
+        if (c + radius < cols)      // pixel entering the window
+            for (k = 0; k < cn; k++)
+                curr[k] += row[(c + radius) * cn + k];
+        if (c - radius - 1 >= 0)    // pixel leaving the window
+            for (k = 0; k < cn; k++)
+                curr[k] -= row[(c - radius - 1) * cn + k];
+    }
+}
+
+/****************************** boxAverageRect *****************************
+ * void boxAverageRect(const Mat& src, Mat& dst, int radius,
+ *                    const Rect& outRect, AverageScratch& scratch)
+ *
+ * Description: Averages the (2 * radius + 1)^2 neighborhood of every pixel
+ * in outRect, reading neighbors from anywhere in src, and stores the
+ * averages into the same pixels of dst.
+ *
+ * Process:
+ * 1.) Hand radius 1 on 8-bit images with up to 4 channels to the
+ *     vectorized 3x3 kernel, and every other image with 1, 3 or 4
+ *     channels to the specialized kernels of typedAverage.hpp.  What is
+ *     left is 8-bit images of other channel counts.
+ * 2.) Precompute the number of valid columns for every output column.
+ * 3.) Prime the vertical running sums with the rows above and at the
+ *     first output row.
+ * 4.) For every output row divide the running sums by the valid cell
+ *     count, then add the entering row and subtract the leaving row.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * src           in          8-bit image of any channel count, or 16U or
+ *                           32F with 1, 3 or 4 channels.
+ * dst           out         Preallocated image of same size and type as
+ *                           src.  Must not alias src.
+ * radius        in          Half width of the window, radius >= 1.
+ * outRect       in          Region of dst to compute.
+ * scratch       in/out      Row sums, grown to the width of outRect.
+ *
+ * NOTES:
+ * - Sums are kept in int, which is exact for radius up to roughly 1400.
+ * - Only outRect of dst is written, so threads may fill disjoint
+ *   rectangles of the same dst concurrently.
+ **************************************************************************/
+void boxAverageRect(const Mat& src, Mat& dst, int radius, const Rect& outRect,
+                    AverageScratch& scratch)
+{
+    CV_Assert(dst.size() == src.size() && dst.type() == src.type());
+    CV_Assert(radius >= 1);
+    AverageKernel kernel = selectAverageKernel(src.type(), radius);
+    int cn = src.channels();
+    int startRow = outRect.y, endRow = outRect.y + outRect.height;
+    int startCol = outRect.x, endCol = outRect.x + outRect.width;
+    int width = outRect.width * cn;
+    int *rowSum, *colSum, *colCount;
+    int i, j, k, r, vcount;
+    if (outRect.width <= 0 || outRect.height <= 0)
+        return;
+    if (radius == 1 && cn <= 4 && src.depth() == CV_8U)
+    {
+        average3x3Rect(src, dst, outRect);
+        return;
+    }
+    if (kernel)
+    {
+        kernel(src, dst, radius, outRect, scratch);
+        return;
+    }
+    CV_Assert(src.depth() == CV_8U);        // ensures pixel value range [0..255]
+    rowSum = scratchBuffer(scratch.intSums, 2 * (size_t) width);
+    colSum = rowSum + width;
+    colCount = scratchBuffer(scratch.counts, outRect.width);
+    for (j = 0; j < width; j++)
+        colSum[j] = 0;
+
+    for (j = startCol; j < endCol; j++)
+        colCount[j - startCol] = min(j + radius, src.cols - 1) - max(j - radius, 0) + 1;
+
+    // Prime vertical sums with rows [startRow - radius, startRow + radius)
+    for (i = max(startRow - radius, 0); i < min(startRow + radius, src.rows); i++)
+    {
+        horizontalBoxSums(src.ptr<uchar>(i), src.cols, cn, radius, startCol, endCol, rowSum);
+        for (j = 0; j < width; j++)
+            colSum[j] += rowSum[j];
+    }
+
+    for (r = startRow; r < endRow; r++)
+    {
+        uchar *out = dst.ptr<uchar>(r) + startCol * cn;
+        if (r + radius < src.rows)  // row entering the window
+        {
+            horizontalBoxSums(src.ptr<uchar>(r + radius), src.cols, cn, radius, startCol, endCol, rowSum);
+            for (j = 0; j < width; j++)
+                colSum[j] += rowSum[j];
+        }
+        vcount = min(r + radius, src.rows - 1) - max(r - radius, 0) + 1;
+        for (i = 0, j = 0; i < outRect.width; i++)
+        {
+            int count = colCount[i] * vcount;
+            for (k = 0; k < cn; k++, j++)
+                out[j] = saturate_cast<uchar>(colSum[j] / count);
+        }
+        if (r - radius >= 0)        // row leaving the window
+        {
+            horizontalBoxSums(src.ptr<uchar>(r - radius), src.cols, cn, radius, startCol, endCol, rowSum);
+            for (j = 0; j < width; j++)
+                colSum[j] -= rowSum[j];
+        }
+    }
+}
+
+/****************************** boxAverageRows *****************************
+ * void boxAverageRows(const Mat& src, Mat& dst, int radius,
+ *                    int startRow, int endRow, AverageScratch& scratch)
+ *
+ * Description: Convenience wrapper that averages full-width rows
+ * [startRow, endRow).  Used to split an image into row bands.
+ **************************************************************************/
+void boxAverageRows(const Mat& src, Mat& dst, int radius, int startRow, int endRow,
+                    AverageScratch& scratch)
+{
+    boxAverageRect(src, dst, radius, Rect(0, startRow, src.cols, endRow - startRow), scratch);
+}
+
+/******************************** boxAverage *******************************
+ * void boxAverage(const Mat& src, Mat& dst, int radius,
+ *                 AverageScratch& scratch)
+ *
+ * Description: Averages the whole image.  Allocates dst if needed.
+ **************************************************************************/
+void boxAverage(const Mat& src, Mat& dst, int radius, AverageScratch& scratch)
+{
+    dst.create(src.rows, src.cols, src.type());
+    boxAverageRows(src, dst, radius, 0, src.rows, scratch);
+}
+
+/******************************** boxAverage *******************************
+ * void boxAverage(const Mat& src, Mat& dst, int radius)
+ *
+ * Description: One-off version with its own scratch, which it allocates
+ * and frees on every call.
+ **************************************************************************/
+void boxAverage(const Mat& src, Mat& dst, int radius)
+{
+    AverageScratch scratch;
+    boxAverage(src, dst, radius, scratch);
+}
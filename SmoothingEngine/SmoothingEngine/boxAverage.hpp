@@ -0,0 +1,33 @@
+/***********************************************************************************
+ * boxAverage.hpp written by Timothy Hennessy
+ *
+ * Description: Separable running-sum box average.  Computes the average of
+ * a (2 * radius + 1) x (2 * radius + 1) neighborhood for every pixel at a
+ * flat cost per pixel, independent of radius.
+ *
+ * Neighborhoods clipped by the image border are divided by the number of
+ * cells that are actually inside the image, so radius 1 is bit-exact with
+ * the original 3x3 neighborhoodAverage.
+ *
+ * Images with 1, 3 or 4 channels are handed to the compile-time
+ * specialized kernels of typedAverage.hpp, which give the same result.
+ *
+ * Every call takes the caller's AverageScratch for its row sums.  Keep one
+ * per thread for the whole run, the three argument boxAverage is only for
+ * one-off calls.
+ *********************************************************************************/
+#ifndef BOX_AVERAGE_HPP
+#define BOX_AVERAGE_HPP
+#include <opencv2/opencv.hpp>
+#include "typedAverage.hpp"
+
+void horizontalBoxSums(const uchar *row, int cols, int cn, int radius,
+                       int startCol, int endCol, int *out);
+void boxAverageRect(const cv::Mat& src, cv::Mat& dst, int radius, const cv::Rect& outRect,
+                    AverageScratch& scratch);
+void boxAverageRows(const cv::Mat& src, cv::Mat& dst, int radius, int startRow, int endRow,
+                    AverageScratch& scratch);
+void boxAverage(const cv::Mat& src, cv::Mat& dst, int radius, AverageScratch& scratch);
+void boxAverage(const cv::Mat& src, cv::Mat& dst, int radius);
+
+#endif
@@ -0,0 +1,199 @@
+/***********************************************************************************
+ * bufferPool.cpp written by Timothy Hennessy
+ *
+ * Description: Size-bucketed, aligned image buffer pool.
+ *********************************************************************************/
+#include <cstdlib>
+#include "bufferPool.hpp"
+using namespace cv;
+using namespace std;
+
+// Smallest bucket step, one page
+#define MIN_BUCKET_STEP 4096
+
+/******************************* bucketBytes ******************************
+ * size_t bucketBytes(size_t bytes)
+ *
+ * Description: Rounds bytes up to its bucket.  Buckets are a page apart
+ * for small buffers and 1/16 of the size apart for large ones, so images
+ * of nearly the same size share blocks while a block is never more than
+ * a page or 1/16 larger than what it holds.
+ **************************************************************************/
+size_t bucketBytes(size_t bytes)
+{
+    size_t step = MIN_BUCKET_STEP;
+    while (step * 16 <= bytes)
+        step *= 2;
+    return (bytes + step - 1) / step * step;
+}
+
+/******************************** BufferPool ******************************
+ * BufferPool::BufferPool(size_t idleLimit)
+ *
+ * Description: Creates an empty pool that keeps at most idleLimit bytes
+ * of free blocks, no limit by default.
+ **************************************************************************/
+BufferPool::BufferPool(size_t idleLimit)
+    : allocatedBlocks(0), reusedBlocks(0), evictedBlocks(0), heldBytes(0), idleBytes(0),
+      idleLimit(idleLimit), releaseClock(0)
+{
+    pthread_mutex_init(&mutex, NULL);
+}
+
+BufferPool::~BufferPool()
+{
+    size_t b;
+    for (b = 0; b < blocks.size(); b++)
+        free(blocks[b].data);
+    pthread_mutex_destroy(&mutex);
+}
+
+/************************** BufferPool::trimIdle **************************
+ * void BufferPool::trimIdle(size_t keepBytes)
+ *
+ * Description: Frees free blocks, least recently released first, until
+ * at most keepBytes of them are left.  Called with mutex held.
+ **************************************************************************/
+void BufferPool::trimIdle(size_t keepBytes)
+{
+    size_t b, oldest;
+    while (idleBytes > keepBytes)
+    {
+        oldest = blocks.size();
+        for (b = 0; b < blocks.size(); b++)
+            if (blocks[b].free
+                && (oldest == blocks.size() || blocks[b].released < blocks[oldest].released))
+                oldest = b;
+        free(blocks[oldest].data);
+        idleBytes -= blocks[oldest].bytes;
+        heldBytes -= blocks[oldest].bytes;
+        evictedBlocks++;
+        blocks.erase(blocks.begin() + oldest);
+    }
+}
+
+/*************************** BufferPool::acquire **************************
+ * Mat BufferPool::acquire(int rows, int cols, int type)
+ *
+ * Description: Returns a continuous rows x cols buffer of type, with
+ * undefined contents.
+ *
+ * Process:
+ * 1.) Take the first free block of the request's bucket.
+ * 2.) Otherwise free idle blocks of other buckets until the new block
+ *     fits in the idle limit, then allocate a new aligned block of the
+ *     bucket size.
+ * 3.) Wrap the block in a Mat header.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * Mat           value       header on the block, empty if the allocation
+ *                           failed.
+ **************************************************************************/
+Mat BufferPool::acquire(int rows, int cols, int type)
+{
+    size_t bytes = bucketBytes((size_t) rows * cols * CV_ELEM_SIZE(type));
+    Block block;
+    size_t b;
+    pthread_mutex_lock(&mutex);
+    for (b = 0; b < blocks.size(); b++)
+        if (blocks[b].free && blocks[b].bytes == bytes)
+        {
+            blocks[b].free = false;
+            idleBytes -= bytes;
+            reusedBlocks++;
+            pthread_mutex_unlock(&mutex);
+            return Mat(rows, cols, type, blocks[b].data);
+        }
+    trimIdle(idleLimit > bytes ? idleLimit - bytes : 0);
+    if (posix_memalign((void **) &block.data, BUFFER_ALIGNMENT, bytes) != 0)
+    {
+        pthread_mutex_unlock(&mutex);
+        return Mat();
+    }
+    block.bytes = bytes;
+    block.free = false;
+    block.released = 0;
+    blocks.push_back(block);
+    allocatedBlocks++;
+    heldBytes += bytes;
+    pthread_mutex_unlock(&mutex);
+    return Mat(rows, cols, type, block.data);
+}
+
+/*************************** BufferPool::release **************************
+ * bool BufferPool::release(Mat& buffer)
+ *
+ * Description: Hands the block buffer points to back to the pool and
+ * clears buffer, then frees the oldest free blocks beyond the idle limit.
+ * A Mat that did not come from acquire is only cleared.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * bool          value       False if buffer was not a block of the pool.
+ **************************************************************************/
+bool BufferPool::release(Mat& buffer)
+{
+    size_t b;
+    bool found = false;
+    pthread_mutex_lock(&mutex);
+    for (b = 0; b < blocks.size() && !found; b++)
+        if (blocks[b].data == buffer.data && !blocks[b].free)
+        {
+            blocks[b].free = true;
+            blocks[b].released = ++releaseClock;
+            idleBytes += blocks[b].bytes;
+            found = true;
+        }
+    trimIdle(idleLimit);
+    pthread_mutex_unlock(&mutex);
+    buffer = Mat();
+    return found;
+}
+
+long BufferPool::blocksAllocated() const
+{
+    long count;
+    pthread_mutex_lock(&mutex);
+    count = allocatedBlocks;
+    pthread_mutex_unlock(&mutex);
+    return count;
+}
+
+long BufferPool::blocksReused() const
+{
+    long count;
+    pthread_mutex_lock(&mutex);
+    count = reusedBlocks;
+    pthread_mutex_unlock(&mutex);
+    return count;
+}
+
+long BufferPool::blocksEvicted() const
+{
+    long count;
+    pthread_mutex_lock(&mutex);
+    count = evictedBlocks;
+    pthread_mutex_unlock(&mutex);
+    return count;
+}
+
+size_t BufferPool::bytesHeld() const
+{
+    size_t bytes;
+    pthread_mutex_lock(&mutex);
+    bytes = heldBytes;
+    pthread_mutex_unlock(&mutex);
+    return bytes;
+}
+
+/************************** BufferPool::printStats ************************
+ * Description: Prints the counters as one line, e.g.
+ *     buffer pool: 3 blocks allocated, 97 reused, 0 evicted, 1.5 MB held
+ **************************************************************************/
+void BufferPool::printStats(ostream& out) const
+{
+    out << "buffer pool: " << blocksAllocated() << " blocks allocated, " << blocksReused() << " reused, ";
+    out << blocksEvicted() << " evicted, ";
+    out << bytesHeld() / 1048576.0 << " MB held" << endl;
+}
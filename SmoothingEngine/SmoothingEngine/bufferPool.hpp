@@ -0,0 +1,78 @@
+/***********************************************************************************
+ * bufferPool.hpp written by Timothy Hennessy
+ *
+ * Description: Size-bucketed pool of image buffers.  A long run takes its
+ * ping-pong and result buffers from the pool and hands them back when an
+ * image, frame or round is done, so after warm-up it reuses the same few
+ * image blocks instead of allocating and freeing a full image every time.
+ *
+ * acquire returns a Mat header on a BUFFER_ALIGNMENT aligned block whose
+ * size is the request rounded up to its bucket, reusing a free block of
+ * that bucket when there is one.  release marks the block free again.
+ *
+ * A free block only serves its own bucket, so a run over many image sizes
+ * would keep one idle block per size it has seen.  The idle limit bounds
+ * that: free blocks beyond it are freed, least recently released first,
+ * and before a new block is allocated idle blocks of other buckets are
+ * freed to make room for it.  Held memory is then at most the buffers in
+ * use plus the limit.  blocksAllocated(), blocksReused() and
+ * blocksEvicted() count image blocks only, other heap use (decoders,
+ * queues, shared pointers) is not seen by the pool.
+ *
+ * Usage:
+ *     BufferPool buffers(idleLimit);           // outlives every buffer
+ *     Mat a = buffers.acquire(rows, cols, CV_8UC3);
+ *     ...
+ *     buffers.release(a);
+ *********************************************************************************/
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+#include <pthread.h>
+#include <iostream>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#define BUFFER_ALIGNMENT 64     // cache line, also enough for any vector load
+#define DEFAULT_IDLE_LIMIT_MB 256
+
+size_t bucketBytes(size_t bytes);
+
+/******************************* BufferPool *******************************
+ * Thread safe.  Headers returned by acquire do not own their data: a
+ * copy of one must not be used after the buffer is released, and
+ * reallocating one (create with another size or type) detaches it from
+ * the pool.
+ **************************************************************************/
+class BufferPool
+{
+public:
+    BufferPool(size_t idleLimit = (size_t) -1);
+    ~BufferPool();
+    cv::Mat acquire(int rows, int cols, int type);
+    bool release(cv::Mat& buffer);
+    long blocksAllocated() const;
+    long blocksReused() const;
+    long blocksEvicted() const;
+    size_t bytesHeld() const;
+    void printStats(std::ostream& out) const;
+private:
+    struct Block
+    {
+        unsigned char *data;
+        size_t bytes;           // bucket size
+        bool free;
+        unsigned long released; // releaseClock when last released
+    };
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+    void trimIdle(size_t keepBytes);
+
+    std::vector<Block> blocks;
+    long allocatedBlocks, reusedBlocks, evictedBlocks;
+    size_t heldBytes, idleBytes;
+    size_t idleLimit;           // free bytes kept for reuse
+    unsigned long releaseClock;
+    mutable pthread_mutex_t mutex;
+};
+
+#endif
@@ -0,0 +1,181 @@
+/***********************************************************************************
+ * compositeKernel.cpp written by Timothy Hennessy
+ *
+ * Description: Closed-form composite kernel for n box average iterations.
+ *********************************************************************************/
+#include <cmath>
+#include <cstdlib>
+#include "compositeKernel.hpp"
+using namespace cv;
+using namespace std;
+
+// Taps below this fraction of the kernel cannot move an 8-bit result
+#define TAIL_EPSILON 1e-9
+
+/************************** buildCompositeKernel **************************
+ * int buildCompositeKernel(int radius, int n, vector<float>& kernel)
+ *
+ * Description: Builds the 1D box of width 2 * radius + 1 convolved with
+ * itself n times and returns its half width.  Kernel index i holds the
+ * weight of offset i - halfWidth.
+ *
+ * Process:
+ * 1.) Convolve in double, renormalizing to a sum of 1 after every step.
+ * 2.) Trim tails whose weights are below TAIL_EPSILON.  The kernel
+ *     approaches a Gaussian of variance n * radius * (radius + 1) / 3, so
+ *     for large n it is far narrower than its full n * radius half width.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * radius        in          Box half width, radius >= 1.
+ * n             in          Number of iterations, n >= 1.
+ * kernel        out         2 * halfWidth + 1 weights summing to 1.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * int           value       Half width of the trimmed kernel.
+ **************************************************************************/
+int buildCompositeKernel(int radius, int n, vector<float>& kernel)
+{
+    CV_Assert(radius >= 1 && n >= 1);
+    int width = 2 * radius + 1;
+    vector<double> curr(1, 1.0), next;
+    int iter, i, t;
+    double total;
+    for (iter = 0; iter < n; iter++)
+    {
+        next.assign(curr.size() + width - 1, 0.0);
+        for (i = 0; i < (int) curr.size(); i++)
+            for (t = 0; t < width; t++)
+                next[i + t] += curr[i];
+        total = 0.0;
+        for (i = 0; i < (int) next.size(); i++)
+            total += next[i];
+        for (i = 0; i < (int) next.size(); i++)
+            next[i] /= total;
+        // Drop tails as we go so large n stays cheap to build
+        while (next.size() > 1 && next.front() < TAIL_EPSILON && next.back() < TAIL_EPSILON)
+        {
+            next.erase(next.begin());
+            next.pop_back();
+        }
+        curr.swap(next);
+    }
+    kernel.assign(curr.begin(), curr.end());
+    return (int) curr.size() / 2;
+}
+
+/**************************** compositeAverage ****************************
+ * void compositeAverage(const Mat& src, Mat& dst, int radius, int n)
+ *
+ * Description: Approximates n iterations of the box average in a single
+ * separable pass.
+ *
+ * Process:
+ * 1.) Build the composite kernel.
+ * 2.) Horizontal pass into a float buffer, dividing by the weight of the
+ *     taps that fall inside the image.
+ * 3.) Vertical pass over the float buffer with the same renormalization,
+ *     rounding to the nearest 8-bit value.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * src           in          8-bit image with 1 to 4 channels.
+ * dst           out         Result, allocated if needed.
+ * radius        in          Box half width, radius >= 1.
+ * n             in          Number of iterations to approximate, n >= 0.
+ **************************************************************************/
+void compositeAverage(const Mat& src, Mat& dst, int radius, int n)
+{
+    CV_Assert(src.depth() == CV_8U);        // ensures pixel value range [0..255]
+    CV_Assert(src.channels() <= 4);
+    vector<float> kernel;
+    int cn = src.channels();
+    int width = src.cols * cn;
+    int half, r, c, k, t, j, first, last;
+    if (n == 0)
+    {
+        src.copyTo(dst);
+        return;
+    }
+    half = buildCompositeKernel(radius, n, kernel);
+    dst.create(src.rows, src.cols, src.type());
+    Mat horizontal(src.rows, width, CV_32FC1);
+    vector<float> colNorm(src.cols), acc(width);
+
+    // Renormalization only depends on the column, compute it once
+    for (c = 0; c < src.cols; c++)
+    {
+        float weight = 0.0f;
+        for (t = max(-half, -c); t <= min(half, src.cols - 1 - c); t++)
+            weight += kernel[t + half];
+        colNorm[c] = 1.0f / weight;
+    }
+
+    for (r = 0; r < src.rows; r++)
+    {
+        const uchar *row = src.ptr<uchar>(r);
+        float *out = horizontal.ptr<float>(r);
+        for (c = 0; c < src.cols; c++)
+        {
+            float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            first = max(-half, -c);
+            last  = min(half, src.cols - 1 - c);
+            for (t = first; t <= last; t++)
+                for (k = 0; k < cn; k++)
+                    sum[k] += kernel[t + half] * row[(c + t) * cn + k];
+            for (k = 0; k < cn; k++)
+                out[c * cn + k] = sum[k] * colNorm[c];
+        }
+    }
+
+    for (r = 0; r < src.rows; r++)
+    {
+        float weight = 0.0f;
+        first = max(-half, -r);
+        last  = min(half, src.rows - 1 - r);
+        for (j = 0; j < width; j++)
+            acc[j] = 0.0f;
+        for (t = first; t <= last; t++)
+        {
+            const float *in = horizontal.ptr<float>(r + t);
+            float w = kernel[t + half];
+            weight += w;
+            for (j = 0; j < width; j++)
+                acc[j] += w * in[j];
+        }
+        uchar *out = dst.ptr<uchar>(r);
+        for (j = 0; j < width; j++)
+            out[j] = saturate_cast<uchar>(acc[j] / weight);
+    }
+}
+
+/**************************** compareDeviation ****************************
+ * DeviationReport compareDeviation(const Mat& a, const Mat& b)
+ *
+ * Description: Max and mean absolute difference over every channel of two
+ * 8-bit images of the same size and type.
+ **************************************************************************/
+DeviationReport compareDeviation(const Mat& a, const Mat& b)
+{
+    CV_Assert(a.size() == b.size() && a.type() == b.type() && a.depth() == CV_8U);
+    DeviationReport report = { 0, 0.0 };
+    int width = a.cols * a.channels();
+    int r, j, diff;
+    double total = 0.0;
+    for (r = 0; r < a.rows; r++)
+    {
+        const uchar *pa = a.ptr<uchar>(r), *pb = b.ptr<uchar>(r);
+        long rowTotal = 0;
+        for (j = 0; j < width; j++)
+        {
+            diff = abs((int) pa[j] - (int) pb[j]);
+            rowTotal += diff;
+            report.maxAbs = max(report.maxAbs, diff);
+        }
+        total += rowTotal;
+    }
+    if (a.total() > 0)
+        report.meanAbs = total / ((double) a.total() * a.channels());
+    return report;
+}
@@ -0,0 +1,31 @@
+/***********************************************************************************
+ * compositeKernel.hpp written by Timothy Hennessy
+ *
+ * Description: Closed-form "n iterations in one pass" mode.  Running the
+ * (2 * radius + 1)^2 box average n times is, apart from the truncation at
+ * every step and the border renormalization, a single separable filter
+ * whose 1D kernel is the box convolved with itself n times.  This builds
+ * that kernel once and applies it in one pass with float accumulation.
+ *
+ * The result is approximate.  compareDeviation reports how far it is
+ * from the exact iterative path, which stays the default everywhere.
+ * Most of the deviation is drift in the exact path itself: every
+ * truncating division loses up to (d - 1) / d of a level, so for large n
+ * the iterative image is darker than the true blur this computes.
+ *********************************************************************************/
+#ifndef COMPOSITE_KERNEL_HPP
+#define COMPOSITE_KERNEL_HPP
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+struct DeviationReport
+{
+    int maxAbs;        // largest absolute channel difference
+    double meanAbs;    // mean absolute channel difference
+};
+
+int buildCompositeKernel(int radius, int n, std::vector<float>& kernel);
+void compositeAverage(const cv::Mat& src, cv::Mat& dst, int radius, int n);
+DeviationReport compareDeviation(const cv::Mat& a, const cv::Mat& b);
+
+#endif
@@ -0,0 +1,168 @@
+/***********************************************************************************
+ * cpuTopology.cpp written by Timothy Hennessy
+ *
+ * Description: Thread count and NUMA-ordered core pinning.
+ *********************************************************************************/
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <dirent.h>
+#endif
+#include <pthread.h>
+#include <unistd.h>
+#include <cstdio>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "cpuTopology.hpp"
+using namespace std;
+
+/******************************** cpuNode *********************************
+ * Description: NUMA node of cpu, taken from the nodeN link sysfs puts in
+ * every cpu directory.  0 when unknown.
+ **************************************************************************/
+static int cpuNode(int cpu)
+{
+    int node = 0;
+#ifdef __linux__
+    char path[64];
+    DIR *dir;
+    struct dirent *entry;
+    sprintf(path, "/sys/devices/system/cpu/cpu%d", cpu);
+    if ((dir = opendir(path)) == NULL)
+        return 0;
+    while ((entry = readdir(dir)) != NULL)
+        if (sscanf(entry->d_name, "node%d", &node) == 1)
+            break;
+    closedir(dir);
+    if (entry == NULL)
+        node = 0;
+#endif
+    return node;
+}
+
+/****************************** siblingRank *******************************
+ * Description: Position of cpu among the SMT siblings of its core, 0 for
+ * the lowest numbered, taken from thread_siblings_list (e.g. "0,8" or
+ * "2-3").  0 when unknown.
+ **************************************************************************/
+static int siblingRank(int cpu)
+{
+    int rank = 0;
+#ifdef __linux__
+    char path[96];
+    FILE *file;
+    int first, last;
+    char separator;
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    if ((file = fopen(path, "r")) == NULL)
+        return 0;
+    while (fscanf(file, "%d", &first) == 1)
+    {
+        last = first;
+        separator = (char) fgetc(file);
+        if (separator == '-')
+        {
+            if (fscanf(file, "%d", &last) != 1)
+                break;
+            separator = (char) fgetc(file);
+        }
+        if (first < cpu)
+            rank += min(last, cpu - 1) - first + 1;
+        if (separator != ',')
+            break;
+    }
+    fclose(file);
+#endif
+    return rank;
+}
+
+/****************************** orderedCpus *******************************
+ * vector<int> orderedCpus()
+ *
+ * Description: The CPUs this process may run on, sorted by NUMA node,
+ * then by rank among the SMT siblings of their core, then by CPU number.
+ * Every core's first thread comes before any core's second, whether the
+ * kernel numbers siblings far apart (0/8) or next to each other (0/1), so
+ * the first workers of a node get whole cores.
+ *
+ * NOTES:
+ * - Honours taskset/cgroup restrictions through sched_getaffinity.
+ * - Ranks come from the full sibling list, so with a restricted affinity
+ *   a CPU whose first sibling is excluded still ranks second.
+ **************************************************************************/
+static vector<int> orderedCpus()
+{
+    vector<pair<pair<int, int>, int> > nodes;    // ((node, sibling rank), cpu)
+    vector<int> cpus;
+    size_t i;
+#ifdef __linux__
+    cpu_set_t set;
+    int cpu;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &set))
+                nodes.push_back(make_pair(make_pair(cpuNode(cpu), siblingRank(cpu)), cpu));
+#endif
+    if (nodes.empty())
+    {
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        for (i = 0; i < (size_t) max(count, 1L); i++)
+            nodes.push_back(make_pair(make_pair(0, 0), (int) i));
+    }
+    sort(nodes.begin(), nodes.end());
+    for (i = 0; i < nodes.size(); i++)
+        cpus.push_back(nodes[i].second);
+    return cpus;
+}
+
+static const vector<int>& cpuList()
+{
+    static const vector<int> cpus = orderedCpus();
+    return cpus;
+}
+
+/***************************** hardwareThreads ****************************
+ * Description: Number of CPUs available to this process, the default
+ * thread count of the parallel tools.
+ **************************************************************************/
+int hardwareThreads()
+{
+    return (int) cpuList().size();
+}
+
+/******************************** workerCpu *******************************
+ * Description: CPU that worker is pinned to.  Workers beyond the number
+ * of CPUs wrap around.
+ **************************************************************************/
+int workerCpu(int worker)
+{
+    return cpuList()[worker % cpuList().size()];
+}
+
+/***************************** pinCurrentThread ***************************
+ * bool pinCurrentThread(int worker)
+ *
+ * Description: Restricts the calling thread to workerCpu(worker).  Pages
+ * the thread touches first are then allocated on that CPU's node and stay
+ * local for as long as the thread lives.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * bool          value       False if pinning failed or is not supported.
+ **************************************************************************/
+bool pinCurrentThread(int worker)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(workerCpu(worker), &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void) worker;
+    return false;
+#endif
+}
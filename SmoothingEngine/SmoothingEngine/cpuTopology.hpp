@@ -0,0 +1,20 @@
+/***********************************************************************************
+ * cpuTopology.hpp written by Timothy Hennessy
+ *
+ * Description: Thread count and core pinning.  Workers are numbered so that
+ * consecutive workers sit on the same NUMA node: with bands of rows handed
+ * out in worker order, neighbouring bands (which share halo rows) stay on
+ * one socket and each socket gets one contiguous part of the image.
+ *
+ * Pinning uses pthread_setaffinity_np and NUMA nodes are read from sysfs,
+ * both Linux only.  Elsewhere pinning is a no-op and every CPU counts as
+ * node 0.
+ *********************************************************************************/
+#ifndef CPU_TOPOLOGY_HPP
+#define CPU_TOPOLOGY_HPP
+
+int hardwareThreads();
+int workerCpu(int worker);
+bool pinCurrentThread(int worker);
+
+#endif
@@ -0,0 +1,207 @@
+/***********************************************************************************
+ * exposureStack.cpp written by Timothy Hennessy
+ *
+ * Description: Running-sum exposure stacking split into row bands.
+ *********************************************************************************/
+#include <climits>
+#include "exposureStack.hpp"
+#include "profile.hpp"
+using namespace cv;
+using namespace std;
+
+#define BANDS_PER_THREAD 4  // lets a fast thread pick up a slow one's rows
+
+struct BandWork
+{
+    const Mat *frame;
+    Mat *sum;
+    Mat *output;
+    int bands;
+    int frames;                 // frames in the sum
+    bool first;                 // add initializes the sum
+};
+
+static void bandRows(const BandWork& work, int rows, int index, int *r0, int *r1)
+{
+    *r0 = (int) ((long long) rows * index / work.bands);
+    *r1 = (int) ((long long) rows * (index + 1) / work.bands);
+}
+
+/********************************* addRows ********************************
+ * Adds rows [r0, r1) of frame (T samples) into sum (S samples), or
+ * copies them if this is the first frame so the sum never has to be
+ * cleared on its own pass.
+ **************************************************************************/
+template <typename T, typename S>
+static void addRows(const Mat& frame, Mat& sum, int r0, int r1, bool first)
+{
+    int width = frame.cols * frame.channels(), r, x;
+    for (r = r0; r < r1; r++)
+    {
+        const T *in = frame.ptr<T>(r);
+        S *acc = sum.ptr<S>(r);
+        if (first)
+            for (x = 0; x < width; x++)
+                acc[x] = in[x];
+        else
+            for (x = 0; x < width; x++)
+                acc[x] += in[x];
+    }
+}
+
+/******************************** meanRows ********************************
+ * Divides rows [r0, r1) of sum by frames into output.  Integer depths
+ * round to nearest, since unlike the repeated spatial averages a stack is
+ * divided only once.  The rounding is done in long long: a full 8-bit sum
+ * plus frames / 2 does not fit in an int.
+ **************************************************************************/
+template <typename T, typename S>
+static void meanRows(const Mat& sum, Mat& output, int frames, int r0, int r1)
+{
+    int width = output.cols * output.channels(), r, x;
+    for (r = r0; r < r1; r++)
+    {
+        const S *acc = sum.ptr<S>(r);
+        T *out = output.ptr<T>(r);
+        for (x = 0; x < width; x++)
+            out[x] = (T) (((long long) acc[x] + frames / 2) / frames);
+    }
+}
+
+template <>
+void meanRows<float, double>(const Mat& sum, Mat& output, int frames, int r0, int r1)
+{
+    int width = output.cols * output.channels(), r, x;
+    for (r = r0; r < r1; r++)
+    {
+        const double *acc = sum.ptr<double>(r);
+        float *out = output.ptr<float>(r);
+        for (x = 0; x < width; x++)
+            out[x] = (float) (acc[x] / frames);
+    }
+}
+
+static void addBand(void *arg, int index)
+{
+    BandWork& work = *(BandWork *) arg;
+    int r0, r1;
+    PROFILE_SCOPE("stack band");
+    bandRows(work, work.frame->rows, index, &r0, &r1);
+    if (work.frame->depth() == CV_8U)
+        addRows<uchar, int>(*work.frame, *work.sum, r0, r1, work.first);
+    else if (work.frame->depth() == CV_16U)
+        addRows<ushort, double>(*work.frame, *work.sum, r0, r1, work.first);
+    else
+        addRows<float, double>(*work.frame, *work.sum, r0, r1, work.first);
+}
+
+static void meanBand(void *arg, int index)
+{
+    BandWork& work = *(BandWork *) arg;
+    int r0, r1;
+    bandRows(work, work.output->rows, index, &r0, &r1);
+    if (work.output->depth() == CV_8U)
+        meanRows<uchar, int>(*work.sum, *work.output, work.frames, r0, r1);
+    else if (work.output->depth() == CV_16U)
+        meanRows<ushort, double>(*work.sum, *work.output, work.frames, r0, r1);
+    else
+        meanRows<float, double>(*work.sum, *work.output, work.frames, r0, r1);
+}
+
+static int bandCount(int rows, ThreadPool& pool)
+{
+    return max(1, min(rows, pool.size() * BANDS_PER_THREAD));
+}
+
+const char *stackStatusMessage(StackStatus status)
+{
+    switch (status)
+    {
+        case STACK_ADDED:     return "added";
+        case STACK_BAD_DEPTH: return "depth is not 8U, 16U or 32F";
+        case STACK_MISMATCH:  return "size or type differs from the first frame";
+        default:              return "one more 8-bit frame could overflow the sum";
+    }
+}
+
+ExposureStack::ExposureStack() : type(-1), frames(0)
+{
+}
+
+/*************************** ExposureStack::add ***************************
+ * StackStatus ExposureStack::add(const Mat& frame, ThreadPool& pool)
+ *
+ * Description: Adds frame to the stack, one row band per pool task.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * frame         in          8U, 16U or 32F image of any channel count.
+ * pool          in          threads the row bands run on.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * StackStatus   value       STACK_ADDED, or why the stack was left
+ *                           unchanged: STACK_BAD_DEPTH for an empty frame
+ *                           or one not 8U, 16U or 32F, STACK_MISMATCH
+ *                           for another size or type than the first
+ *                           frame, STACK_FULL if one more 8-bit frame
+ *                           could overflow the sum.
+ **************************************************************************/
+StackStatus ExposureStack::add(const Mat& frame, ThreadPool& pool)
+{
+    BandWork work;
+    int depth = frame.depth();
+    if (!frame.data || (depth != CV_8U && depth != CV_16U && depth != CV_32F))
+        return STACK_BAD_DEPTH;
+    if (frames == 0)
+    {
+        type = frame.type();
+        sum.create(frame.rows, frame.cols,
+                   CV_MAKETYPE(depth == CV_8U ? CV_32S : CV_64F, frame.channels()));
+    }
+    else if (frame.type() != type || frame.rows != sum.rows || frame.cols != sum.cols)
+        return STACK_MISMATCH;
+    else if (depth == CV_8U && frames >= INT_MAX / 255)
+        return STACK_FULL;
+    work.frame = &frame;
+    work.sum = &sum;
+    work.output = NULL;
+    work.bands = bandCount(frame.rows, pool);
+    work.frames = frames;
+    work.first = frames == 0;
+    pool.parallelFor(work.bands, addBand, &work);
+    frames++;
+    return STACK_ADDED;
+}
+
+/*************************** ExposureStack::mean **************************
+ * bool ExposureStack::mean(Mat& output, ThreadPool& pool) const
+ *
+ * Description: Writes the average of the frames added so far to output,
+ * in the type of the frames.  False if the stack is empty.
+ **************************************************************************/
+bool ExposureStack::mean(Mat& output, ThreadPool& pool) const
+{
+    BandWork work;
+    if (frames == 0)
+        return false;
+    output.create(sum.rows, sum.cols, type);
+    work.frame = NULL;
+    work.sum = const_cast<Mat *>(&sum);
+    work.output = &output;
+    work.bands = bandCount(sum.rows, pool);
+    work.frames = frames;
+    work.first = false;
+    pool.parallelFor(work.bands, meanBand, &work);
+    return true;
+}
+
+int ExposureStack::count() const
+{
+    return frames;
+}
+
+size_t ExposureStack::accumulatorBytes() const
+{
+    return sum.data ? (size_t) sum.rows * sum.cols * sum.elemSize() : 0;
+}
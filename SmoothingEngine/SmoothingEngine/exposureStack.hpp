@@ -0,0 +1,36 @@
+/***********************************************************************************
+ * exposureStack.hpp written by Timothy Hennessy
+ *
+ * Description: Temporal averaging of aligned exposures of one scene.
+ * Frames are added one at a time into a running sum, so memory is one
+ * accumulator however many frames are stacked, and each add is split into
+ * row bands that run on a ThreadPool.
+ *
+ * The sum is CV_32S for 8-bit frames (exact up to 8 million frames) and
+ * CV_64F for 16-bit and float frames (exact for 16-bit up to 10^11).
+ *********************************************************************************/
+#ifndef EXPOSURE_STACK_HPP
+#define EXPOSURE_STACK_HPP
+#include <opencv2/opencv.hpp>
+#include "threadPool.hpp"
+
+// Outcome of ExposureStack::add
+enum StackStatus { STACK_ADDED, STACK_BAD_DEPTH, STACK_MISMATCH, STACK_FULL };
+
+const char *stackStatusMessage(StackStatus status);
+
+class ExposureStack
+{
+public:
+    ExposureStack();
+    StackStatus add(const cv::Mat& frame, ThreadPool& pool);
+    bool mean(cv::Mat& output, ThreadPool& pool) const;
+    int count() const;
+    size_t accumulatorBytes() const;
+private:
+    cv::Mat sum;
+    int type;                   // type of the stacked frames
+    int frames;
+};
+
+#endif
@@ -0,0 +1,412 @@
+/***********************************************************************************
+ * haloTransport.cpp written by Timothy Hennessy
+ *
+ * Description: Shared memory and Unix domain socket halo transports.
+ *
+ * NOTES:
+ * - A failed worker must not leave its neighbors waiting forever.  With
+ *   sockets they see the connection close, with shared memory the parent
+ *   raises an abort flag that every spinning barrier checks.
+ *********************************************************************************/
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "haloTransport.hpp"
+using namespace cv;
+using namespace std;
+
+#define CACHE_LINE 64
+#define SPINS_BEFORE_YIELD 1000   // then yield, workers may share cores
+
+/******************************** reapWorkers *****************************
+ * bool reapWorkers(const vector<pid_t>& workers, atomic<int> *abort)
+ *
+ * Description: Waits for every worker in the order they exit.  On the
+ * first one that fails, raises *abort (if given) so the others stop
+ * waiting for it.  Returns true if all exited with status 0.
+ **************************************************************************/
+static bool reapWorkers(const vector<pid_t>& workers, atomic<int> *abort)
+{
+    size_t reaped;
+    int status;
+    bool ok = true;
+    pid_t pid;
+    for (reaped = 0; reaped < workers.size(); reaped++)
+    {
+        pid = waitpid(-1, &status, 0);
+        if (pid < 0)
+            return false;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            ok = false;
+            if (abort)
+                abort->store(1);
+        }
+    }
+    return ok;
+}
+
+/******************************* ShmTransport *****************************
+ * Segment layout: a cache line of barrier and abort state, then halo
+ * slots [parity][worker][up, down] of haloBytes each, then the result
+ * image.  Slots alternate by parity between exchanges, so one barrier per
+ * exchange is enough: nobody writes a slot set before everybody has read
+ * it, since that takes passing the next barrier.
+ **************************************************************************/
+struct ShmHeader
+{
+    atomic<int> arrived;          // workers at the barrier
+    atomic<int> generation;       // bumped when the barrier opens
+    atomic<int> abort;            // a worker failed, stop
+};
+
+class ShmTransport : public HaloTransport
+{
+public:
+    ShmTransport() : base(NULL), length(0), header(NULL), workers(0), worker(-1), parity(0) {}
+    ~ShmTransport()
+    {
+        if (base)
+            munmap(base, length);
+    }
+
+    bool setup(const vector<int>& shardBounds, int haloRows, size_t rowBytes)
+    {
+        char name[64];
+        int fd;
+        bounds = shardBounds;
+        workers = (int) bounds.size() - 1;
+        this->rowBytes = rowBytes;
+        haloBytes = haloRows * rowBytes;
+        slotsOffset = CACHE_LINE;
+        resultOffset = slotsOffset + 4 * workers * haloBytes;
+        length = resultOffset + bounds.back() * rowBytes;
+
+        // Named only until mapped, the workers inherit the mapping
+        snprintf(name, sizeof(name), "/smoothing_halo_%d", (int) getpid());
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0)
+            return false;
+        shm_unlink(name);
+        if (ftruncate(fd, (off_t) length) != 0)
+        {
+            close(fd);
+            return false;
+        }
+        base = (uchar *) mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+        {
+            base = NULL;
+            return false;
+        }
+        header = new (base) ShmHeader();
+        header->arrived.store(0);
+        header->generation.store(0);
+        header->abort.store(0);
+        return true;
+    }
+
+    void attach(int w)
+    {
+        worker = w;
+    }
+
+    void attachParent()
+    {
+    }
+
+    bool exchange(const uchar *toUp, const uchar *toDown, uchar *fromUp, uchar *fromDown)
+    {
+        if (toUp)
+            memcpy(slot(parity, worker, 0), toUp, haloBytes);
+        if (toDown)
+            memcpy(slot(parity, worker, 1), toDown, haloBytes);
+        if (!barrier())
+            return false;
+        if (fromUp)
+            memcpy(fromUp, slot(parity, worker - 1, 1), haloBytes);
+        if (fromDown)
+            memcpy(fromDown, slot(parity, worker + 1, 0), haloBytes);
+        parity ^= 1;
+        return true;
+    }
+
+    bool sendResult(const Mat& rows)
+    {
+        uchar *out = base + resultOffset + bounds[worker] * rowBytes;
+        int r;
+        for (r = 0; r < rows.rows; r++)
+            memcpy(out + r * rowBytes, rows.ptr(r), rowBytes);
+        return true;
+    }
+
+    bool finish(const vector<pid_t>& children, Mat& output)
+    {
+        int r;
+        if (!reapWorkers(children, &header->abort))
+            return false;
+        for (r = 0; r < output.rows; r++)
+            memcpy(output.ptr(r), base + resultOffset + r * rowBytes, rowBytes);
+        return true;
+    }
+
+private:
+    uchar *slot(int p, int w, int direction)
+    {
+        return base + slotsOffset + ((p * workers + w) * 2 + direction) * haloBytes;
+    }
+
+    /************************** ShmTransport::barrier *********************
+     * Spins until all workers arrive, yielding after a while so it also
+     * works with more workers than cores.  False if the run was aborted.
+     **********************************************************************/
+    bool barrier()
+    {
+        int generation = header->generation.load(memory_order_acquire);
+        long spins = 0;
+        if (header->arrived.fetch_add(1, memory_order_acq_rel) == workers - 1)
+        {
+            header->arrived.store(0, memory_order_relaxed);
+            header->generation.fetch_add(1, memory_order_release);
+            return true;
+        }
+        while (header->generation.load(memory_order_acquire) == generation)
+        {
+            if (header->abort.load(memory_order_relaxed))
+                return false;
+            if (++spins > SPINS_BEFORE_YIELD)
+                sched_yield();
+        }
+        return true;
+    }
+
+    uchar *base;
+    size_t length;
+    ShmHeader *header;
+    vector<int> bounds;
+    size_t rowBytes, haloBytes, slotsOffset, resultOffset;
+    int workers, worker;
+    int parity;                   // slot set of the next exchange
+};
+
+/****************************** SocketTransport ***************************
+ * links[i] connects worker i (end 0) with worker i + 1 (end 1), results[w]
+ * connects the parent (end 0) with worker w (end 1).  Every process
+ * closes the ends that are not its own after the fork.
+ **************************************************************************/
+class SocketTransport : public HaloTransport
+{
+public:
+    SocketTransport() : up(-1), down(-1), result(-1) {}
+    ~SocketTransport()
+    {
+        closeAll();
+        closeEnd(up);
+        closeEnd(down);
+        closeEnd(result);
+    }
+
+    bool setup(const vector<int>& shardBounds, int haloRows, size_t rowBytes)
+    {
+        size_t k;
+        bounds = shardBounds;
+        this->rowBytes = rowBytes;
+        haloBytes = haloRows * rowBytes;
+        links.assign(bounds.size() - 2, vector<int>(2, -1));
+        results.assign(bounds.size() - 1, vector<int>(2, -1));
+        for (k = 0; k < links.size(); k++)
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, &links[k][0]) != 0)
+                return false;
+        for (k = 0; k < results.size(); k++)
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, &results[k][0]) != 0)
+                return false;
+        return true;
+    }
+
+    void attach(int w)
+    {
+        up = w > 0 ? take(links[w - 1][1]) : -1;
+        down = w < (int) links.size() ? take(links[w][0]) : -1;
+        result = take(results[w][1]);
+        closeAll();
+        if (up >= 0)
+            fcntl(up, F_SETFL, fcntl(up, F_GETFL) | O_NONBLOCK);
+        if (down >= 0)
+            fcntl(down, F_SETFL, fcntl(down, F_GETFL) | O_NONBLOCK);
+    }
+
+    void attachParent()
+    {
+        size_t k;
+        for (k = 0; k < links.size(); k++)
+        {
+            closeEnd(links[k][0]);
+            closeEnd(links[k][1]);
+        }
+        for (k = 0; k < results.size(); k++)
+            closeEnd(results[k][1]);
+    }
+
+    /************************ SocketTransport::exchange *******************
+     * Sends and receives on both links at once with poll, so neither
+     * neighbor can block writing a halo larger than the socket buffer
+     * while the other is blocked writing too.
+     **********************************************************************/
+    bool exchange(const uchar *toUp, const uchar *toDown, uchar *fromUp, uchar *fromDown)
+    {
+        const uchar *out[2] = { toUp, toDown };
+        uchar *in[2] = { fromUp, fromDown };
+        int fds[2] = { up, down };
+        size_t sent[2] = { 0, 0 }, received[2] = { 0, 0 };
+        struct pollfd polls[2];
+        ssize_t moved;
+        int k, count;
+        while (true)
+        {
+            count = 0;
+            for (k = 0; k < 2; k++)
+            {
+                polls[k].fd = -1;
+                polls[k].events = 0;
+                polls[k].revents = 0;
+                if (fds[k] < 0)
+                    continue;
+                if (out[k] && sent[k] < haloBytes)
+                    polls[k].events |= POLLOUT;
+                if (in[k] && received[k] < haloBytes)
+                    polls[k].events |= POLLIN;
+                if (polls[k].events)
+                {
+                    polls[k].fd = fds[k];
+                    count++;
+                }
+            }
+            if (count == 0)
+                return true;
+            if (poll(polls, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            for (k = 0; k < 2; k++)
+            {
+                if (polls[k].revents & POLLOUT)
+                {
+                    moved = send(fds[k], out[k] + sent[k], haloBytes - sent[k], MSG_NOSIGNAL);
+                    if (moved < 0 && errno != EAGAIN && errno != EINTR)
+                        return false;
+                    sent[k] += moved > 0 ? moved : 0;
+                }
+                if ((polls[k].revents & (POLLIN | POLLHUP | POLLERR)) && in[k] && received[k] < haloBytes)
+                {
+                    moved = recv(fds[k], in[k] + received[k], haloBytes - received[k], 0);
+                    if (moved == 0 || (moved < 0 && errno != EAGAIN && errno != EINTR))
+                        return false;       // neighbor gone
+                    received[k] += moved > 0 ? moved : 0;
+                }
+            }
+        }
+    }
+
+    bool sendResult(const Mat& rows)
+    {
+        int r;
+        for (r = 0; r < rows.rows; r++)
+            if (!transfer(result, (uchar *) rows.ptr(r), rowBytes, true))
+                return false;
+        return true;
+    }
+
+    bool finish(const vector<pid_t>& children, Mat& output)
+    {
+        bool ok = true;
+        size_t w;
+        int r;
+        for (w = 0; w < results.size(); w++)
+        {
+            for (r = bounds[w]; ok && r < bounds[w + 1]; r++)
+                ok = transfer(results[w][0], output.ptr(r), rowBytes, false);
+            closeEnd(results[w][0]);
+        }
+        return reapWorkers(children, NULL) && ok;
+    }
+
+private:
+    // Blocking send or receive of exactly bytes
+    static bool transfer(int fd, uchar *data, size_t bytes, bool sending)
+    {
+        size_t done = 0;
+        ssize_t moved;
+        while (done < bytes)
+        {
+            moved = sending ? send(fd, data + done, bytes - done, MSG_NOSIGNAL)
+                            : recv(fd, data + done, bytes - done, 0);
+            if (moved < 0 && errno == EINTR)
+                continue;
+            if (moved <= 0)
+                return false;
+            done += moved;
+        }
+        return true;
+    }
+
+    static int take(int& fd)
+    {
+        int kept = fd;
+        fd = -1;
+        return kept;
+    }
+
+    static void closeEnd(int& fd)
+    {
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+
+    void closeAll()
+    {
+        size_t k;
+        for (k = 0; k < links.size(); k++)
+        {
+            closeEnd(links[k][0]);
+            closeEnd(links[k][1]);
+        }
+        for (k = 0; k < results.size(); k++)
+        {
+            closeEnd(results[k][0]);
+            closeEnd(results[k][1]);
+        }
+    }
+
+    vector<int> bounds;
+    vector<vector<int> > links, results;
+    size_t rowBytes, haloBytes;
+    int up, down, result;         // this worker's ends
+};
+
+/*************************** createHaloTransport **************************
+ * HaloTransport *createHaloTransport(const string& name)
+ *
+ * Description: New transport by name, "shm" or "socket", NULL for any
+ * other name.  The caller deletes it.
+ **************************************************************************/
+HaloTransport *createHaloTransport(const string& name)
+{
+    if (name == "shm")
+        return new ShmTransport();
+    if (name == "socket")
+        return new SocketTransport();
+    return NULL;
+}
@@ -0,0 +1,44 @@
+/***********************************************************************************
+ * haloTransport.hpp written by Timothy Hennessy
+ *
+ * Description: Message transport between the worker processes of a
+ * sharded run.  Worker w owns rows [bounds[w], bounds[w + 1]) of the image
+ * and after every block of iterations swaps haloRows boundary rows with
+ * its neighbors w - 1 and w + 1; at the end it hands its rows to the
+ * parent.
+ *
+ * Backends:
+ * - shm: one POSIX shared memory segment with a double-buffered halo slot
+ *   per worker and direction, a spinning barrier, and the result image.
+ * - socket: a Unix domain socket pair per pair of neighbors and one per
+ *   worker to the parent.
+ * Only exchange, sendResult and finish move data, so a backend for
+ * workers on several machines implements the same three calls.
+ *
+ * Lifecycle:
+ * 1.) Parent: setup, then fork the workers.
+ * 2.) Worker: attach, then exchange per block and sendResult once.
+ * 3.) Parent: attachParent, then finish, which also reaps the workers.
+ *********************************************************************************/
+#ifndef HALO_TRANSPORT_HPP
+#define HALO_TRANSPORT_HPP
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+class HaloTransport
+{
+public:
+    virtual ~HaloTransport() {}
+    virtual bool setup(const std::vector<int>& bounds, int haloRows, size_t rowBytes) = 0;
+    virtual void attach(int worker) = 0;
+    virtual void attachParent() = 0;
+    virtual bool exchange(const uchar *toUp, const uchar *toDown, uchar *fromUp, uchar *fromDown) = 0;
+    virtual bool sendResult(const cv::Mat& rows) = 0;
+    virtual bool finish(const std::vector<pid_t>& workers, cv::Mat& output) = 0;
+};
+
+HaloTransport *createHaloTransport(const std::string& name);
+
+#endif
@@ -0,0 +1,369 @@
+/***********************************************************************************
+ * imageDiff.cpp written by Timothy Hennessy
+ *
+ * Description: Banded, vectorized image comparison.
+ *
+ * A row is processed in blocks of cn vectors, i.e. 16 (SSE2) or 32 (AVX2)
+ * whole pixels.  Within a block, lane l of vector k always holds channel
+ * (width * k + l) % cn, so one running maximum per vector is enough for
+ * per-channel maxima.  The nonzero bytes of a block form a bit mask, which
+ * is folded over the cn bytes of each pixel to count differing pixels and
+ * find the first and last one without leaving the vector loop.
+ *
+ * NOTES:
+ * - Squares are summed in 32-bit lanes and flushed to 64-bit lanes every
+ *   FLUSH_BLOCKS blocks, well before a lane could overflow.
+ *********************************************************************************/
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "imageDiff.hpp"
+#include "simdAverage.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+using namespace cv;
+using namespace std;
+
+#define FLUSH_BLOCKS 1024
+#define BANDS_PER_THREAD 4
+
+typedef unsigned long long uint64;
+
+struct RowDiff
+{
+    uint64 sumSquares;
+    int maxError[4];
+    long long mismatches;
+    int first, last;        // first and last differing column, -1 if none
+};
+
+typedef void (*DiffKernel)(const uchar *a, const uchar *b, int cols, int cn, RowDiff& out);
+
+/**************************** diffPixelsScalar ****************************
+ * Description: Compares pixels [begin, cols) of a row one byte at a time.
+ * Used on its own and for the tail the vector kernels leave.
+ **************************************************************************/
+static void diffPixelsScalar(const uchar *a, const uchar *b, int begin, int cols, int cn,
+                             RowDiff& out)
+{
+    int x, c, d, differs;
+    for (x = begin; x < cols; x++)
+    {
+        differs = 0;
+        for (c = 0; c < cn; c++)
+        {
+            d = abs(a[x * cn + c] - b[x * cn + c]);
+            out.sumSquares += (uint64) (d * d);
+            out.maxError[c] = max(out.maxError[c], d);
+            differs |= d;
+        }
+        if (differs)
+        {
+            out.mismatches++;
+            if (out.first < 0)
+                out.first = x;
+            out.last = x;
+        }
+    }
+}
+
+static void diffRowScalar(const uchar *a, const uchar *b, int cols, int cn, RowDiff& out)
+{
+    diffPixelsScalar(a, b, 0, cols, cn, out);
+}
+
+#ifdef SIMD_X86
+/****************************** addPixelMask ******************************
+ * static void addPixelMask(uint64 mask, uint64 starts, int cn,
+ *                          int firstPixel, RowDiff& out)
+ *
+ * Description: mask has one bit per byte of 16 consecutive pixels, set
+ * where the byte differs.  Folds it to one bit per pixel (the bit of the
+ * pixel's first byte, selected by starts) and updates the pixel count and
+ * the first and last differing column.
+ **************************************************************************/
+static inline void addPixelMask(uint64 mask, uint64 starts, int cn, int firstPixel,
+                                RowDiff& out)
+{
+    uint64 pixels = mask;
+    int s;
+    for (s = 1; s < cn; s++)
+        pixels |= mask >> s;
+    pixels &= starts;
+    if (!pixels)
+        return;
+    out.mismatches += __builtin_popcountll(pixels);
+    if (out.first < 0)
+        out.first = firstPixel + __builtin_ctzll(pixels) / cn;
+    out.last = firstPixel + (63 - __builtin_clzll(pixels)) / cn;
+}
+
+static uint64 pixelStarts(int cn)
+{
+    uint64 starts = 0;
+    int p;
+    for (p = 0; p < 16; p++)
+        starts |= 1ULL << (p * cn);
+    return starts;
+}
+
+static void diffRowSse2(const uchar *a, const uchar *b, int cols, int cn, RowDiff& out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i maxv[4] = { zero, zero, zero, zero };
+    __m128i sq32 = zero, sq64 = zero;
+    uint64 starts = pixelStarts(cn), mask, lanes[2];
+    uchar bytes[16];
+    int block = 16 * cn, end = cols * cn, x, k, l, blocks = 0;
+    for (x = 0; x + block <= end; x += block)
+    {
+        mask = 0;
+        for (k = 0; k < cn; k++)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i *) (a + x + 16 * k));
+            __m128i vb = _mm_loadu_si128((const __m128i *) (b + x + 16 * k));
+            __m128i d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+            __m128i lo = _mm_unpacklo_epi8(d, zero), hi = _mm_unpackhi_epi8(d, zero);
+            maxv[k] = _mm_max_epu8(maxv[k], d);
+            sq32 = _mm_add_epi32(sq32, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+            mask |= (uint64) (~_mm_movemask_epi8(_mm_cmpeq_epi8(d, zero)) & 0xFFFF) << (16 * k);
+        }
+        if (mask)
+            addPixelMask(mask, starts, cn, x / cn, out);
+        if (++blocks == FLUSH_BLOCKS)
+        {
+            sq64 = _mm_add_epi64(sq64, _mm_unpacklo_epi32(sq32, zero));
+            sq64 = _mm_add_epi64(sq64, _mm_unpackhi_epi32(sq32, zero));
+            sq32 = zero;
+            blocks = 0;
+        }
+    }
+    sq64 = _mm_add_epi64(sq64, _mm_unpacklo_epi32(sq32, zero));
+    sq64 = _mm_add_epi64(sq64, _mm_unpackhi_epi32(sq32, zero));
+    _mm_storeu_si128((__m128i *) lanes, sq64);
+    out.sumSquares += lanes[0] + lanes[1];
+    for (k = 0; k < cn; k++)
+    {
+        _mm_storeu_si128((__m128i *) bytes, maxv[k]);
+        for (l = 0; l < 16; l++)
+            out.maxError[(16 * k + l) % cn] = max(out.maxError[(16 * k + l) % cn], (int) bytes[l]);
+    }
+    diffPixelsScalar(a, b, x / cn, cols, cn, out);
+}
+
+// Bits [start, start + len) of the 128-bit value w[1]:w[0], len <= 64
+static inline uint64 extractBits(const uint64 w[2], int start, int len)
+{
+    uint64 v;
+    if (start >= 64)
+        v = w[1] >> (start - 64);
+    else if (start == 0)
+        v = w[0];
+    else
+        v = (w[0] >> start) | (w[1] << (64 - start));
+    return len == 64 ? v : v & ((1ULL << len) - 1);
+}
+
+__attribute__((target("avx2")))
+static void diffRowAvx2(const uchar *a, const uchar *b, int cols, int cn, RowDiff& out)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i maxv[4] = { zero, zero, zero, zero };
+    __m256i sq32 = zero, sq64 = zero;
+    uint64 starts = pixelStarts(cn), mask[2], lanes[4];
+    uchar bytes[32];
+    int block = 32 * cn, end = cols * cn, x, k, l, blocks = 0;
+    for (x = 0; x + block <= end; x += block)
+    {
+        mask[0] = mask[1] = 0;
+        for (k = 0; k < cn; k++)
+        {
+            __m256i va = _mm256_loadu_si256((const __m256i *) (a + x + 32 * k));
+            __m256i vb = _mm256_loadu_si256((const __m256i *) (b + x + 32 * k));
+            __m256i d = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+            __m256i lo = _mm256_unpacklo_epi8(d, zero), hi = _mm256_unpackhi_epi8(d, zero);
+            maxv[k] = _mm256_max_epu8(maxv[k], d);
+            sq32 = _mm256_add_epi32(sq32, _mm256_add_epi32(_mm256_madd_epi16(lo, lo),
+                                                           _mm256_madd_epi16(hi, hi)));
+            mask[k / 2] |= (uint64) (unsigned int) ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(d, zero))
+                           << (32 * (k % 2));
+        }
+        if (mask[0] | mask[1])
+        {
+            addPixelMask(extractBits(mask, 0, 16 * cn), starts, cn, x / cn, out);
+            addPixelMask(extractBits(mask, 16 * cn, 16 * cn), starts, cn, x / cn + 16, out);
+        }
+        if (++blocks == FLUSH_BLOCKS)
+        {
+            sq64 = _mm256_add_epi64(sq64, _mm256_unpacklo_epi32(sq32, zero));
+            sq64 = _mm256_add_epi64(sq64, _mm256_unpackhi_epi32(sq32, zero));
+            sq32 = zero;
+            blocks = 0;
+        }
+    }
+    sq64 = _mm256_add_epi64(sq64, _mm256_unpacklo_epi32(sq32, zero));
+    sq64 = _mm256_add_epi64(sq64, _mm256_unpackhi_epi32(sq32, zero));
+    _mm256_storeu_si256((__m256i *) lanes, sq64);
+    out.sumSquares += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for (k = 0; k < cn; k++)
+    {
+        _mm256_storeu_si256((__m256i *) bytes, maxv[k]);
+        for (l = 0; l < 32; l++)
+            out.maxError[(32 * k + l) % cn] = max(out.maxError[(32 * k + l) % cn], (int) bytes[l]);
+    }
+    diffPixelsScalar(a, b, x / cn, cols, cn, out);
+}
+#endif
+
+/****************************** selectKernel ******************************
+ * Description: Widest diff kernel allowed by simdLevel().  There is no
+ * AVX-512 variant, the comparison is bound by memory bandwidth well
+ * before AVX2 runs out.
+ **************************************************************************/
+static DiffKernel selectKernel()
+{
+#ifdef SIMD_X86
+    if (simdLevel() >= SIMD_AVX2)
+        return diffRowAvx2;
+    if (simdLevel() >= SIMD_SSE2)
+        return diffRowSse2;
+#endif
+    return diffRowScalar;
+}
+
+struct DiffJob
+{
+    const Mat *a, *b;
+    bool earlyExit;
+    int numBands;
+    DiffKernel kernel;
+    vector<RowDiff> bands;
+    vector<int> firstRow, lastRow;
+    atomic<bool> stop;
+};
+
+/******************************** diffBand ********************************
+ * void diffBand(void *p, int band)
+ *
+ * Description: Pool task.  Compares the rows of one band and accumulates
+ * them into job->bands[band].  In early-exit mode every band stops at the
+ * first row with a difference anywhere in the image.
+ **************************************************************************/
+static void diffBand(void *p, int band)
+{
+    DiffJob *job = (DiffJob *) p;
+    int startRow = (int) ((long) job->a->rows * band / job->numBands);
+    int endRow = (int) ((long) job->a->rows * (band + 1) / job->numBands);
+    int r, c, cn = job->a->channels();
+    RowDiff& total = job->bands[band];
+    RowDiff row;
+    for (r = startRow; r < endRow && !job->stop; r++)
+    {
+        row.sumSquares = 0;
+        row.mismatches = 0;
+        row.first = row.last = -1;
+        for (c = 0; c < 4; c++)
+            row.maxError[c] = 0;
+        job->kernel(job->a->ptr(r), job->b->ptr(r), job->a->cols, cn, row);
+
+        total.sumSquares += row.sumSquares;
+        for (c = 0; c < cn; c++)
+            total.maxError[c] = max(total.maxError[c], row.maxError[c]);
+        if (row.mismatches == 0)
+            continue;
+        total.mismatches += row.mismatches;
+        total.first = total.first < 0 ? row.first : min(total.first, row.first);
+        total.last = max(total.last, row.last);
+        if (job->firstRow[band] < 0)
+            job->firstRow[band] = r;
+        job->lastRow[band] = r;
+        if (job->earlyExit)
+            job->stop = true;
+    }
+}
+
+/******************************* diffImages *******************************
+ * bool diffImages(const Mat& a, const Mat& b, ThreadPool& pool,
+ *                 bool earlyExit, DiffReport& report)
+ *
+ * Description: Compares a and b and fills report.
+ *
+ * Process:
+ * 1.) Check that both images have the same size and type.
+ * 2.) Split the rows into bands and compare them on pool.
+ * 3.) Merge band results and derive MSE, PSNR and the bounding box.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * a, b          in          8-bit images with 1 to 4 channels.
+ * pool          in          threads to compare with.
+ * earlyExit     in          stop at the first difference.  Only mismatches
+ *                           > 0 is meaningful then, report.complete is false.
+ * report        out         metrics, see DiffReport.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * bool          value       False if the images cannot be compared.
+ **************************************************************************/
+bool diffImages(const Mat& a, const Mat& b, ThreadPool& pool, bool earlyExit,
+                DiffReport& report)
+{
+    DiffJob job;
+    int band, c, cn = a.channels();
+    int firstRow = -1, lastRow = -1, firstCol = -1, lastCol = -1;
+    uint64 sumSquares = 0;
+
+    if (a.empty() || a.size() != b.size() || a.type() != b.type() || a.depth() != CV_8U
+        || cn > 4)
+        return false;
+
+    job.a = &a;
+    job.b = &b;
+    job.earlyExit = earlyExit;
+    job.numBands = min(a.rows, pool.size() * BANDS_PER_THREAD);
+    job.kernel = selectKernel();
+    job.bands.resize(job.numBands);
+    job.firstRow.assign(job.numBands, -1);
+    job.lastRow.assign(job.numBands, -1);
+    job.stop = false;
+    for (band = 0; band < job.numBands; band++)
+    {
+        RowDiff& d = job.bands[band];
+        d.sumSquares = 0;
+        d.mismatches = 0;
+        d.first = d.last = -1;
+        for (c = 0; c < 4; c++)
+            d.maxError[c] = 0;
+    }
+    pool.parallelFor(job.numBands, diffBand, &job);
+
+    report.mismatches = 0;
+    report.channels = cn;
+    for (c = 0; c < 4; c++)
+        report.maxError[c] = 0;
+    for (band = 0; band < job.numBands; band++)
+    {
+        const RowDiff& d = job.bands[band];
+        sumSquares += d.sumSquares;
+        report.mismatches += d.mismatches;
+        for (c = 0; c < cn; c++)
+            report.maxError[c] = max(report.maxError[c], d.maxError[c]);
+        if (d.mismatches == 0)
+            continue;
+        if (firstRow < 0)
+            firstRow = job.firstRow[band];
+        lastRow = job.lastRow[band];
+        firstCol = firstCol < 0 ? d.first : min(firstCol, d.first);
+        lastCol = max(lastCol, d.last);
+    }
+    report.complete = !job.stop;
+    report.mse = (double) sumSquares / ((double) a.total() * cn);
+    report.psnr = report.mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / report.mse)
+                                   : numeric_limits<double>::infinity();
+    report.bounds = firstRow < 0 ? Rect()
+                                 : Rect(firstCol, firstRow, lastCol - firstCol + 1, lastRow - firstRow + 1);
+    return true;
+}
@@ -0,0 +1,32 @@
+/***********************************************************************************
+ * imageDiff.hpp written by Timothy Hennessy
+ *
+ * Description: Parallel, vectorized comparison of two 8-bit images.  Rows
+ * are split into bands that run on a ThreadPool, and every row is compared
+ * 16 or 32 bytes at a time with SSE2 or AVX2 (picked like the averaging
+ * kernels, see simdAverage.hpp, and capped by SMOOTH_SIMD as well).
+ *
+ * Besides identical or not, it measures how far apart the images are, so
+ * approximate engines (e.g. the composite kernel) can be checked against
+ * a tolerance instead of only for bit equality.
+ *********************************************************************************/
+#ifndef IMAGE_DIFF_HPP
+#define IMAGE_DIFF_HPP
+#include <opencv2/opencv.hpp>
+#include "threadPool.hpp"
+
+struct DiffReport
+{
+    long long mismatches;   // pixels that differ in at least one channel
+    int channels;
+    int maxError[4];        // largest absolute difference, per channel
+    double mse;             // mean squared error over all samples
+    double psnr;            // dB, infinity when the images are identical
+    cv::Rect bounds;        // bounding box of the differing pixels, or empty
+    bool complete;          // false if stopped at the first difference
+};
+
+bool diffImages(const cv::Mat& a, const cv::Mat& b, ThreadPool& pool, bool earlyExit,
+                DiffReport& report);
+
+#endif
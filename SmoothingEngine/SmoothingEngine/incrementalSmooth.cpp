@@ -0,0 +1,101 @@
+/***********************************************************************************
+ * incrementalSmooth.cpp written by Timothy Hennessy
+ *
+ * Description: Recomputes only the part of a smoothed image a local input
+ * change can reach.
+ *********************************************************************************/
+#include "incrementalSmooth.hpp"
+#include "boxAverage.hpp"
+using namespace cv;
+using namespace std;
+
+/******************************** growRect ********************************
+ * Rect growRect(const Rect& rect, long long by, const Rect& bounds)
+ *
+ * Description: rect grown by "by" pixels on every side, clipped to bounds.
+ **************************************************************************/
+static Rect growRect(const Rect& rect, long long by, const Rect& bounds)
+{
+    long long x0 = max((long long) bounds.x, rect.x - by);
+    long long y0 = max((long long) bounds.y, rect.y - by);
+    long long x1 = min((long long) bounds.x + bounds.width, (long long) rect.x + rect.width + by);
+    long long y1 = min((long long) bounds.y + bounds.height, (long long) rect.y + rect.height + by);
+    return Rect((int) x0, (int) y0, (int) (x1 - x0), (int) (y1 - y0));
+}
+
+/**************************** incrementalSmooth ***************************
+ * bool incrementalSmooth(const Mat& input, const Mat& previousOutput,
+ *                        const Rect& changed, int radius, int iterations,
+ *                        Mat& output, Rect *recomputed)
+ *
+ * Description: Produces the result of iterations averaging operations on
+ * input, given previousOutput, the result for an earlier input that
+ * differed from input only inside changed.
+ *
+ * Process:
+ * 1.) Copy input inside the change grown by 2 * n * radius into a local
+ *     buffer.  Its edges are either image edges or too far away to matter.
+ * 2.) Run pass k = 1..n over the change grown by (2n - k) * radius only,
+ *     ping-ponging between two local buffers.  Every pixel a pass computes
+ *     reads only pixels the previous pass computed, so each one is exact.
+ * 3.) Copy previousOutput to output and overwrite the change grown by
+ *     n * radius with the last pass.
+ *
+ * Parameter      Direction   Description
+ * ------------------------------------------------------------------------
+ * input          in          new 8-bit input image.
+ * previousOutput in          result of the same radius and iterations on
+ *                            the previous input, same size and type.
+ * changed        in          rectangle holding every changed pixel, may
+ *                            be empty.  Clipped to the image.
+ * radius         in          neighborhood radius of both runs, >= 1.
+ * iterations     in          averaging operations of both runs, >= 0.
+ * output         out         new result.  May be previousOutput itself, in
+ *                            which case only the affected area is written.
+ * recomputed     out         optional, area of output that was recomputed.
+ *
+ * Returns        Method      Description
+ * ------------------------------------------------------------------------
+ * bool           value       False if the images do not match or params
+ *                            are out of range.
+ **************************************************************************/
+bool incrementalSmooth(const Mat& input, const Mat& previousOutput, const Rect& changed,
+                       int radius, int iterations, Mat& output, Rect *recomputed)
+{
+    Rect bounds(0, 0, input.cols, input.rows), change, window, pass, affected;
+    Mat buffers[2], target;
+    AverageScratch scratch;
+    int k;
+
+    if (input.empty() || input.depth() != CV_8U || radius < 1 || iterations < 0
+        || previousOutput.size() != input.size() || previousOutput.type() != input.type())
+        return false;
+    change = changed & bounds;
+    if (change.width <= 0 || change.height <= 0)
+        change = Rect();
+    affected = change.area() ? growRect(change, (long long) iterations * radius, bounds) : Rect();
+
+    // Pass 0 is the input over the largest region any later pass reads
+    if (change.area())
+    {
+        window = growRect(change, 2LL * iterations * radius, bounds);
+        input(window).copyTo(buffers[0]);
+        buffers[1].create(window.size(), input.type());
+        for (k = 1; k <= iterations; k++)
+        {
+            pass = growRect(change, (2LL * iterations - k) * radius, bounds);
+            boxAverageRect(buffers[(k - 1) % 2], buffers[k % 2], radius, pass - window.tl(), scratch);
+        }
+    }
+
+    if (output.data != previousOutput.data)
+        previousOutput.copyTo(output);
+    if (change.area())
+    {
+        target = output(affected);
+        buffers[iterations % 2](affected - window.tl()).copyTo(target);
+    }
+    if (recomputed)
+        *recomputed = affected;
+    return true;
+}
@@ -0,0 +1,24 @@
+/***********************************************************************************
+ * incrementalSmooth.hpp written by Timothy Hennessy
+ *
+ * Description: Incremental recomputation after a local edit.  One averaging
+ * pass moves information by at most radius pixels, so when an input changes
+ * only inside a rectangle, n passes change the output only inside that
+ * rectangle grown by n * radius.  Everything else is taken from the output
+ * of the previous run.
+ *
+ * To recompute the affected area exactly, pass k only needs the pixels that
+ * pass k + 1 reads, i.e. the affected area grown by (n - k) * radius.  The
+ * recomputed region therefore starts at the change grown by 2 * n * radius
+ * and shrinks by radius every pass, and the result is bit-identical to
+ * smoothing the whole new input again.
+ *********************************************************************************/
+#ifndef INCREMENTAL_SMOOTH_HPP
+#define INCREMENTAL_SMOOTH_HPP
+#include <opencv2/opencv.hpp>
+
+bool incrementalSmooth(const cv::Mat& input, const cv::Mat& previousOutput,
+                       const cv::Rect& changed, int radius, int iterations,
+                       cv::Mat& output, cv::Rect *recomputed = NULL);
+
+#endif
@@ -0,0 +1,160 @@
+/***********************************************************************************
+ * integralImage.cpp written by Timothy Hennessy
+ *
+ * Description: Summed-area table (integral image) backend.  Sums are kept
+ * per channel in 32-bit unsigned integers.  The table itself may wrap on
+ * large images, but modular arithmetic keeps every window sum exact as long
+ * as the window holds fewer than 2^32 / 255 (about 16.8 million) pixels.
+ *********************************************************************************/
+#include "integralImage.hpp"
+using namespace cv;
+using namespace std;
+
+/************************** buildSummedAreaTable **************************
+ * void buildSummedAreaTable(const Mat& src, SummedAreaTable& table)
+ *
+ * Description: Builds the summed-area table of src.  Entry (y, x) holds
+ * the sum of every pixel above and to the left of (y, x), exclusive, so
+ * row 0 and column 0 are all zero.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * src           in          8-bit image of any channel count.
+ * table         out         Table sized (rows + 1) x (cols + 1) x cn.
+ *                           Storage is reused between calls.
+ **************************************************************************/
+void buildSummedAreaTable(const Mat& src, SummedAreaTable& table)
+{
+    CV_Assert(src.depth() == CV_8U);        // ensures pixel value range [0..255]
+    int cn = src.channels();
+    int stride = (src.cols + 1) * cn;       // entries per table row
+    int i, j, k;
+    table.rows = src.rows;
+    table.cols = src.cols;
+    table.cn   = cn;
+    table.sums.assign((size_t) (src.rows + 1) * stride, 0);
+    for (i = 0; i < src.rows; i++)
+    {
+        const uchar *row = src.ptr<uchar>(i);
+        const unsigned int *above = &table.sums[(size_t) i * stride];
+        unsigned int *curr = &table.sums[(size_t) (i + 1) * stride];
+        // Entry to the left plus column above, minus their overlap
+        for (j = 0; j < src.cols; j++)
+            for (k = 0; k < cn; k++)
+                curr[(j + 1) * cn + k] = curr[j * cn + k] + above[(j + 1) * cn + k]
+                                       - above[j * cn + k] + row[j * cn + k];
+    }
+}
+
+/****************************** windowAverage *****************************
+ * void windowAverage(const SummedAreaTable& table, const Rect& window,
+ *                    uchar *out)
+ *
+ * Description: Averages every channel over window.  The window is first
+ * clipped to the image and divided by the number of cells left.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * table         in          Table built by buildSummedAreaTable.
+ * window        in          Window in image coordinates, may extend past
+ *                           the image border.
+ * out           out         table.cn averaged channel values.
+ *
+ * NOTES:
+ * - A window entirely outside the image leaves out untouched.
+ **************************************************************************/
+void windowAverage(const SummedAreaTable& table, const Rect& window, uchar *out)
+{
+    int x0 = max(window.x, 0), x1 = min(window.x + window.width, table.cols);
+    int y0 = max(window.y, 0), y1 = min(window.y + window.height, table.rows);
+    int stride = (table.cols + 1) * table.cn;
+    int k;
+    if (x1 <= x0 || y1 <= y0)
+        return;
+    unsigned int count = (unsigned int) (x1 - x0) * (unsigned int) (y1 - y0);
+    const unsigned int *top    = &table.sums[(size_t) y0 * stride];
+    const unsigned int *bottom = &table.sums[(size_t) y1 * stride];
+    for (k = 0; k < table.cn; k++)
+    {
+        unsigned int sum = bottom[x1 * table.cn + k] - bottom[x0 * table.cn + k]
+                         - top[x1 * table.cn + k] + top[x0 * table.cn + k];
+        out[k] = saturate_cast<uchar>(sum / count);
+    }
+}
+
+/*************************** integralAverageRows **************************
+ * void integralAverageRows(const SummedAreaTable& table, Mat& dst,
+ *                          int radiusX, int radiusY,
+ *                          int startRow, int endRow)
+ *
+ * Description: Averages a (2 * radiusX + 1) wide by (2 * radiusY + 1) tall
+ * window centered at every pixel of rows [startRow, endRow).
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * table         in          Table built by buildSummedAreaTable.
+ * dst           out         Preallocated 8-bit image the size of the
+ *                           table's source, with table.cn channels.
+ * radiusX       in          Horizontal half width, radiusX >= 0.
+ * radiusY       in          Vertical half height, radiusY >= 0.
+ * startRow      in          First row to produce.
+ * endRow        in          One past the last row to produce.
+ **************************************************************************/
+void integralAverageRows(const SummedAreaTable& table, Mat& dst, int radiusX,
+                         int radiusY, int startRow, int endRow)
+{
+    CV_Assert(dst.rows == table.rows && dst.cols == table.cols);
+    CV_Assert(dst.depth() == CV_8U && dst.channels() == table.cn);
+    CV_Assert(radiusX >= 0 && radiusY >= 0);
+    int r, c;
+    for (r = startRow; r < endRow; r++)
+    {
+        uchar *out = dst.ptr<uchar>(r);
+        for (c = 0; c < table.cols; c++)
+            windowAverage(table, Rect(c - radiusX, r - radiusY, 2 * radiusX + 1, 2 * radiusY + 1),
+                          out + c * table.cn);
+    }
+}
+
+/***************************** integralAverage ****************************
+ * void integralAverage(const SummedAreaTable& table, Mat& dst,
+ *                      int radiusX, int radiusY)
+ *
+ * Description: Averages the whole image.  Allocates dst if needed.
+ **************************************************************************/
+void integralAverage(const SummedAreaTable& table, Mat& dst, int radiusX, int radiusY)
+{
+    dst.create(table.rows, table.cols, CV_MAKETYPE(CV_8U, table.cn));
+    integralAverageRows(table, dst, radiusX, radiusY, 0, table.rows);
+}
+
+/**************************** integralAverageMap **************************
+ * void integralAverageMap(const SummedAreaTable& table, const Mat& radii,
+ *                         Mat& dst)
+ *
+ * Description: Averages a square window whose radius is chosen per pixel.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * table         in          Table built by buildSummedAreaTable.
+ * radii         in          CV_8UC1 or CV_32SC1 image the size of the
+ *                           source holding the radius of every pixel.
+ * dst           out         Averaged image.  Allocated if needed.
+ **************************************************************************/
+void integralAverageMap(const SummedAreaTable& table, const Mat& radii, Mat& dst)
+{
+    CV_Assert(radii.rows == table.rows && radii.cols == table.cols);
+    CV_Assert(radii.type() == CV_8UC1 || radii.type() == CV_32SC1);
+    int r, c, radius;
+    dst.create(table.rows, table.cols, CV_MAKETYPE(CV_8U, table.cn));
+    for (r = 0; r < table.rows; r++)
+    {
+        uchar *out = dst.ptr<uchar>(r);
+        for (c = 0; c < table.cols; c++)
+        {
+            radius = radii.type() == CV_8UC1 ? radii.at<uchar>(r, c) : radii.at<int>(r, c);
+            windowAverage(table, Rect(c - radius, r - radius, 2 * radius + 1, 2 * radius + 1),
+                          out + c * table.cn);
+        }
+    }
+}
@@ -0,0 +1,29 @@
+/***********************************************************************************
+ * integralImage.hpp written by Timothy Hennessy
+ *
+ * Description: Summed-area table (integral image) backend.  The table is
+ * built once in O(N), after which the average of any axis aligned window
+ * costs four lookups and one division, regardless of window size.
+ *
+ * Windows clipped by the image border are divided by the number of valid
+ * cells, matching boxAverage and the original neighborhoodAverage.
+ *********************************************************************************/
+#ifndef INTEGRAL_IMAGE_HPP
+#define INTEGRAL_IMAGE_HPP
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+struct SummedAreaTable
+{
+    int rows, cols, cn;              // dimensions of the source image
+    std::vector<unsigned int> sums;  // (rows + 1) x (cols + 1) x cn sums
+};
+
+void buildSummedAreaTable(const cv::Mat& src, SummedAreaTable& table);
+void windowAverage(const SummedAreaTable& table, const cv::Rect& window, uchar *out);
+void integralAverageRows(const SummedAreaTable& table, cv::Mat& dst, int radiusX,
+                         int radiusY, int startRow, int endRow);
+void integralAverage(const SummedAreaTable& table, cv::Mat& dst, int radiusX, int radiusY);
+void integralAverageMap(const SummedAreaTable& table, const cv::Mat& radii, cv::Mat& dst);
+
+#endif
@@ -0,0 +1,171 @@
+/***********************************************************************************
+ * planarLayout.cpp written by Timothy Hennessy
+ *
+ * Description: Padded channel planes and smoothing runs on them.
+ *********************************************************************************/
+#include "planarLayout.hpp"
+#include "boxAverage.hpp"
+using namespace cv;
+using namespace std;
+
+#define CACHE_LINE 64
+#define PAGE_BYTES 4096     // L1 set index wraps every 4 KB
+
+/******************************* paddedStride *****************************
+ * size_t paddedStride(size_t bytes, int count)
+ *
+ * Description: Rounds bytes up to whole cache lines, then adds lines
+ * until none of the first count multiples is a multiple of PAGE_BYTES,
+ * so count rows (or planes) spaced by the result start in different sets.
+ **************************************************************************/
+static size_t paddedStride(size_t bytes, int count)
+{
+    size_t stride = (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    int k;
+    for (k = 1; k < count; k++)
+    {
+        if ((k * stride) % PAGE_BYTES == 0)
+        {
+            stride += CACHE_LINE;
+            k = 0;
+        }
+    }
+    return stride;
+}
+
+/*************************** PlanarImage::create **************************
+ * void PlanarImage::create(int rows, int cols, int channels, int depth)
+ *
+ * Description: Lays out channels planes of rows x cols in one allocation,
+ * a no-op if the image already has that shape.
+ **************************************************************************/
+void PlanarImage::create(int rows, int cols, int channels, int depth)
+{
+    size_t rowStride = paddedStride((size_t) cols * CV_ELEM_SIZE1(depth), 2);
+    size_t planeStride = paddedStride(rows * rowStride, channels);
+    uchar *base;
+    int k;
+    if ((int) planes.size() == channels && channels > 0 && planes[0].rows == rows
+        && planes[0].cols == cols && planes[0].depth() == depth)
+        return;
+    storage.create(1, (int) (planeStride * channels + CACHE_LINE), CV_8U);
+    base = (uchar *) (((size_t) storage.data + CACHE_LINE - 1) & ~(size_t) (CACHE_LINE - 1));
+    planes.resize(channels);
+    for (k = 0; k < channels; k++)
+        planes[k] = Mat(rows, cols, CV_MAKETYPE(depth, 1), base + k * planeStride, rowStride);
+}
+
+int PlanarImage::channels() const
+{
+    return (int) planes.size();
+}
+
+template <typename T>
+static void deinterleaveRows(const Mat& src, PlanarImage& dst)
+{
+    int cn = src.channels(), r, c, k;
+    for (r = 0; r < src.rows; r++)
+    {
+        const T *in = src.ptr<T>(r);
+        for (k = 0; k < cn; k++)
+        {
+            T *out = dst.planes[k].ptr<T>(r);
+            for (c = 0; c < src.cols; c++)
+                out[c] = in[c * cn + k];
+        }
+    }
+}
+
+template <typename T>
+static void interleaveRows(const PlanarImage& src, Mat& dst)
+{
+    int cn = dst.channels(), r, c, k;
+    for (r = 0; r < dst.rows; r++)
+    {
+        T *out = dst.ptr<T>(r);
+        for (k = 0; k < cn; k++)
+        {
+            const T *in = src.planes[k].ptr<T>(r);
+            for (c = 0; c < dst.cols; c++)
+                out[c * cn + k] = in[c];
+        }
+    }
+}
+
+/****************************** deinterleave ******************************
+ * void deinterleave(const Mat& src, PlanarImage& dst)
+ *
+ * Description: Splits src into one plane per channel, allocating dst if
+ * needed.  8U, 16U and 32F (any element of 1, 2 or 4 bytes).
+ **************************************************************************/
+void deinterleave(const Mat& src, PlanarImage& dst)
+{
+    CV_Assert(src.elemSize1() == 1 || src.elemSize1() == 2 || src.elemSize1() == 4);
+    dst.create(src.rows, src.cols, src.channels(), src.depth());
+    if (src.elemSize1() == 1)
+        deinterleaveRows<uchar>(src, dst);
+    else if (src.elemSize1() == 2)
+        deinterleaveRows<ushort>(src, dst);
+    else
+        deinterleaveRows<float>(src, dst);
+}
+
+/******************************* interleave *******************************
+ * void interleave(const PlanarImage& src, Mat& dst)
+ *
+ * Description: Merges the planes of src back into an interleaved image,
+ * allocating dst if needed.
+ **************************************************************************/
+void interleave(const PlanarImage& src, Mat& dst)
+{
+    const Mat& plane = src.planes[0];
+    dst.create(plane.rows, plane.cols, CV_MAKETYPE(plane.depth(), src.channels()));
+    if (dst.elemSize1() == 1)
+        interleaveRows<uchar>(src, dst);
+    else if (dst.elemSize1() == 2)
+        interleaveRows<ushort>(src, dst);
+    else
+        interleaveRows<float>(src, dst);
+}
+
+/****************************** smoothPlanar ******************************
+ * void smoothPlanar(const Mat& src, Mat& dst, int radius, int iterations,
+ *                   PlanarWork& work)
+ *
+ * Description: Runs iterations averaging operations on src in planar
+ * layout and leaves the interleaved result in dst.
+ *
+ * Process:
+ * 1.) Deinterleave src into work.buffers[0].
+ * 2.) Ping-pong every plane between the two buffers with the single
+ *     channel kernels of boxAverageRect.
+ * 3.) Interleave the last buffer into dst.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * src           in          image of any type boxAverageRect handles per
+ *                           channel.
+ * dst           out         result, may be src itself.
+ * radius        in          neighborhood radius, >= 1.
+ * iterations    in          averaging operations, >= 0.
+ * work          in/out      planes and kernel scratch, reused between calls.
+ *
+ * NOTES:
+ * - Channels are independent, so the result is identical to the
+ *   interleaved path.
+ **************************************************************************/
+void smoothPlanar(const Mat& src, Mat& dst, int radius, int iterations, PlanarWork& work)
+{
+    int t, k;
+    deinterleave(src, work.buffers[0]);
+    work.buffers[1].create(src.rows, src.cols, src.channels(), src.depth());
+    for (t = 1; t <= iterations; t++)
+    {
+        PlanarImage& in = work.buffers[(t - 1) % 2];
+        PlanarImage& out = work.buffers[t % 2];
+        for (k = 0; k < in.channels(); k++)
+            boxAverageRect(in.planes[k], out.planes[k], radius,
+                           Rect(0, 0, src.cols, src.rows), work.scratch);
+    }
+    interleave(work.buffers[iterations % 2], dst);
+}
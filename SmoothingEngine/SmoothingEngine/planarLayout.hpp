@@ -0,0 +1,47 @@
+/***********************************************************************************
+ * planarLayout.hpp written by Timothy Hennessy
+ *
+ * Description: Planar (structure of arrays) working layout.  In an
+ * interleaved BGR image the samples of one channel are three bytes apart,
+ * so every vector the kernels load mixes channels and has to be
+ * shuffled.  For runs of many iterations it pays to split the image into
+ * one plane per channel once, run every iteration on the planes with the
+ * single-channel kernels, and interleave again only for the result.
+ *
+ * Planes share one allocation.  Every row starts on a cache line, and row
+ * and plane strides are kept off multiples of 4 KB, so the same pixel of
+ * the three planes, or of vertically adjacent rows, never competes for
+ * the same cache set.
+ *********************************************************************************/
+#ifndef PLANAR_LAYOUT_HPP
+#define PLANAR_LAYOUT_HPP
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "typedAverage.hpp"
+
+/****************************** PlanarImage *******************************
+ * channels() planes of one depth.  planes[k] is a single-channel header
+ * into the shared storage with a padded step.
+ **************************************************************************/
+class PlanarImage
+{
+public:
+    void create(int rows, int cols, int channels, int depth);
+    int channels() const;
+    std::vector<cv::Mat> planes;
+private:
+    cv::Mat storage;
+};
+
+struct PlanarWork
+{
+    PlanarImage buffers[2];   // ping-pong planes, kept between runs
+    AverageScratch scratch;   // row sums of the kernel
+};
+
+void deinterleave(const cv::Mat& src, PlanarImage& dst);
+void interleave(const PlanarImage& src, cv::Mat& dst);
+void smoothPlanar(const cv::Mat& src, cv::Mat& dst, int radius, int iterations,
+                  PlanarWork& work);
+
+#endif
@@ -0,0 +1,248 @@
+/***********************************************************************************
+ * profile.cpp written by Timothy Hennessy
+ *
+ * Description: Per-thread phase timers, optional hardware counters and
+ * the JSON report behind the macros of profile.hpp.  Empty unless
+ * SMOOTH_PROFILE is defined.
+ *********************************************************************************/
+#include "profile.hpp"
+
+#ifdef SMOOTH_PROFILE
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "timer.hpp"
+using namespace std;
+
+struct PhaseStat
+{
+    PhaseStat() : seconds(0.0), calls(0)
+    {
+        memset(counters, 0, sizeof(counters));
+    }
+    double seconds;
+    long calls;
+    long long counters[PROFILE_COUNTERS];
+};
+
+/****************************** ThreadProfile *****************************
+ * Phases of one thread, indexed by site.  Only the owning thread writes
+ * it; never freed, so the report can read threads that have exited.
+ **************************************************************************/
+struct ThreadProfile
+{
+    int thread;                 // order of the first scope on this thread
+    int perfFd;                 // counter group leader, -1 if none
+    vector<PhaseStat> phases;
+};
+
+static pthread_mutex_t REGISTRY = PTHREAD_MUTEX_INITIALIZER;
+static vector<string> SITES;              // phase name of every site
+static vector<ThreadProfile *> THREADS;
+static double START = monotonicSeconds(); // for the report's wall time
+static thread_local ThreadProfile *CURRENT = NULL;
+
+/******************************* openCounters *****************************
+ * int openCounters()
+ *
+ * Description: Opens cycles, instructions and cache misses of the calling
+ * thread as one perf event group if SMOOTH_PERF is set.  Returns the
+ * group leader, or -1 if counters are off or not permitted.
+ **************************************************************************/
+static int openCounters()
+{
+#ifdef __linux__
+    static const unsigned long long EVENTS[PROFILE_COUNTERS] =
+        { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES };
+    const char *perf = getenv("SMOOTH_PERF");
+    struct perf_event_attr attr;
+    int leader = -1, fd, k;
+    if (!perf || strcmp(perf, "1") != 0)
+        return -1;
+    for (k = 0; k < PROFILE_COUNTERS; k++)
+    {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = EVENTS[k];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        if (fd < 0)
+        {
+            if (leader >= 0)
+                close(leader);
+            return -1;
+        }
+        if (leader < 0)
+            leader = fd;
+    }
+    return leader;
+#else
+    return -1;
+#endif
+}
+
+static void readCounters(int fd, long long *counters)
+{
+    long long values[1 + PROFILE_COUNTERS];
+    int k;
+    if (fd < 0 || read(fd, values, sizeof(values)) != (ssize_t) sizeof(values))
+    {
+        memset(counters, 0, PROFILE_COUNTERS * sizeof(long long));
+        return;
+    }
+    for (k = 0; k < PROFILE_COUNTERS; k++)
+        counters[k] = values[1 + k];
+}
+
+static ThreadProfile& currentThread()
+{
+    if (CURRENT == NULL)
+    {
+        CURRENT = new ThreadProfile();
+        CURRENT->perfFd = openCounters();
+        pthread_mutex_lock(&REGISTRY);
+        CURRENT->thread = (int) THREADS.size();
+        THREADS.push_back(CURRENT);
+        pthread_mutex_unlock(&REGISTRY);
+    }
+    return *CURRENT;
+}
+
+/******************************** profileSite *****************************
+ * int profileSite(const char *name)
+ *
+ * Description: Index of phase name, registered on first use.  Called once
+ * per PROFILE_SCOPE, whose static local keeps the result.
+ **************************************************************************/
+int profileSite(const char *name)
+{
+    int site;
+    pthread_mutex_lock(&REGISTRY);
+    site = (int) (find(SITES.begin(), SITES.end(), string(name)) - SITES.begin());
+    if (site == (int) SITES.size())
+        SITES.push_back(name);
+    pthread_mutex_unlock(&REGISTRY);
+    return site;
+}
+
+ProfileScope::ProfileScope(int site) : site(site)
+{
+    readCounters(currentThread().perfFd, counters);
+    start = monotonicSeconds();
+}
+
+ProfileScope::~ProfileScope()
+{
+    double end = monotonicSeconds();
+    ThreadProfile& thread = *CURRENT;
+    long long now[PROFILE_COUNTERS];
+    int k;
+    if ((int) thread.phases.size() <= site)
+        thread.phases.resize(site + 1);
+    PhaseStat& phase = thread.phases[site];
+    phase.seconds += end - start;
+    phase.calls++;
+    if (thread.perfFd >= 0)
+    {
+        readCounters(thread.perfFd, now);
+        for (k = 0; k < PROFILE_COUNTERS; k++)
+            phase.counters[k] += now[k] - counters[k];
+    }
+}
+
+/******************************* profileReport ****************************
+ * void profileReport(const char *program)
+ *
+ * Description: Writes the JSON report to SMOOTH_PROFILE_OUT, or stderr.
+ * Call it once every profiled thread is idle, e.g. at the end of main.
+ *
+ * Process:
+ * 1.) For every phase, sum the threads that ran it and find the slowest.
+ * 2.) imbalance is slowest / mean over those threads, 1.0 is perfect.
+ * 3.) List the phases of every thread.
+ **************************************************************************/
+void profileReport(const char *program)
+{
+    static const char *COUNTER_NAMES[PROFILE_COUNTERS] = { "cycles", "instructions", "llc_misses" };
+    const char *path = getenv("SMOOTH_PROFILE_OUT");
+    FILE *out = path ? fopen(path, "w") : stderr;
+    bool counters = false;
+    size_t s, t;
+    int k;
+    if (!out)
+    {
+        fprintf(stderr, "Could not write profile: %s\n", path);
+        return;
+    }
+    pthread_mutex_lock(&REGISTRY);
+    for (t = 0; t < THREADS.size(); t++)
+        counters = counters || THREADS[t]->perfFd >= 0;
+
+    fprintf(out, "{\"program\":\"%s\",\"wall_seconds\":%.6f,\"threads\":%d,\"counters\":%s,\"phases\":[",
+            program, monotonicSeconds() - START, (int) THREADS.size(), counters ? "true" : "false");
+    for (s = 0; s < SITES.size(); s++)
+    {
+        PhaseStat total;
+        double slowest = 0.0;
+        int threads = 0;
+        for (t = 0; t < THREADS.size(); t++)
+        {
+            if (THREADS[t]->phases.size() <= s || THREADS[t]->phases[s].calls == 0)
+                continue;
+            const PhaseStat& phase = THREADS[t]->phases[s];
+            total.seconds += phase.seconds;
+            total.calls += phase.calls;
+            for (k = 0; k < PROFILE_COUNTERS; k++)
+                total.counters[k] += phase.counters[k];
+            slowest = max(slowest, phase.seconds);
+            threads++;
+        }
+        fprintf(out, "%s\n {\"name\":\"%s\",\"threads\":%d,\"calls\":%ld,\"seconds\":%.6f,"
+                "\"max_thread_seconds\":%.6f,\"mean_thread_seconds\":%.6f,\"imbalance\":%.3f",
+                s == 0 ? "" : ",", SITES[s].c_str(), threads, total.calls, total.seconds, slowest,
+                threads ? total.seconds / threads : 0.0,
+                total.seconds > 0.0 ? slowest * threads / total.seconds : 1.0);
+        for (k = 0; counters && k < PROFILE_COUNTERS; k++)
+            fprintf(out, ",\"%s\":%lld", COUNTER_NAMES[k], total.counters[k]);
+        fprintf(out, "}");
+    }
+
+    fprintf(out, "],\n\"per_thread\":[");
+    for (t = 0; t < THREADS.size(); t++)
+    {
+        const ThreadProfile& thread = *THREADS[t];
+        bool first = true;
+        fprintf(out, "%s\n {\"thread\":%d,\"phases\":{", t == 0 ? "" : ",", thread.thread);
+        for (s = 0; s < thread.phases.size(); s++)
+        {
+            if (thread.phases[s].calls == 0)
+                continue;
+            fprintf(out, "%s\"%s\":{\"seconds\":%.6f,\"calls\":%ld", first ? "" : ",",
+                    SITES[s].c_str(), thread.phases[s].seconds, thread.phases[s].calls);
+            for (k = 0; counters && k < PROFILE_COUNTERS; k++)
+                fprintf(out, ",\"%s\":%lld", COUNTER_NAMES[k], thread.phases[s].counters[k]);
+            fprintf(out, "}");
+            first = false;
+        }
+        fprintf(out, "}}");
+    }
+    fprintf(out, "]}\n");
+    pthread_mutex_unlock(&REGISTRY);
+    if (out != stderr)
+        fclose(out);
+}
+
+#endif
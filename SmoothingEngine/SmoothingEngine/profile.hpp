@@ -0,0 +1,59 @@
+/***********************************************************************************
+ * profile.hpp written by Timothy Hennessy
+ *
+ * Description: Hot-path instrumentation.  PROFILE_SCOPE("phase") times the
+ * rest of the enclosing block on the monotonic clock and adds it to that
+ * phase of the calling thread.  PROFILE_REPORT(program) writes a JSON
+ * report of every phase per thread, with the load imbalance (slowest
+ * thread over mean thread) of every phase run by several threads.
+ *
+ * Everything compiles to nothing unless SMOOTH_PROFILE is defined, e.g.
+ * with -DSMOOTH_PROFILE, so release builds pay no cost at all.
+ *
+ * At run time:
+ * - SMOOTH_PROFILE_OUT=path writes the report to path instead of stderr.
+ * - SMOOTH_PERF=1 also counts cycles, instructions and last level cache
+ *   misses per phase with perf_event_open (Linux only).  Each scope then
+ *   costs two system calls, so keep it for coarse phases.
+ *
+ * Phases nest, a phase includes the time of the phases inside it.
+ *********************************************************************************/
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#ifdef SMOOTH_PROFILE
+
+#define PROFILE_COUNTERS 3      // cycles, instructions, LLC misses
+
+int profileSite(const char *name);
+void profileReport(const char *program);
+
+/******************************* ProfileScope *****************************
+ * Timer of one PROFILE_SCOPE, adds its lifetime to site on destruction.
+ **************************************************************************/
+class ProfileScope
+{
+public:
+    ProfileScope(int site);
+    ~ProfileScope();
+private:
+    int site;
+    double start;
+    long long counters[PROFILE_COUNTERS];
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(name) \
+    static const int PROFILE_JOIN(profileSite_, __LINE__) = profileSite(name); \
+    ProfileScope PROFILE_JOIN(profileScope_, __LINE__)(PROFILE_JOIN(profileSite_, __LINE__))
+#define PROFILE_REPORT(program) profileReport(program)
+
+#else
+
+#define PROFILE_SCOPE(name) do { } while (0)
+#define PROFILE_REPORT(program) do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,316 @@
+/***********************************************************************************
+ * rawImage.cpp written by Timothy Hennessy
+ *
+ * Description: Memory-mapped .bgr image format.
+ *
+ * Header layout, native byte order:
+ *   char magic[8]    "BGRRAW1" plus a terminating zero
+ *   int32 rows, cols, type (OpenCV type, e.g. CV_8UC3)
+ *   zero padding to 64 bytes so pixel rows start cache-line aligned
+ *********************************************************************************/
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rawImage.hpp"
+#include "profile.hpp"
+using namespace cv;
+using namespace std;
+
+#define RAW_HEADER_BYTES 64
+static const char RAW_MAGIC[8] = "BGRRAW1";
+
+struct RawImageHeader
+{
+    char magic[8];
+    int rows, cols, type;
+};
+
+/****************************** validRawType ******************************
+ * Description: True if type is one the engine reads and writes, 8U, 16U
+ * or 32F with 1 to 4 channels, with no other bits set.  Guards against a
+ * corrupt header reaching CV_ELEM_SIZE and the Mat constructor.
+ **************************************************************************/
+static bool validRawType(int type)
+{
+    int depth = CV_MAT_DEPTH(type), cn = CV_MAT_CN(type);
+    return type == CV_MAKETYPE(depth, cn) && cn >= 1 && cn <= 4
+        && (depth == CV_8U || depth == CV_16U || depth == CV_32F);
+}
+
+MappedImage::MappedImage() : base(NULL), length(0)
+{
+}
+
+MappedImage::~MappedImage()
+{
+    release();
+}
+
+/************************** MappedImage::commit ***************************
+ * bool MappedImage::commit()
+ *
+ * Description: Renames the file created by createMappedImage over its
+ * target path.  The mapping stays valid, later writes still reach the
+ * file.  Writes to a shared mapping reach the file through the page
+ * cache, no explicit flush is needed.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * bool          value       False if the rename failed, or the image was
+ *                           not created by createMappedImage or already
+ *                           committed.
+ **************************************************************************/
+bool MappedImage::commit()
+{
+    if (tempPath.empty() || rename(tempPath.c_str(), targetPath.c_str()) != 0)
+        return false;
+    tempPath.clear();
+    return true;
+}
+
+/************************** MappedImage::release **************************
+ * Description: Drops mat and unmaps the file.  A created file that was
+ * never committed is deleted.
+ **************************************************************************/
+void MappedImage::release()
+{
+    mat.release();
+    if (base)
+        munmap(base, length);
+    if (!tempPath.empty())
+        unlink(tempPath.c_str());
+    base = NULL;
+    length = 0;
+    tempPath.clear();
+    targetPath.clear();
+}
+
+bool isRawImagePath(const string& path)
+{
+    size_t n = strlen(RAW_IMAGE_EXTENSION);
+    return path.size() >= n && path.compare(path.size() - n, n, RAW_IMAGE_EXTENSION) == 0;
+}
+
+/******************************* hasImageExtension ************************
+ * bool hasImageExtension(const string& name)
+ *
+ * Description: True if name ends, in any case, in an extension readImage
+ * understands.  Used to pick the images out of an input directory.
+ **************************************************************************/
+bool hasImageExtension(const string& name)
+{
+    static const char *extensions[] = { ".jpg", ".jpeg", ".png", ".ppm", ".pgm", ".bmp", ".tif",
+                                        ".tiff", RAW_IMAGE_EXTENSION };
+    size_t dot = name.find_last_of('.');
+    size_t e;
+    if (dot == string::npos)
+        return false;
+    string ext = name.substr(dot);
+    for (e = 0; e < ext.size(); e++)
+        ext[e] = (char) tolower(ext[e]);
+    for (e = 0; e < sizeof(extensions) / sizeof(extensions[0]); e++)
+        if (ext == extensions[e])
+            return true;
+    return false;
+}
+
+/******************************** mapImage ********************************
+ * bool mapImage(const string& path, MappedImage& image)
+ *
+ * Description: Maps an existing .bgr file.  The mapping is private and
+ * writable: engines may use image.mat as a ping-pong buffer, pages are
+ * copied on first write and the file itself is never modified.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * bool          value       False if the file is missing or malformed.
+ *
+ * NOTES:
+ * - The header is untrusted: the type must pass validRawType and the
+ *   pixel count is checked against the file size by division, so no
+ *   product of header fields can overflow.
+ **************************************************************************/
+bool mapImage(const string& path, MappedImage& image)
+{
+    RawImageHeader header;
+    struct stat info;
+    int fd = open(path.c_str(), O_RDONLY);
+    image.release();
+    if (fd < 0)
+        return false;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < RAW_HEADER_BYTES
+        || pread(fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)
+        || memcmp(header.magic, RAW_MAGIC, sizeof(RAW_MAGIC)) != 0
+        || header.rows <= 0 || header.cols <= 0 || !validRawType(header.type)
+        || (size_t) header.rows * header.cols
+           > ((size_t) info.st_size - RAW_HEADER_BYTES) / CV_ELEM_SIZE(header.type))
+    {
+        close(fd);
+        return false;
+    }
+    image.length = (size_t) info.st_size;
+    image.base = mmap(NULL, image.length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image.base == MAP_FAILED)
+    {
+        image.base = NULL;
+        return false;
+    }
+    image.mat = Mat(header.rows, header.cols, header.type, (uchar *) image.base + RAW_HEADER_BYTES);
+    return true;
+}
+
+/**************************** createMappedImage ***************************
+ * bool createMappedImage(const string& path, int rows, int cols,
+ *                        int type, MappedImage& image)
+ *
+ * Description: Creates a .bgr file of the given size and maps it shared,
+ * so pixels written to image.mat land in the file without an imwrite.
+ *
+ * Process:
+ * 1.) Create the file under a temporary dot-name in the directory of
+ *     path, the same way ResultCache::store does.
+ * 2.) Size it, map it and write the header.
+ * 3.) Leave path itself alone until image.commit() renames the file.
+ *
+ * NOTES:
+ * - Truncating path in place would destroy an input mapped from the same
+ *   file: its MAP_PRIVATE pages that were never touched read from the
+ *   file again.  The rename leaves the old file to that mapping.
+ **************************************************************************/
+bool createMappedImage(const string& path, int rows, int cols, int type,
+                       MappedImage& image)
+{
+    RawImageHeader header;
+    size_t length = RAW_HEADER_BYTES + (size_t) rows * cols * CV_ELEM_SIZE(type);
+    size_t slash = path.find_last_of('/');
+    char temp[32];
+    int fd;
+    image.release();
+    sprintf(temp, ".%d_%lx_", (int) getpid(), (unsigned long) pthread_self());
+    if (slash == string::npos)
+        image.tempPath = temp + path;
+    else
+        image.tempPath = path.substr(0, slash + 1) + temp + path.substr(slash + 1);
+    image.targetPath = path;
+    fd = open(image.tempPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        image.tempPath.clear();
+        return false;
+    }
+    if (ftruncate(fd, (off_t) length) != 0)
+    {
+        close(fd);
+        image.release();
+        return false;
+    }
+    image.base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image.base == MAP_FAILED)
+    {
+        image.base = NULL;
+        image.release();
+        return false;
+    }
+    image.length = length;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RAW_MAGIC, sizeof(RAW_MAGIC));
+    header.rows = rows;
+    header.cols = cols;
+    header.type = type;
+    memcpy(image.base, &header, sizeof(header));
+    image.mat = Mat(rows, cols, type, (uchar *) image.base + RAW_HEADER_BYTES);
+    return true;
+}
+
+/****************************** convertRawImage ***************************
+ * Mat convertRawImage(const Mat& image, int depth, int cn)
+ *
+ * Description: Copies image into a new Mat of depth and cn channels.
+ * Channels go through cvtColor, 16U becomes 8U scaled by 1/256 like
+ * imread does for 16-bit files, 32F is saturated to 8U unscaled.
+ **************************************************************************/
+static Mat convertRawImage(const Mat& image, int depth, int cn)
+{
+    Mat colored, converted;
+    int code = -1;
+    if (image.channels() == cn)
+        colored = image;
+    else
+    {
+        if (image.channels() == 1 && cn == 3)
+            code = COLOR_GRAY2BGR;
+        else if (image.channels() == 4 && cn == 3)
+            code = COLOR_BGRA2BGR;
+        else if (image.channels() == 3 && cn == 1)
+            code = COLOR_BGR2GRAY;
+        else if (image.channels() == 4 && cn == 1)
+            code = COLOR_BGRA2GRAY;
+        else
+            return Mat();
+        cvtColor(image, colored, code);
+    }
+    if (colored.depth() == depth)
+        return colored;
+    colored.convertTo(converted, depth, colored.depth() == CV_16U ? 1.0 / 256 : 1.0);
+    return converted;
+}
+
+/******************************** readImage *******************************
+ * Mat readImage(const string& path, MappedImage& mapping, int flags)
+ *
+ * Description: Reads path the way imread(path, flags) would.  A .bgr file
+ * is mapped into mapping and returned in place when its stored type is
+ * what flags asks for (always with IMREAD_UNCHANGED), and otherwise
+ * converted into a new Mat and unmapped.  Any other format is decoded
+ * with imread.  flags 1, the default, gives 8-bit BGR.  Returns an empty
+ * Mat on failure, like imread.
+ **************************************************************************/
+Mat readImage(const string& path, MappedImage& mapping, int flags)
+{
+    Mat converted;
+    int depth, cn;
+    PROFILE_SCOPE("read");
+    if (!isRawImagePath(path))
+        return imread(path, flags);
+    if (!mapImage(path, mapping))
+        return Mat();
+    if (flags == IMREAD_UNCHANGED)
+        return mapping.mat;
+    depth = flags & IMREAD_ANYDEPTH ? mapping.mat.depth() : CV_8U;
+    if (flags & IMREAD_ANYCOLOR)
+        cn = mapping.mat.channels();
+    else
+        cn = flags & IMREAD_COLOR ? 3 : 1;
+    if (mapping.mat.type() == CV_MAKETYPE(depth, cn))
+        return mapping.mat;
+    converted = convertRawImage(mapping.mat, depth, cn);
+    mapping.release();
+    return converted;
+}
+
+/******************************* writeImage *******************************
+ * bool writeImage(const string& path, const Mat& image)
+ *
+ * Description: Writes a .bgr file with one copy of the rows into a fresh
+ * mapping and commits it, or encodes any other format with imwrite.
+ **************************************************************************/
+bool writeImage(const string& path, const Mat& image)
+{
+    MappedImage out;
+    int r;
+    PROFILE_SCOPE("write");
+    if (!isRawImagePath(path))
+        return imwrite(path, image);
+    if (!createMappedImage(path, image.rows, image.cols, image.type(), out))
+        return false;
+    for (r = 0; r < image.rows; r++)
+        memcpy(out.mat.ptr(r), image.ptr(r), image.cols * image.elemSize());
+    return out.commit();
+}
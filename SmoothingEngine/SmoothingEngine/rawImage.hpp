@@ -0,0 +1,60 @@
+/***********************************************************************************
+ * rawImage.hpp written by Timothy Hennessy
+ *
+ * Description: Native uncompressed image format read and written through
+ * mmap.  A .bgr file is a 64-byte header followed by the pixels exactly as
+ * a continuous cv::Mat stores them (interleaved BGR for color images), so
+ * a mapped file can be wrapped in a Mat header and smoothed in place with
+ * no decode, no encode and no copy.  Being lossless, it is also the format
+ * to use for intermediates that CompareImages must verify.
+ *
+ * readImage and writeImage pick the format from the file extension:
+ * .bgr goes through mmap, anything else through imread/imwrite.  Like
+ * imread, readImage returns the type its flags ask for, so a .bgr file is
+ * only used in place when it already holds that type.
+ *
+ * A new .bgr file is built under a temporary name next to its target and
+ * only renamed over it by commit, so the output may be the very file the
+ * input is mapped from: the input mapping keeps the old file alive.
+ *********************************************************************************/
+#ifndef RAW_IMAGE_HPP
+#define RAW_IMAGE_HPP
+#include <string>
+#include <opencv2/opencv.hpp>
+
+#define RAW_IMAGE_EXTENSION ".bgr"
+
+/****************************** MappedImage *******************************
+ * Owns one mapping of a .bgr file.  mat points into the mapping, so it
+ * must not be used after the MappedImage is released or destroyed.  An
+ * image from createMappedImage reaches its path only through commit,
+ * releasing it uncommitted deletes the temporary file.
+ **************************************************************************/
+class MappedImage
+{
+public:
+    MappedImage();
+    ~MappedImage();
+    bool commit();
+    void release();
+    cv::Mat mat;
+private:
+    MappedImage(const MappedImage&);
+    MappedImage& operator=(const MappedImage&);
+    friend bool mapImage(const std::string&, MappedImage&);
+    friend bool createMappedImage(const std::string&, int, int, int, MappedImage&);
+    void *base;
+    size_t length;
+    std::string tempPath;       // created file not yet renamed to targetPath
+    std::string targetPath;
+};
+
+bool isRawImagePath(const std::string& path);
+bool hasImageExtension(const std::string& name);
+bool mapImage(const std::string& path, MappedImage& image);
+bool createMappedImage(const std::string& path, int rows, int cols, int type,
+                       MappedImage& image);
+cv::Mat readImage(const std::string& path, MappedImage& mapping, int flags = 1);
+bool writeImage(const std::string& path, const cv::Mat& image);
+
+#endif
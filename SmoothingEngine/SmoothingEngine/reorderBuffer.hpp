@@ -0,0 +1,100 @@
+/***********************************************************************************
+ * reorderBuffer.hpp written by Timothy Hennessy
+ *
+ * Description: Puts items finished out of order by parallel workers back
+ * into sequence order, e.g. video frames before they are encoded.  Holds
+ * at most capacity items: a worker that finishes an item too far ahead of
+ * the next one to be taken blocks until the consumer catches up, so memory
+ * and the latency of every item stay bounded.
+ *
+ * Items must be numbered 0, 1, 2, ... without gaps, and every number must
+ * eventually be put (put an empty item for a failure), or the consumer
+ * waits forever for the gap.
+ *********************************************************************************/
+#ifndef REORDER_BUFFER_HPP
+#define REORDER_BUFFER_HPP
+#include <pthread.h>
+#include <map>
+
+template <typename T>
+class ReorderBuffer
+{
+public:
+    ReorderBuffer(int capacity) : capacity(capacity < 1 ? 1 : capacity), next(0), end(-1)
+    {
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&changed, NULL);
+    }
+
+    ~ReorderBuffer()
+    {
+        pthread_cond_destroy(&changed);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    /************************** ReorderBuffer::put ************************
+     * void put(long index, const T& item)
+     *
+     * Description: Stores item number index, blocking while index is
+     * capacity or more items ahead of the next one to be taken.  The item
+     * the consumer waits for is never blocked, so this cannot deadlock.
+     **********************************************************************/
+    void put(long index, const T& item)
+    {
+        pthread_mutex_lock(&mutex);
+        while (index >= next + capacity)
+            pthread_cond_wait(&changed, &mutex);
+        items[index] = item;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    /************************* ReorderBuffer::take ************************
+     * bool take(T& item)
+     *
+     * Description: Removes the next item in sequence, blocking until it
+     * has been put.  Returns false once all count items given to close
+     * have been taken.
+     **********************************************************************/
+    bool take(T& item)
+    {
+        typename std::map<long, T>::iterator found;
+        pthread_mutex_lock(&mutex);
+        while ((found = items.find(next)) == items.end() && next != end)
+            pthread_cond_wait(&changed, &mutex);
+        if (found == items.end())
+        {
+            pthread_mutex_unlock(&mutex);
+            return false;
+        }
+        item = found->second;
+        items.erase(found);
+        next++;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mutex);
+        return true;
+    }
+
+    /************************ ReorderBuffer::close ************************
+     * void close(long count)
+     *
+     * Description: count items will be put in total.
+     **********************************************************************/
+    void close(long count)
+    {
+        pthread_mutex_lock(&mutex);
+        end = count;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mutex);
+    }
+
+private:
+    std::map<long, T> items;
+    int capacity;
+    long next;                  // index take returns next
+    long end;                   // total item count, -1 until closed
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+};
+
+#endif
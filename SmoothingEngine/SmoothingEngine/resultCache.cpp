@@ -0,0 +1,228 @@
+/***********************************************************************************
+ * resultCache.cpp written by Timothy Hennessy
+ *
+ * Description: Content-addressed on-disk result cache with LRU eviction.
+ *
+ * NOTES:
+ * - Entries are written under a temporary dot-name and renamed into
+ *   place, so a reader (in this or another process) never maps a half
+ *   written file and concurrent writers of the same entry are harmless.
+ * - Files that disappear between listing and use (evicted by another
+ *   process) are treated as misses.
+ *********************************************************************************/
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "resultCache.hpp"
+using namespace cv;
+using namespace std;
+
+#define HASH_PRIME1 11400714785074694791ULL
+#define HASH_PRIME2 14029467366897019727ULL
+#define HASH_PRIME3 1609587929392839161ULL
+
+static inline unsigned long long rotl(unsigned long long x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline unsigned long long hashRound(unsigned long long acc, unsigned long long input)
+{
+    return rotl(acc + input * HASH_PRIME2, 31) * HASH_PRIME1;
+}
+
+/******************************** pixelHash *******************************
+ * unsigned long long pixelHash(const Mat& image)
+ *
+ * Description: 64-bit hash of the size, type and pixels of image.  Four
+ * independent lanes consume 32 bytes per step (the xxHash64 round), so
+ * hashing runs at memory speed rather than a byte at a time.
+ *
+ * NOTES:
+ * - Row padding of non-continuous Mats is skipped, a view hashes the same
+ *   as its clone.
+ **************************************************************************/
+unsigned long long pixelHash(const Mat& image)
+{
+    unsigned long long lanes[4], word, h;
+    size_t rowBytes = image.cols * image.elemSize(), x;
+    int r, k;
+    lanes[0] = HASH_PRIME1 + HASH_PRIME2;
+    lanes[1] = HASH_PRIME2;
+    lanes[2] = (unsigned long long) image.rows * HASH_PRIME3;
+    lanes[3] = ((unsigned long long) image.cols << 32 | (unsigned int) image.type()) * HASH_PRIME1;
+    for (r = 0; r < image.rows; r++)
+    {
+        const uchar *row = image.ptr(r);
+        for (x = 0; x + 32 <= rowBytes; x += 32)
+        {
+            for (k = 0; k < 4; k++)
+            {
+                memcpy(&word, row + x + 8 * k, 8);
+                lanes[k] = hashRound(lanes[k], word);
+            }
+        }
+        for (; x < rowBytes; x++)
+            lanes[x % 4] = hashRound(lanes[x % 4], row[x]);
+    }
+    h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+    for (k = 0; k < 4; k++)
+        h = (h ^ hashRound(0, lanes[k])) * HASH_PRIME1 + HASH_PRIME3;
+    h ^= h >> 33;
+    h *= HASH_PRIME2;
+    h ^= h >> 29;
+    h *= HASH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+ResultCache::ResultCache(const string& directory, size_t maxBytes)
+    : directory(directory), maxBytes(maxBytes)
+{
+    pthread_mutex_init(&mutex, NULL);
+}
+
+ResultCache::~ResultCache()
+{
+    pthread_mutex_destroy(&mutex);
+}
+
+string ResultCache::entryPrefix(unsigned long long hash, const string& engine, int radius) const
+{
+    char key[64];
+    sprintf(key, "%016llx_", hash);
+    return key + engine + "_r" + to_string(radius) + "_n";
+}
+
+/*************************** ResultCache::lookup **************************
+ * bool ResultCache::lookup(unsigned long long hash, const string& engine,
+ *                          int radius, int iterations,
+ *                          int& cachedIterations, MappedImage& mapping)
+ *
+ * Description: Finds the entry for (hash, engine, radius) with the most
+ * iterations <= iterations and maps it.
+ *
+ * Process:
+ * 1.) Scan the directory for names with this key's prefix.
+ * 2.) Map the best candidate, falling back to the next best if it was
+ *     evicted in the meantime.
+ * 3.) Touch the entry so eviction sees it as recently used.
+ *
+ * Parameter        Direction   Description
+ * ------------------------------------------------------------------------
+ * hash             in          pixelHash of the input image.
+ * engine           in          engine name, part of the key.
+ * radius           in          neighborhood radius, part of the key.
+ * iterations       in          iterations requested.
+ * cachedIterations out         iterations of the entry found.
+ * mapping          out         private (writable) mapping of the entry.
+ *
+ * Returns          Method      Description
+ * ------------------------------------------------------------------------
+ * bool             value       False if no usable entry exists.
+ **************************************************************************/
+bool ResultCache::lookup(unsigned long long hash, const string& engine, int radius,
+                         int iterations, int& cachedIterations, MappedImage& mapping)
+{
+    string prefix = entryPrefix(hash, engine, radius), name, path;
+    vector<int> found;
+    DIR *dir = opendir(directory.c_str());
+    struct dirent *entry;
+    char rest[16];
+    int n;
+    size_t i;
+    if (dir == NULL)
+        return false;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        name = entry->d_name;
+        if (name.compare(0, prefix.size(), prefix) == 0
+            && sscanf(name.c_str() + prefix.size(), "%d%15s", &n, rest) == 2
+            && strcmp(rest, RAW_IMAGE_EXTENSION) == 0 && n <= iterations)
+            found.push_back(n);
+    }
+    closedir(dir);
+
+    sort(found.begin(), found.end());
+    for (i = found.size(); i-- > 0;)
+    {
+        path = directory + "/" + prefix + to_string(found[i]) + RAW_IMAGE_EXTENSION;
+        if (mapImage(path, mapping))
+        {
+            utimes(path.c_str(), NULL);
+            cachedIterations = found[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**************************** ResultCache::store **************************
+ * bool ResultCache::store(unsigned long long hash, const string& engine,
+ *                         int radius, int iterations, const Mat& image)
+ *
+ * Description: Writes image as the entry for (hash, engine, radius,
+ * iterations), then evicts old entries if the cache is over its limit.
+ * The cache directory is created on first use.
+ **************************************************************************/
+bool ResultCache::store(unsigned long long hash, const string& engine, int radius,
+                        int iterations, const Mat& image)
+{
+    string name = entryPrefix(hash, engine, radius) + to_string(iterations) + RAW_IMAGE_EXTENSION;
+    string path = directory + "/" + name;
+    char temp[32];
+    sprintf(temp, "/.%d_%lx_", (int) getpid(), (unsigned long) pthread_self());
+    string tempPath = directory + temp + name;
+    mkdir(directory.c_str(), 0755);
+    if (!writeImage(tempPath, image) || rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        unlink(tempPath.c_str());
+        return false;
+    }
+    evict();
+    return true;
+}
+
+/**************************** ResultCache::evict **************************
+ * void ResultCache::evict()
+ *
+ * Description: Deletes entries, least recently used first, until the
+ * entries in the directory add up to at most maxBytes.
+ **************************************************************************/
+void ResultCache::evict()
+{
+    vector<pair<time_t, pair<string, size_t> > > entries;   // (mtime, (path, bytes))
+    size_t total = 0, i;
+    struct dirent *entry;
+    struct stat info;
+    string path;
+    DIR *dir;
+
+    pthread_mutex_lock(&mutex);
+    if ((dir = opendir(directory.c_str())) != NULL)
+    {
+        while ((entry = readdir(dir)) != NULL)
+        {
+            path = directory + "/" + entry->d_name;
+            if (entry->d_name[0] == '.' || !isRawImagePath(path)
+                || stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+                continue;
+            entries.push_back(make_pair(info.st_mtime, make_pair(path, (size_t) info.st_size)));
+            total += info.st_size;
+        }
+        closedir(dir);
+    }
+    sort(entries.begin(), entries.end());
+    for (i = 0; i < entries.size() && total > maxBytes; i++)
+    {
+        unlink(entries[i].second.first.c_str());
+        total -= entries[i].second.second;
+    }
+    pthread_mutex_unlock(&mutex);
+}
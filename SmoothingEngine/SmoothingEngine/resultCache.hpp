@@ -0,0 +1,48 @@
+/***********************************************************************************
+ * resultCache.hpp written by Timothy Hennessy
+ *
+ * Description: Persistent, content-addressed cache of smoothing results.
+ * An entry is keyed by a hash of the decoded input pixels plus (engine,
+ * radius, iterations), so renaming or re-encoding a file does not matter,
+ * only what it decodes to.
+ *
+ * Besides final results, runs store checkpoints every few iterations.  A
+ * lookup returns the entry with the most iterations not above the request,
+ * so n = 300 resumes from a cached n = 250 and runs only 50 more passes.
+ *
+ * Entries are .bgr files (see rawImage.hpp) named
+ *     <hash>_<engine>_r<radius>_n<iterations>.bgr
+ * in one directory and are read back through mmap.  The directory is
+ * kept under a size limit by deleting the least recently used entries,
+ * with the file modification time as the use time.
+ *********************************************************************************/
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+#include <pthread.h>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "rawImage.hpp"
+
+unsigned long long pixelHash(const cv::Mat& image);
+
+class ResultCache
+{
+public:
+    ResultCache(const std::string& directory, size_t maxBytes);
+    ~ResultCache();
+    bool lookup(unsigned long long hash, const std::string& engine, int radius,
+                int iterations, int& cachedIterations, MappedImage& mapping);
+    bool store(unsigned long long hash, const std::string& engine, int radius,
+               int iterations, const cv::Mat& image);
+    void evict();
+private:
+    ResultCache(const ResultCache&);
+    ResultCache& operator=(const ResultCache&);
+    std::string entryPrefix(unsigned long long hash, const std::string& engine, int radius) const;
+
+    std::string directory;
+    size_t maxBytes;
+    pthread_mutex_t mutex;          // serializes eviction between threads
+};
+
+#endif
@@ -0,0 +1,286 @@
+/***********************************************************************************
+ * simdAverage.cpp written by Timothy Hennessy
+ *
+ * Description: Vectorized 3x3 neighborhood average with runtime CPU
+ * dispatch.
+ *
+ * Only interior columns are vectorized.  There every window is 3 pixels
+ * wide, so a row of output needs the same rows loaded at byte offsets -cn,
+ * 0 and +cn and the channel layout never matters.  The first and last
+ * column, and images too small to have interior columns, use the scalar
+ * per pixel path.
+ *
+ * NOTES:
+ * - Reciprocals are ceil(65536 / d).  (x * ceil(65536 / d)) >> 16 equals
+ *   x / d for all x <= 255 * d and d in {2, 3, 4, 6, 9}, checked
+ *   exhaustively.
+ * - ISA specific kernels are compiled with target attributes, so no
+ *   global -mavx2 style flags are needed and the binary still runs on
+ *   CPUs without them.
+ *********************************************************************************/
+#include <cstdlib>
+#include <cstring>
+#include "simdAverage.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+using namespace cv;
+using namespace std;
+
+typedef void (*RowKernel)(const uchar *const rows[], int numRows, uchar *out,
+                          int begin, int end, int cn);
+
+static inline unsigned short reciprocal(int divisor)
+{
+    return (unsigned short) ((65536 + divisor - 1) / divisor);
+}
+
+/******************************** rowScalar *******************************
+ * static void rowScalar(const uchar *const rows[], int numRows,
+ *                       uchar *out, int begin, int end, int cn)
+ *
+ * Description: Averages interior bytes [begin, end) of one output row
+ * over numRows (2 or 3) source rows and 3 columns.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * rows          in          The numRows source rows in the window.
+ * numRows       in          Rows inside the image, 3 or 2 at the border.
+ * out           out         Output row.
+ * begin         in          First byte to produce, >= cn.
+ * end           in          One past last byte, <= (cols - 1) * cn.
+ * cn            in          Channels per pixel, the horizontal stride.
+ **************************************************************************/
+static void rowScalar(const uchar *const rows[], int numRows, uchar *out,
+                      int begin, int end, int cn)
+{
+    unsigned int m = reciprocal(3 * numRows);
+    unsigned int sum;
+    int x, k;
+    for (x = begin; x < end; x++)
+    {
+        sum = 0;
+        for (k = 0; k < numRows; k++)
+            sum += rows[k][x - cn] + rows[k][x] + rows[k][x + cn];
+        out[x] = (uchar) ((sum * m) >> 16);
+    }
+}
+
+#ifdef SIMD_X86
+static void rowSse2(const uchar *const rows[], int numRows, uchar *out,
+                    int begin, int end, int cn)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i m = _mm_set1_epi16((short) reciprocal(3 * numRows));
+    int x, k;
+    for (x = begin; x + 16 <= end; x += 16)
+    {
+        __m128i lo = zero, hi = zero;
+        for (k = 0; k < numRows; k++)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *) (rows[k] + x - cn));
+            __m128i b = _mm_loadu_si128((const __m128i *) (rows[k] + x));
+            __m128i c = _mm_loadu_si128((const __m128i *) (rows[k] + x + cn));
+            lo = _mm_add_epi16(lo, _mm_add_epi16(_mm_unpacklo_epi8(a, zero),
+                 _mm_add_epi16(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero))));
+            hi = _mm_add_epi16(hi, _mm_add_epi16(_mm_unpackhi_epi8(a, zero),
+                 _mm_add_epi16(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero))));
+        }
+        lo = _mm_mulhi_epu16(lo, m);
+        hi = _mm_mulhi_epu16(hi, m);
+        _mm_storeu_si128((__m128i *) (out + x), _mm_packus_epi16(lo, hi));
+    }
+    rowScalar(rows, numRows, out, x, end, cn);
+}
+
+// Unpack and pack both work within 128-bit lanes, so lane order survives
+__attribute__((target("avx2")))
+static void rowAvx2(const uchar *const rows[], int numRows, uchar *out,
+                    int begin, int end, int cn)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i m = _mm256_set1_epi16((short) reciprocal(3 * numRows));
+    int x, k;
+    for (x = begin; x + 32 <= end; x += 32)
+    {
+        __m256i lo = zero, hi = zero;
+        for (k = 0; k < numRows; k++)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i *) (rows[k] + x - cn));
+            __m256i b = _mm256_loadu_si256((const __m256i *) (rows[k] + x));
+            __m256i c = _mm256_loadu_si256((const __m256i *) (rows[k] + x + cn));
+            lo = _mm256_add_epi16(lo, _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero),
+                 _mm256_add_epi16(_mm256_unpacklo_epi8(b, zero), _mm256_unpacklo_epi8(c, zero))));
+            hi = _mm256_add_epi16(hi, _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero),
+                 _mm256_add_epi16(_mm256_unpackhi_epi8(b, zero), _mm256_unpackhi_epi8(c, zero))));
+        }
+        lo = _mm256_mulhi_epu16(lo, m);
+        hi = _mm256_mulhi_epu16(hi, m);
+        _mm256_storeu_si256((__m256i *) (out + x), _mm256_packus_epi16(lo, hi));
+    }
+    rowSse2(rows, numRows, out, x, end, cn);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void rowAvx512(const uchar *const rows[], int numRows, uchar *out,
+                      int begin, int end, int cn)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i m = _mm512_set1_epi16((short) reciprocal(3 * numRows));
+    int x, k;
+    for (x = begin; x + 64 <= end; x += 64)
+    {
+        __m512i lo = zero, hi = zero;
+        for (k = 0; k < numRows; k++)
+        {
+            __m512i a = _mm512_loadu_si512((const void *) (rows[k] + x - cn));
+            __m512i b = _mm512_loadu_si512((const void *) (rows[k] + x));
+            __m512i c = _mm512_loadu_si512((const void *) (rows[k] + x + cn));
+            lo = _mm512_add_epi16(lo, _mm512_add_epi16(_mm512_unpacklo_epi8(a, zero),
+                 _mm512_add_epi16(_mm512_unpacklo_epi8(b, zero), _mm512_unpacklo_epi8(c, zero))));
+            hi = _mm512_add_epi16(hi, _mm512_add_epi16(_mm512_unpackhi_epi8(a, zero),
+                 _mm512_add_epi16(_mm512_unpackhi_epi8(b, zero), _mm512_unpackhi_epi8(c, zero))));
+        }
+        lo = _mm512_mulhi_epu16(lo, m);
+        hi = _mm512_mulhi_epu16(hi, m);
+        _mm512_storeu_si512((void *) (out + x), _mm512_packus_epi16(lo, hi));
+    }
+    rowAvx2(rows, numRows, out, x, end, cn);
+}
+#endif
+
+/****************************** detectSimdLevel ***************************
+ * static SimdLevel detectSimdLevel()
+ *
+ * Description: Widest kernel supported by this CPU, capped by the
+ * SMOOTH_SIMD environment variable when it is set.
+ **************************************************************************/
+static SimdLevel detectSimdLevel()
+{
+    SimdLevel level = SIMD_SCALAR;
+    const char *cap = getenv("SMOOTH_SIMD");
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        level = SIMD_SSE2;
+    if (__builtin_cpu_supports("avx2"))
+        level = SIMD_AVX2;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        level = SIMD_AVX512;
+#endif
+    if (cap)
+    {
+        int c;
+        for (c = SIMD_SCALAR; c <= SIMD_AVX512; c++)
+            if (strcmp(cap, simdLevelName((SimdLevel) c)) == 0 && c < level)
+                level = (SimdLevel) c;
+    }
+    return level;
+}
+
+SimdLevel simdLevel()
+{
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+const char *simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+        case SIMD_SSE2:   return "sse2";
+        case SIMD_AVX2:   return "avx2";
+        case SIMD_AVX512: return "avx512";
+        default:          return "scalar";
+    }
+}
+
+static RowKernel selectRowKernel()
+{
+#ifdef SIMD_X86
+    switch (simdLevel())
+    {
+        case SIMD_SSE2:   return rowSse2;
+        case SIMD_AVX2:   return rowAvx2;
+        case SIMD_AVX512: return rowAvx512;
+        default:          break;
+    }
+#endif
+    return rowScalar;
+}
+
+/******************************* averagePixel ****************************
+ * static void averagePixel(const Mat& src, Mat& dst, int r, int c)
+ *
+ * Description: Scalar 3x3 average of one pixel with border clipping, the
+ * same computation as the original neighborhoodAverage.
+ **************************************************************************/
+static void averagePixel(const Mat& src, Mat& dst, int r, int c)
+{
+    int cn = src.channels();
+    int startRow = max(r - 1, 0), endRow = min(r + 1, src.rows - 1);
+    int startCol = max(c - 1, 0), endCol = min(c + 1, src.cols - 1);
+    int count = (endRow - startRow + 1) * (endCol - startCol + 1);
+    int sum[4] = { 0, 0, 0, 0 };
+    int i, j, k;
+    for (i = startRow; i <= endRow; i++)
+    {
+        const uchar *row = src.ptr<uchar>(i);
+        for (j = startCol; j <= endCol; j++)
+            for (k = 0; k < cn; k++)
+                sum[k] += row[j * cn + k];
+    }
+    uchar *out = dst.ptr<uchar>(r) + c * cn;
+    for (k = 0; k < cn; k++)
+        out[k] = saturate_cast<uchar>(sum[k] / count);
+}
+
+/****************************** average3x3Rect ****************************
+ * void average3x3Rect(const Mat& src, Mat& dst, const Rect& outRect)
+ *
+ * Description: 3x3 neighborhood average of every pixel in outRect.
+ *
+ * Process:
+ * 1.) For every output row collect the 2 or 3 source rows in the window.
+ * 2.) Run the dispatched row kernel over the interior columns.
+ * 3.) Average the first and last column with the scalar path.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * src           in          8-bit image with 1 to 4 channels.
+ * dst           out         Preallocated image of same size and type.
+ *                           Must not alias src.
+ * outRect       in          Region of dst to compute.
+ **************************************************************************/
+void average3x3Rect(const Mat& src, Mat& dst, const Rect& outRect)
+{
+    static const RowKernel kernel = selectRowKernel();
+    CV_Assert(src.depth() == CV_8U && src.channels() <= 4);
+    CV_Assert(dst.size() == src.size() && dst.type() == src.type());
+    int cn = src.channels();
+    int startCol = outRect.x, endCol = outRect.x + outRect.width;
+    int interiorStart = max(startCol, 1), interiorEnd = min(endCol, src.cols - 1);
+    int r, c, numRows;
+    const uchar *rows[3];
+    for (r = outRect.y; r < outRect.y + outRect.height; r++)
+    {
+        numRows = 0;
+        if (r > 0)
+            rows[numRows++] = src.ptr<uchar>(r - 1);
+        rows[numRows++] = src.ptr<uchar>(r);
+        if (r < src.rows - 1)
+            rows[numRows++] = src.ptr<uchar>(r + 1);
+        if (numRows < 2 || interiorStart >= interiorEnd)
+        {
+            for (c = startCol; c < endCol; c++)
+                averagePixel(src, dst, r, c);
+            continue;
+        }
+        kernel(rows, numRows, dst.ptr<uchar>(r), interiorStart * cn, interiorEnd * cn, cn);
+        if (startCol == 0)
+            averagePixel(src, dst, r, 0);
+        if (endCol == src.cols)
+            averagePixel(src, dst, r, src.cols - 1);
+    }
+}
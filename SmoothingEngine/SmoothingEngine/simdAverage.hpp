@@ -0,0 +1,32 @@
+/***********************************************************************************
+ * simdAverage.hpp written by Timothy Hennessy
+ *
+ * Description: Vectorized 3x3 neighborhood average for interleaved 8-bit
+ * images (BGR or any other channel count).  Sums are widened to 16-bit
+ * lanes and the division by 6 or 9 is replaced by a multiply with a
+ * reciprocal that gives exactly the truncated quotient for every sum a
+ * window of 8-bit pixels can produce, so the output is byte for byte the
+ * same as neighborhoodAverage.
+ *
+ * The widest kernel the CPU supports (AVX-512BW, AVX2, SSE2) is picked
+ * once at startup from CPUID, with a scalar fallback.  Setting the
+ * environment variable SMOOTH_SIMD to scalar, sse2, avx2 or avx512 caps
+ * the choice, e.g. to check kernels against each other with CompareImages.
+ *********************************************************************************/
+#ifndef SIMD_AVERAGE_HPP
+#define SIMD_AVERAGE_HPP
+#include <opencv2/opencv.hpp>
+
+enum SimdLevel
+{
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_AVX512
+};
+
+SimdLevel simdLevel();
+const char *simdLevelName(SimdLevel level);
+void average3x3Rect(const cv::Mat& src, cv::Mat& dst, const cv::Rect& outRect);
+
+#endif
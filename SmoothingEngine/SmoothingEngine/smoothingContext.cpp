@@ -0,0 +1,138 @@
+/***********************************************************************************
+ * smoothingContext.cpp written by Timothy Hennessy
+ *
+ * Description: Reentrant smoothing context running tiles on a shared pool.
+ *********************************************************************************/
+#include "smoothingContext.hpp"
+#include "boxAverage.hpp"
+#include "profile.hpp"
+#include "typedAverage.hpp"
+using namespace cv;
+using namespace std;
+
+// Chunks queued per pool thread and pass, enough for the FIFO queue to
+// even out uneven tiles without paying per tile queueing cost.
+#define CHUNKS_PER_THREAD 4
+
+SmoothingContext::SmoothingContext(ThreadPool& pool, const SmoothParams& params)
+    : params(params), stableAfter(-1), pool(pool), src(NULL), dst(NULL), block(1), numTiles(0), numChunks(0)
+{
+}
+
+/************************ SmoothingContext::runChunk **********************
+ * void SmoothingContext::runChunk(void *p, int chunk)
+ *
+ * Description: Pool task.  Runs the current pass on tiles
+ * [numTiles * chunk / numChunks, numTiles * (chunk + 1) / numChunks).
+ **************************************************************************/
+void SmoothingContext::runChunk(void *p, int chunk)
+{
+    SmoothingContext *context = (SmoothingContext *) p;
+    const SmoothParams& params = context->params;
+    int first = (int) ((long) context->numTiles * chunk / context->numChunks);
+    int end = (int) ((long) context->numTiles * (chunk + 1) / context->numChunks);
+    int i;
+    if (context->block > 1)
+    {
+        smoothTiles(*context->src, *context->dst, params.radius, context->block,
+                    params.tiles, first, end, context->work[chunk]);
+        return;
+    }
+    if (params.sparse || params.untilStable)
+    {
+        for (i = first; i < end; i++)
+            context->tracker.run(*context->src, *context->dst, i, context->work[chunk].scratch);
+        return;
+    }
+    for (i = first; i < end; i++)
+        boxAverageRect(*context->src, *context->dst, params.radius,
+                       tileRect(context->src->size(), params.tiles, i), context->work[chunk].scratch);
+}
+
+/************************* SmoothingContext::smooth ***********************
+ * bool SmoothingContext::smooth(const Mat& input, Mat& output)
+ *
+ * Description: Runs params.iterations averaging operations on input and
+ * leaves the result in output.
+ *
+ * Process:
+ * 1.) Validate params and allocate output (a no-op if it already has the
+ *     right size and type, so output may be a view into a larger Mat).
+ * 2.) Ping-pong between output and spare, choosing the first destination
+ *     so that the last pass lands in output.
+ * 3.) Split every pass into chunks of tiles and run them with parallelFor.
+ * 4.) With params.sparse, skip stable tiles and record the first pass
+ *     that changed nothing in stableAfter.  With params.untilStable, end
+ *     there, the result is the same as running all iterations.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * input         in          8-bit image of any channel count, or 16U or
+ *                           32F with 1, 3 or 4 channels, not modified.
+ * output        out         smoothed image, must not share data with input.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * bool          value       False if input is empty or of another type, params
+ *                           are out of range or combine tiled with
+ *                           sparse, or output aliases input.
+ **************************************************************************/
+bool SmoothingContext::smooth(const Mat& input, Mat& output)
+{
+    int passes, pass, averageOps;
+    const Mat *in = &input;
+    Mat *out;
+    PROFILE_SCOPE("smooth");
+
+    if (input.empty() || params.radius < 1
+        || (input.depth() != CV_8U && selectAverageKernel(input.type(), params.radius) == NULL)
+        || params.iterations < 0 || params.tiles.tileRows < 1 || params.tiles.tileCols < 1
+        || (params.tiled && params.tiles.blockIters < 1)
+        || (params.tiled && (params.sparse || params.untilStable)))
+        return false;
+    output.create(input.size(), input.type());
+    if (output.data == input.data)
+        return false;
+    stableAfter = -1;
+    if (params.iterations == 0)
+    {
+        input.copyTo(output);
+        return true;
+    }
+    spare.create(input.size(), input.type());
+
+    block = params.tiled ? params.tiles.blockIters : 1;
+    passes = (params.iterations + block - 1) / block;
+    numTiles = tileCount(input.size(), params.tiles);
+    numChunks = min(numTiles, pool.size() * CHUNKS_PER_THREAD);
+    if ((int) work.size() < numChunks)
+        work.resize(numChunks);
+    if (params.sparse || params.untilStable)
+        tracker.reset(input.size(), params.tiles, params.radius);
+
+    for (pass = 0, averageOps = 0; pass < passes; pass++, averageOps += block)
+    {
+        out = (passes - 1 - pass) % 2 == 0 ? &output : &spare;
+        block = params.tiled ? min(params.tiles.blockIters, params.iterations - averageOps) : 1;
+        src = in;
+        dst = out;
+        pool.parallelFor(numChunks, runChunk, this);
+        in = out;
+
+        // A pass that changed nothing repeats forever
+        if ((params.sparse || params.untilStable) && tracker.endPass() == 0)
+        {
+            if (stableAfter < 0)
+                stableAfter = averageOps;
+            if (params.untilStable)
+            {
+                if (out != &output)
+                    out->copyTo(output);
+                break;
+            }
+        }
+    }
+    src = NULL;
+    dst = NULL;
+    return true;
+}
@@ -0,0 +1,68 @@
+/***********************************************************************************
+ * smoothingContext.hpp written by Timothy Hennessy
+ *
+ * Description: Reentrant in-process smoothing API.  All state of a run
+ * lives in a SmoothingContext instead of globals, so any number of images
+ * can be smoothed at the same time in one process, each through its own
+ * context, all sharing one ThreadPool.
+ *
+ * Every pass is split into tiles and handed to the pool with parallelFor,
+ * whose FIFO queue balances the load.  Unlike runTeam this never takes the
+ * pool exclusively, and since waiting callers help run queued tasks, a
+ * context may also be used from inside a pool task.
+ *
+ * Usage:
+ *     ThreadPool pool(hardwareThreads());      // once per process
+ *     SmoothingContext context(pool);          // one per concurrent caller
+ *     context.params.iterations = 20;
+ *     context.smooth(input, output);
+ *********************************************************************************/
+#ifndef SMOOTHING_CONTEXT_HPP
+#define SMOOTHING_CONTEXT_HPP
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "activeTiles.hpp"
+#include "temporalBlocking.hpp"
+#include "threadPool.hpp"
+
+struct SmoothParams
+{
+    int radius;          // neighborhood is (2 * radius + 1)^2
+    int iterations;      // averaging operations
+    bool tiled;          // run tiles.blockIters iterations per tile
+    TileConfig tiles;    // tile size, also the unit of parallel work
+    bool sparse;         // skip stable tiles (see activeTiles.hpp), not with tiled
+    bool untilStable;    // stop early at a fixed point, implies sparse
+};
+
+const SmoothParams DEFAULT_SMOOTH_PARAMS = { 1, 1, false, DEFAULT_TILE_CONFIG, false, false };
+
+/**************************** SmoothingContext ****************************
+ * One smoothing run at a time.  Buffers are kept between calls, so
+ * reusing a context for images of the same size allocates nothing.  A
+ * context must not be used by two threads at once, use one per caller.
+ **************************************************************************/
+class SmoothingContext
+{
+public:
+    SmoothingContext(ThreadPool& pool, const SmoothParams& params = DEFAULT_SMOOTH_PARAMS);
+    bool smooth(const cv::Mat& input, cv::Mat& output);
+    SmoothParams params;
+    int stableAfter;                // averages after which the last smooth
+                                    // stopped changing, -1 if it never did
+                                    // (only tracked with sparse)
+private:
+    SmoothingContext(const SmoothingContext&);
+    SmoothingContext& operator=(const SmoothingContext&);
+    static void runChunk(void *p, int chunk);
+
+    ThreadPool& pool;
+    cv::Mat spare;                  // second ping-pong buffer
+    std::vector<TileWork> work;     // tile buffers and scratch, one set per chunk
+    ActiveTiles tracker;            // stable tiles, with params.sparse
+    const cv::Mat *src;             // current pass
+    cv::Mat *dst;
+    int block, numTiles, numChunks;
+};
+
+#endif
@@ -0,0 +1,159 @@
+/***********************************************************************************
+ * snapshotWriter.cpp written by Timothy Hennessy
+ *
+ * Description: Background snapshot writer with reusable buffers.
+ *********************************************************************************/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include "snapshotWriter.hpp"
+#include "profile.hpp"
+#include "rawImage.hpp"
+using namespace cv;
+using namespace std;
+
+/*************************** parseSnapshotConfig **************************
+ * bool parseSnapshotConfig(char *spec, SnapshotConfig& config)
+ *
+ * Description: Parses every[,directory[,drop|block[,extension]]] into
+ * config, leaving omitted fields at their defaults.  spec is modified.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * bool          value       False if a field is invalid.
+ **************************************************************************/
+bool parseSnapshotConfig(char *spec, SnapshotConfig& config)
+{
+    char *token = strtok(spec, ",");
+    if (!token || (config.every = atoi(token)) < 1)
+        return false;
+    if ((token = strtok(NULL, ",")) != NULL)
+        config.directory = token;
+    if ((token = strtok(NULL, ",")) != NULL)
+    {
+        if (strcmp(token, "drop") == 0)
+            config.policy = SNAPSHOT_DROP;
+        else if (strcmp(token, "block") == 0)
+            config.policy = SNAPSHOT_BLOCK;
+        else
+            return false;
+    }
+    if ((token = strtok(NULL, ",")) != NULL)
+        config.extension = token[0] == '.' ? string(token) : "." + string(token);
+    return strtok(NULL, ",") == NULL;
+}
+
+/**************************** SnapshotWriter ******************************
+ * SnapshotWriter(const SnapshotConfig& config)
+ *
+ * Description: Creates config.directory if needed and starts the writer
+ * thread.  Buffers are allocated by the first snapshots that need them.
+ **************************************************************************/
+SnapshotWriter::SnapshotWriter(const SnapshotConfig& config)
+    : config(config), pending(config.depth), spare(config.depth), allocated(0),
+      writtenCount(0), droppedCount(0), failedCount(0)
+{
+    mkdir(config.directory.c_str(), 0755);
+    running = pthread_create(&thread, NULL, writerMain, this) == 0;
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    close();
+}
+
+bool SnapshotWriter::due(int averageOps) const
+{
+    return averageOps > 0 && averageOps % config.every == 0;
+}
+
+/************************** SnapshotWriter::submit ************************
+ * bool SnapshotWriter::submit(int averageOps, const Mat& image)
+ *
+ * Description: Queues a copy of image as the snapshot after averageOps
+ * iterations.  image may be overwritten as soon as this returns.
+ *
+ * Process:
+ * 1.) Take a buffer the writer has finished with, or create one while
+ *     fewer than depth exist.
+ * 2.) Otherwise drop the snapshot, or with the block policy wait for the
+ *     writer to finish one.
+ * 3.) Copy image into the buffer and queue it.  The queue holds depth
+ *     entries and only depth buffers exist, so this never waits.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * bool          value       False if the snapshot was dropped.
+ **************************************************************************/
+bool SnapshotWriter::submit(int averageOps, const Mat& image)
+{
+    Snapshot snapshot;
+    PROFILE_SCOPE("snapshot");
+    if (!running)
+    {
+        droppedCount++;
+        return false;
+    }
+    if (!spare.tryPop(snapshot.image))
+    {
+        if (allocated < config.depth)
+            allocated++;
+        else if (config.policy == SNAPSHOT_DROP || !spare.pop(snapshot.image))
+        {
+            droppedCount++;
+            return false;
+        }
+    }
+    image.copyTo(snapshot.image);
+    snapshot.averageOps = averageOps;
+    pending.push(snapshot);
+    return true;
+}
+
+/************************** SnapshotWriter::close *************************
+ * void SnapshotWriter::close()
+ *
+ * Description: Writes every queued snapshot and stops the writer thread.
+ * Called by the destructor, call it earlier to have the counts final.
+ **************************************************************************/
+void SnapshotWriter::close()
+{
+    if (!running)
+        return;
+    pending.close();
+    pthread_join(thread, NULL);
+    running = false;
+}
+
+long SnapshotWriter::written() const
+{
+    return writtenCount;
+}
+
+long SnapshotWriter::dropped() const
+{
+    return droppedCount;
+}
+
+long SnapshotWriter::failed() const
+{
+    return failedCount;
+}
+
+void *SnapshotWriter::writerMain(void *p)
+{
+    SnapshotWriter& writer = *(SnapshotWriter *) p;
+    Snapshot snapshot;
+    char name[64];
+    while (writer.pending.pop(snapshot))
+    {
+        snprintf(name, sizeof(name), "/after_%d_averages", snapshot.averageOps);
+        if (writeImage(writer.config.directory + name + writer.config.extension, snapshot.image))
+            writer.writtenCount++;
+        else
+            writer.failedCount++;
+        writer.spare.push(snapshot.image);
+    }
+    return NULL;
+}
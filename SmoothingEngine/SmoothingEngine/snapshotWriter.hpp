@@ -0,0 +1,67 @@
+/***********************************************************************************
+ * snapshotWriter.hpp written by Timothy Hennessy
+ *
+ * Description: Progress snapshots of a running smoothing loop, written by
+ * a background thread so the loop never waits for an encoder or a disk.
+ *
+ * Every every iterations the loop calls submit, which copies the image
+ * into one of depth reusable buffers and queues it.  The writer thread
+ * encodes queued snapshots to <directory>/after_<n>_averages<extension>
+ * and hands the buffers back.  When all buffers are in use, the drop
+ * policy skips the snapshot (the loop never waits) and the block policy
+ * waits for a buffer (every snapshot is kept).
+ *********************************************************************************/
+#ifndef SNAPSHOT_WRITER_HPP
+#define SNAPSHOT_WRITER_HPP
+#include <pthread.h>
+#include <atomic>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "boundedQueue.hpp"
+
+enum SnapshotPolicy { SNAPSHOT_DROP, SNAPSHOT_BLOCK };
+
+struct SnapshotConfig
+{
+    int every;                  // iterations between snapshots
+    std::string directory;
+    std::string extension;      // picks the encoder, e.g. .bgr or .jpg
+    SnapshotPolicy policy;
+    int depth;                  // snapshot buffers
+};
+
+const SnapshotConfig DEFAULT_SNAPSHOT_CONFIG = { 25, ".", ".bgr", SNAPSHOT_DROP, 2 };
+
+bool parseSnapshotConfig(char *spec, SnapshotConfig& config);
+
+class SnapshotWriter
+{
+public:
+    SnapshotWriter(const SnapshotConfig& config);
+    ~SnapshotWriter();
+    bool due(int averageOps) const;
+    bool submit(int averageOps, const cv::Mat& image);
+    void close();
+    long written() const;
+    long dropped() const;
+    long failed() const;
+private:
+    struct Snapshot
+    {
+        int averageOps;
+        cv::Mat image;
+    };
+    SnapshotWriter(const SnapshotWriter&);
+    SnapshotWriter& operator=(const SnapshotWriter&);
+    static void *writerMain(void *p);
+
+    SnapshotConfig config;
+    BoundedQueue<Snapshot> pending;     // waiting for the writer
+    BoundedQueue<cv::Mat> spare;        // buffers the writer is done with
+    int allocated;                      // buffers created so far
+    std::atomic<long> writtenCount, droppedCount, failedCount;
+    pthread_t thread;
+    bool running;
+};
+
+#endif
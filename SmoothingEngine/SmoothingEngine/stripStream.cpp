@@ -0,0 +1,282 @@
+/***********************************************************************************
+ * stripStream.cpp written by Timothy Hennessy
+ *
+ * Description: Streaming strip-based smoothing and scanline PNM I/O.
+ *********************************************************************************/
+#include <cctype>
+#include <cstring>
+#include "boxAverage.hpp"
+#include "stripStream.hpp"
+using namespace cv;
+using namespace std;
+
+PnmReader::PnmReader() : rows(0), cols(0), channels(0), fp(NULL)
+{
+}
+
+PnmReader::~PnmReader()
+{
+    if (fp)
+        fclose(fp);
+}
+
+/*************************** readHeaderNumber *****************************
+ * static bool readHeaderNumber(FILE *fp, int& value)
+ *
+ * Description: Reads the next decimal number of a PNM header, skipping
+ * whitespace and # comments.
+ **************************************************************************/
+static bool readHeaderNumber(FILE *fp, int& value)
+{
+    int ch = fgetc(fp);
+    while (ch == '#' || isspace(ch))
+    {
+        if (ch == '#')
+            while (ch != '\n' && ch != EOF)
+                ch = fgetc(fp);
+        ch = fgetc(fp);
+    }
+    if (!isdigit(ch))
+        return false;
+    value = 0;
+    while (isdigit(ch))
+    {
+        value = value * 10 + (ch - '0');
+        ch = fgetc(fp);
+    }
+    // exactly one whitespace byte ends the header, ch has consumed it
+    return true;
+}
+
+/***************************** PnmReader::open ****************************
+ * bool PnmReader::open(const char *path)
+ *
+ * Description: Opens a binary PPM (P6, 3 channels) or PGM (P5, 1 channel)
+ * and reads its header.  Only maxval 255 is supported.
+ **************************************************************************/
+bool PnmReader::open(const char *path)
+{
+    char magic[2];
+    int maxval;
+    fp = fopen(path, "rb");
+    if (!fp || fread(magic, 1, 2, fp) != 2 || magic[0] != 'P')
+        return false;
+    if (magic[1] == '6')
+        channels = 3;
+    else if (magic[1] == '5')
+        channels = 1;
+    else
+        return false;
+    return readHeaderNumber(fp, cols) && readHeaderNumber(fp, rows)
+        && readHeaderNumber(fp, maxval) && maxval == 255 && rows > 0 && cols > 0;
+}
+
+bool PnmReader::readRow(uchar *row)
+{
+    return fread(row, 1, (size_t) cols * channels, fp) == (size_t) cols * channels;
+}
+
+PnmWriter::PnmWriter() : fp(NULL), rowBytes(0)
+{
+}
+
+PnmWriter::~PnmWriter()
+{
+    close();
+}
+
+bool PnmWriter::open(const char *path, int rows, int cols, int channels)
+{
+    CV_Assert(channels == 1 || channels == 3);
+    fp = fopen(path, "wb");
+    rowBytes = (size_t) cols * channels;
+    if (!fp)
+        return false;
+    return fprintf(fp, "P%c\n%d %d\n255\n", channels == 3 ? '6' : '5', cols, rows) > 0;
+}
+
+bool PnmWriter::writeRow(const uchar *row)
+{
+    return fwrite(row, 1, rowBytes, fp) == rowBytes;
+}
+
+bool PnmWriter::close()
+{
+    bool ok = true;
+    if (fp)
+        ok = fclose(fp) == 0;
+    fp = NULL;
+    return ok;
+}
+
+/*************************** StreamingSmoother ****************************
+ * StreamingSmoother::StreamingSmoother(int rows, int cols, int channels,
+ *                                      int radius, int n, RowSink sink,
+ *                                      void *sinkArg)
+ *
+ * Description: Sets up n iteration levels for an image of rows x cols.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * rows          in          Image height, needed to know when the bottom
+ *                           border is reached.
+ * cols          in          Image width.
+ * channels      in          Channels per pixel.
+ * radius        in          Neighborhood half width, radius >= 1.
+ * n             in          Number of averaging operations, n >= 0.
+ * sink          in          Called with every final row, in order.
+ * sinkArg       in          Passed through to sink.
+ **************************************************************************/
+StreamingSmoother::StreamingSmoother(int rows, int cols, int channels, int radius,
+                                     int n, RowSink sink, void *sinkArg)
+    : rows(rows), cols(cols), channels(channels), radius(radius),
+      ringRows(2 * radius + 2), colCount(cols), levels(n), sink(sink), sinkArg(sinkArg)
+{
+    int c, l, width = cols * channels;
+    CV_Assert(radius >= 1 && n >= 0);
+    for (c = 0; c < cols; c++)
+        colCount[c] = min(c + radius, cols - 1) - max(c - radius, 0) + 1;
+    for (l = 0; l < n; l++)
+    {
+        levels[l].ring.resize((size_t) ringRows * width);
+        levels[l].colSum.assign(width, 0);
+        levels[l].rowSum.resize(width);
+        levels[l].out.resize(width);
+        levels[l].received = levels[l].emitted = 0;
+        levels[l].lo = 0;
+        levels[l].hi = -1;
+    }
+}
+
+const uchar *StreamingSmoother::ringRow(Level& l, int r)
+{
+    return &l.ring[(size_t) (r % ringRows) * cols * channels];
+}
+
+/************************** StreamingSmoother::push ***********************
+ * bool StreamingSmoother::push(int level, const uchar *row)
+ *
+ * Description: Feeds the next input row to level and emits every output
+ * row that has become final.
+ *
+ * Process:
+ * 1.) Store the row in the ring.
+ * 2.) While the window of the next output row is complete, slide the
+ *     vertical running sums to that window, divide by the valid cell
+ *     count and pass the row to the next level, or the sink after the
+ *     last level.
+ *
+ * NOTES:
+ * - Output row o is emitted as soon as row o + radius (or the last row)
+ *   arrives.  The row it drops from the sums, o - radius - 1, is then at
+ *   most 2 * radius + 1 rows old, which is why the ring holds
+ *   2 * radius + 2 rows.
+ **************************************************************************/
+bool StreamingSmoother::push(int level, const uchar *row)
+{
+    if (level == (int) levels.size())
+        return sink(sinkArg, row);
+    Level& l = levels[level];
+    int width = cols * channels;
+    int o, j, c, k, vcount;
+    memcpy(&l.ring[(size_t) (l.received % ringRows) * width], row, width);
+    l.received++;
+    while (l.emitted < rows && min(l.emitted + radius, rows - 1) < l.received)
+    {
+        o = l.emitted;
+        while (l.hi < min(o + radius, rows - 1))   // rows entering the window
+        {
+            l.hi++;
+            horizontalBoxSums(ringRow(l, l.hi), cols, channels, radius, 0, cols, &l.rowSum[0]);
+            for (j = 0; j < width; j++)
+                l.colSum[j] += l.rowSum[j];
+        }
+        while (l.lo < max(o - radius, 0))          // rows leaving the window
+        {
+            horizontalBoxSums(ringRow(l, l.lo), cols, channels, radius, 0, cols, &l.rowSum[0]);
+            for (j = 0; j < width; j++)
+                l.colSum[j] -= l.rowSum[j];
+            l.lo++;
+        }
+        vcount = l.hi - l.lo + 1;
+        for (c = 0, j = 0; c < cols; c++)
+        {
+            int count = colCount[c] * vcount;
+            for (k = 0; k < channels; k++, j++)
+                l.out[j] = saturate_cast<uchar>(l.colSum[j] / count);
+        }
+        l.emitted++;
+        if (!push(level + 1, &l.out[0]))
+            return false;
+    }
+    return true;
+}
+
+/************************ StreamingSmoother::pushRow **********************
+ * bool StreamingSmoother::pushRow(const uchar *row)
+ *
+ * Description: Feeds the next row of the input image.  Returns false if
+ * the sink failed.
+ **************************************************************************/
+bool StreamingSmoother::pushRow(const uchar *row)
+{
+    return push(0, row);
+}
+
+/*********************** StreamingSmoother::bufferedBytes *****************
+ * size_t StreamingSmoother::bufferedBytes() const
+ *
+ * Description: Bytes held by all levels, the peak memory of the stream.
+ **************************************************************************/
+size_t StreamingSmoother::bufferedBytes() const
+{
+    size_t total = colCount.size() * sizeof(int);
+    size_t l;
+    for (l = 0; l < levels.size(); l++)
+        total += levels[l].ring.size() + levels[l].out.size()
+               + (levels[l].colSum.size() + levels[l].rowSum.size()) * sizeof(int);
+    return total;
+}
+
+static bool writeToPnm(void *arg, const uchar *row)
+{
+    return ((PnmWriter *) arg)->writeRow(row);
+}
+
+/****************************** streamSmooth ******************************
+ * bool streamSmooth(const char *input, const char *output, int radius,
+ *                   int n, size_t *peakBytes)
+ *
+ * Description: Smooths a PPM/PGM file into another one scanline by
+ * scanline, never holding the whole image.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * input         in          Path of a binary PPM or PGM.
+ * output        in          Path to write, same format as input.
+ * radius        in          Neighborhood half width.
+ * n             in          Number of averaging operations.
+ * peakBytes     out         Optional, bytes buffered by the stream.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * bool          value       False on any read or write error.
+ **************************************************************************/
+bool streamSmooth(const char *input, const char *output, int radius, int n,
+                  size_t *peakBytes)
+{
+    PnmReader reader;
+    PnmWriter writer;
+    int r;
+    if (!reader.open(input) || !writer.open(output, reader.rows, reader.cols, reader.channels))
+        return false;
+    StreamingSmoother stream(reader.rows, reader.cols, reader.channels, radius, n,
+                             writeToPnm, &writer);
+    vector<uchar> row((size_t) reader.cols * reader.channels);
+    for (r = 0; r < reader.rows; r++)
+        if (!reader.readRow(&row[0]) || !stream.pushRow(&row[0]))
+            return false;
+    if (peakBytes)
+        *peakBytes = stream.bufferedBytes() + row.size();
+    return writer.close();
+}
@@ -0,0 +1,79 @@
+/***********************************************************************************
+ * stripStream.hpp written by Timothy Hennessy
+ *
+ * Description: Streaming strip-based smoothing for images larger than RAM.
+ * Rows are read one scanline at a time and pushed through n chained
+ * iteration levels.  Each level keeps only the 2 * radius + 2 most recent
+ * rows of its input, and a row leaves the last level, and is written, as
+ * soon as it is final.  Peak memory is O(width * n * radius) instead of
+ * O(width * height).
+ *
+ * Output is bit-exact with n passes of boxAverage.
+ *
+ * Input and output are binary PPM (P6) or PGM (P5) with maxval 255, which
+ * can be read and written by scanline without any codec library.
+ *********************************************************************************/
+#ifndef STRIP_STREAM_HPP
+#define STRIP_STREAM_HPP
+#include <cstdio>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+class PnmReader
+{
+public:
+    PnmReader();
+    ~PnmReader();
+    bool open(const char *path);
+    bool readRow(uchar *row);
+    int rows, cols, channels;
+private:
+    FILE *fp;
+};
+
+class PnmWriter
+{
+public:
+    PnmWriter();
+    ~PnmWriter();
+    bool open(const char *path, int rows, int cols, int channels);
+    bool writeRow(const uchar *row);
+    bool close();
+private:
+    FILE *fp;
+    size_t rowBytes;
+};
+
+// Receives every finished output row, in order
+typedef bool (*RowSink)(void *arg, const uchar *row);
+
+class StreamingSmoother
+{
+public:
+    StreamingSmoother(int rows, int cols, int channels, int radius, int n,
+                      RowSink sink, void *sinkArg);
+    bool pushRow(const uchar *row);
+    size_t bufferedBytes() const;
+private:
+    struct Level
+    {
+        std::vector<uchar> ring;          // last 2 * radius + 2 input rows
+        std::vector<int> colSum, rowSum;  // vertical running sums
+        std::vector<uchar> out;           // row being produced
+        int received, emitted;            // input rows in, output rows out
+        int lo, hi;                       // rows currently in colSum
+    };
+    bool push(int level, const uchar *row);
+    const uchar *ringRow(Level& l, int r);
+
+    int rows, cols, channels, radius, ringRows;
+    std::vector<int> colCount;
+    std::vector<Level> levels;
+    RowSink sink;
+    void *sinkArg;
+};
+
+bool streamSmooth(const char *input, const char *output, int radius, int n,
+                  size_t *peakBytes);
+
+#endif
@@ -0,0 +1,119 @@
+/***********************************************************************************
+ * temporalBlocking.cpp written by Timothy Hennessy
+ *
+ * Description: Temporal (multi-iteration) cache blocking built on
+ * boxAverageRect.
+ *********************************************************************************/
+#include "boxAverage.hpp"
+#include "temporalBlocking.hpp"
+using namespace cv;
+using namespace std;
+
+/******************************** tileCount *******************************
+ * int tileCount(const Size& size, const TileConfig& config)
+ *
+ * Description: Number of tiles needed to cover an image of size.
+ **************************************************************************/
+int tileCount(const Size& size, const TileConfig& config)
+{
+    int tilesDown   = (size.height + config.tileRows - 1) / config.tileRows;
+    int tilesAcross = (size.width + config.tileCols - 1) / config.tileCols;
+    return tilesDown * tilesAcross;
+}
+
+/******************************** tileRect ********************************
+ * Rect tileRect(const Size& size, const TileConfig& config, int index)
+ *
+ * Description: Rectangle of tile index, in row-major tile order.  Tiles
+ * on the right and bottom edges are clipped to the image.
+ **************************************************************************/
+Rect tileRect(const Size& size, const TileConfig& config, int index)
+{
+    int tilesAcross = (size.width + config.tileCols - 1) / config.tileCols;
+    int x = (index % tilesAcross) * config.tileCols;
+    int y = (index / tilesAcross) * config.tileRows;
+    return Rect(x, y, min(config.tileCols, size.width - x), min(config.tileRows, size.height - y));
+}
+
+/******************************** smoothTile ******************************
+ * void smoothTile(const Mat& src, Mat& dst, int radius, int iterations,
+ *                 const Rect& tile, TileWork& work)
+ *
+ * Description: Runs iterations averaging operations on one tile and
+ * stores the result into the same pixels of dst.
+ *
+ * Process:
+ * 1.) Grow the tile by a halo of iterations * radius pixels, clipped to
+ *     the image, and copy that region into a local buffer.
+ * 2.) On iteration t compute only the tile grown by
+ *     (iterations - t) * radius, alternating between the two local buffers.
+ * 3.) Copy the tile out of the final buffer into dst.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * src           in          Image before this block of iterations.
+ * dst           out         Image after this block of iterations.  Must
+ *                           not alias src.
+ * radius        in          Neighborhood half width.
+ * iterations    in          Number of iterations to run, >= 1.
+ * tile          in          Tile of dst to produce.
+ * work          in/out      Local buffers and kernel scratch, reused
+ *                           between calls.
+ *
+ * NOTES:
+ * - The local buffer edges that are not image edges give wrong averages,
+ *   but each iteration only reaches radius pixels further in, and the
+ *   halo is exactly wide enough that those never reach the tile.
+ **************************************************************************/
+void smoothTile(const Mat& src, Mat& dst, int radius, int iterations,
+                const Rect& tile, TileWork& work)
+{
+    int halo = iterations * radius;
+    int t, grow;
+    Rect image(0, 0, src.cols, src.rows);
+    Rect region = Rect(tile.x - halo, tile.y - halo, tile.width + 2 * halo,
+                       tile.height + 2 * halo) & image;
+    Mat local[2];
+
+    // Buffers only grow, interior and edge tiles share one allocation
+    for (t = 0; t < 2; t++)
+    {
+        if (work.buffers[t].rows < region.height || work.buffers[t].cols < region.width
+            || work.buffers[t].type() != src.type())
+            work.buffers[t].create(max(region.height, work.buffers[t].rows),
+                                   max(region.width, work.buffers[t].cols), src.type());
+        local[t] = work.buffers[t](Rect(0, 0, region.width, region.height));
+    }
+    src(region).copyTo(local[0]);
+
+    for (t = 1; t <= iterations; t++)
+    {
+        grow = (iterations - t) * radius;
+        Rect valid = Rect(tile.x - grow, tile.y - grow, tile.width + 2 * grow,
+                          tile.height + 2 * grow) & region;
+        boxAverageRect(local[(t - 1) % 2], local[t % 2], radius,
+                       Rect(valid.x - region.x, valid.y - region.y, valid.width, valid.height),
+                       work.scratch);
+    }
+
+    Mat result = local[iterations % 2](Rect(tile.x - region.x, tile.y - region.y,
+                                            tile.width, tile.height));
+    Mat out = dst(tile);
+    result.copyTo(out);
+}
+
+/******************************* smoothTiles ******************************
+ * void smoothTiles(const Mat& src, Mat& dst, int radius, int iterations,
+ *                  const TileConfig& config, int firstTile, int endTile,
+ *                  TileWork& work)
+ *
+ * Description: Runs smoothTile on tiles [firstTile, endTile).  Threads
+ * may process disjoint tile ranges of the same src and dst concurrently.
+ **************************************************************************/
+void smoothTiles(const Mat& src, Mat& dst, int radius, int iterations,
+                 const TileConfig& config, int firstTile, int endTile, TileWork& work)
+{
+    int i;
+    for (i = firstTile; i < endTile; i++)
+        smoothTile(src, dst, radius, iterations, tileRect(src.size(), config, i), work);
+}
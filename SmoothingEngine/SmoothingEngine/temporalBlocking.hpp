@@ -0,0 +1,40 @@
+/***********************************************************************************
+ * temporalBlocking.hpp written by Timothy Hennessy
+ *
+ * Description: Temporal (multi-iteration) cache blocking.  Instead of
+ * streaming the whole image through memory once per iteration, the image
+ * is cut into tiles and k iterations are run on each tile, plus a halo of
+ * k * radius pixels, while it is still in cache.
+ *
+ * Every iteration shrinks the region that is still correct by radius
+ * pixels (a trapezoid in time), so the tile itself ends up bit-identical
+ * to k untiled passes of boxAverage.
+ *********************************************************************************/
+#ifndef TEMPORAL_BLOCKING_HPP
+#define TEMPORAL_BLOCKING_HPP
+#include <opencv2/opencv.hpp>
+#include "typedAverage.hpp"
+
+struct TileConfig
+{
+    int tileRows;    // rows per tile, not counting halo
+    int tileCols;    // cols per tile, not counting halo
+    int blockIters;  // iterations run per tile before moving on (k)
+};
+
+struct TileWork
+{
+    cv::Mat buffers[2];      // ping-pong buffers for one tile plus halo
+    AverageScratch scratch;  // row sums of the kernel
+};
+
+const TileConfig DEFAULT_TILE_CONFIG = { 128, 128, 4 };
+
+int tileCount(const cv::Size& size, const TileConfig& config);
+cv::Rect tileRect(const cv::Size& size, const TileConfig& config, int index);
+void smoothTile(const cv::Mat& src, cv::Mat& dst, int radius, int iterations,
+                const cv::Rect& tile, TileWork& work);
+void smoothTiles(const cv::Mat& src, cv::Mat& dst, int radius, int iterations,
+                 const TileConfig& config, int firstTile, int endTile, TileWork& work);
+
+#endif
@@ -0,0 +1,281 @@
+/***********************************************************************************
+ * threadPool.cpp written by Timothy Hennessy
+ *
+ * Description: Long-lived pthread worker pool and barrier.
+ *********************************************************************************/
+#include "threadPool.hpp"
+#include "profile.hpp"
+using namespace std;
+
+Barrier::Barrier(int count) : count(count), waiting(0), generation(0)
+{
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+}
+
+Barrier::~Barrier()
+{
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+}
+
+/****************************** Barrier::wait *****************************
+ * void Barrier::wait()
+ *
+ * Description: Blocks until count threads have called wait.  The
+ * generation counter lets the barrier be reused immediately and guards
+ * against spurious wakeups.
+ **************************************************************************/
+void Barrier::wait()
+{
+    pthread_mutex_lock(&mutex);
+    unsigned long arrived = generation;
+    if (++waiting == count)
+    {
+        waiting = 0;
+        generation++;
+        pthread_cond_broadcast(&cond);
+    }
+    else
+    {
+        while (arrived == generation)
+            pthread_cond_wait(&cond, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+/******************************** ThreadPool ******************************
+ * ThreadPool::ThreadPool(int numThreads)
+ *
+ * Description: Starts numThreads workers that sleep until tasks arrive.
+ **************************************************************************/
+ThreadPool::ThreadPool(int numThreads) : head(0), queued(0), stopping(false)
+{
+    int t;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_mutex_init(&teamMutex, NULL);
+    pthread_cond_init(&workReady, NULL);
+    pthread_cond_init(&workDone, NULL);
+    threads.resize(numThreads < 1 ? 1 : numThreads);
+    for (t = 0; t < (int) threads.size(); t++)
+        pthread_create(&threads[t], NULL, workerMain, this);
+}
+
+/******************************* ~ThreadPool ******************************
+ * Description: Lets queued tasks finish, then stops and joins workers.
+ **************************************************************************/
+ThreadPool::~ThreadPool()
+{
+    size_t t;
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_broadcast(&workReady);
+    pthread_mutex_unlock(&mutex);
+    for (t = 0; t < threads.size(); t++)
+        pthread_join(threads[t], NULL);
+    for (t = 0; t < freeTasks.size(); t++)
+        delete freeTasks[t];
+    pthread_cond_destroy(&workDone);
+    pthread_cond_destroy(&workReady);
+    pthread_mutex_destroy(&teamMutex);
+    pthread_mutex_destroy(&mutex);
+}
+
+int ThreadPool::size() const
+{
+    return (int) threads.size();
+}
+
+/************************** ThreadPool::reserve ***************************
+ * void ThreadPool::reserve(size_t count)
+ *
+ * Description: Makes room for count more tasks, called with mutex held.
+ * A ring that is too small is copied in order into one at least twice its
+ * size, the ring never shrinks.
+ **************************************************************************/
+void ThreadPool::reserve(size_t count)
+{
+    size_t i, capacity = ring.size() < 16 ? 32 : ring.size();
+    if (queued + count <= ring.size())
+        return;
+    while (capacity < queued + count)
+        capacity *= 2;
+    vector<Task> larger(capacity);
+    for (i = 0; i < queued; i++)
+        larger[i] = ring[(head + i) % ring.size()];
+    ring.swap(larger);
+    head = 0;
+}
+
+void ThreadPool::push(const Task& task)
+{
+    reserve(1);
+    ring[(head + queued) % ring.size()] = task;
+    queued++;
+}
+
+/*************************** ThreadPool::submit ***************************
+ * void ThreadPool::submit(TaskGroup& group, TaskFunction fn, void *arg)
+ *
+ * Description: Queues fn(arg) as part of group.
+ **************************************************************************/
+void ThreadPool::submit(TaskGroup& group, TaskFunction fn, void *arg)
+{
+    Task task = { fn, arg, &group };
+    pthread_mutex_lock(&mutex);
+    group.pending++;
+    push(task);
+    pthread_cond_signal(&workReady);
+    pthread_mutex_unlock(&mutex);
+}
+
+/**************************** ThreadPool::runOne **************************
+ * bool ThreadPool::runOne(bool block)
+ *
+ * Description: Pops and runs one queued task.  Called with mutex held and
+ * returns with it held.  Returns false if no task was run, either because
+ * the queue was empty and block is false, or because the pool is stopping.
+ **************************************************************************/
+bool ThreadPool::runOne(bool block)
+{
+    while (block && queued == 0 && !stopping)
+        pthread_cond_wait(&workReady, &mutex);
+    if (queued == 0)
+        return false;
+    Task task = ring[head];
+    head = (head + 1) % ring.size();
+    queued--;
+    pthread_mutex_unlock(&mutex);
+    {
+        PROFILE_SCOPE("pool task");
+        task.fn(task.arg);
+    }
+    pthread_mutex_lock(&mutex);
+    if (--task.group->pending == 0)
+        pthread_cond_broadcast(&workDone);
+    return true;
+}
+
+void *ThreadPool::workerMain(void *p)
+{
+    ThreadPool *pool = (ThreadPool *) p;
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->runOne(true))
+        ;
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/***************************** ThreadPool::wait ***************************
+ * void ThreadPool::wait(TaskGroup& group)
+ *
+ * Description: Blocks until every task of group has finished.  While
+ * waiting the caller runs queued tasks itself, so a task may submit and
+ * wait for subtasks without starving the pool.
+ **************************************************************************/
+void ThreadPool::wait(TaskGroup& group)
+{
+    pthread_mutex_lock(&mutex);
+    while (group.pending > 0)
+    {
+        if (!runOne(false))
+            pthread_cond_wait(&workDone, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void ThreadPool::runIndexed(void *p)
+{
+    IndexedTask *task = (IndexedTask *) p;
+    task->fn(task->arg, task->index);
+}
+
+/************************** ThreadPool::takeTasks *************************
+ * vector<IndexedTask> *ThreadPool::takeTasks(int count)
+ *
+ * Description: Hands out an idle task array of at least count entries,
+ * a new one only if none is idle, and makes room for count tasks in the
+ * ring, so the first call of a size does all the growing whatever the
+ * timing.  Every caller in flight, nested ones included, holds its own
+ * array until returnTasks.
+ **************************************************************************/
+vector<ThreadPool::IndexedTask> *ThreadPool::takeTasks(int count)
+{
+    vector<IndexedTask> *tasks;
+    pthread_mutex_lock(&mutex);
+    reserve(count);
+    if (freeTasks.empty())
+        tasks = new vector<IndexedTask>();
+    else
+    {
+        tasks = freeTasks.back();
+        freeTasks.pop_back();
+    }
+    pthread_mutex_unlock(&mutex);
+    if ((int) tasks->size() < count)
+        tasks->resize(count);
+    return tasks;
+}
+
+void ThreadPool::returnTasks(vector<IndexedTask> *tasks)
+{
+    pthread_mutex_lock(&mutex);
+    freeTasks.push_back(tasks);
+    pthread_mutex_unlock(&mutex);
+}
+
+/************************** ThreadPool::parallelFor ***********************
+ * void ThreadPool::parallelFor(int count, IndexedTaskFunction fn,
+ *                              void *arg)
+ *
+ * Description: Runs fn(arg, i) for every i in [0, count) and waits.
+ **************************************************************************/
+void ThreadPool::parallelFor(int count, IndexedTaskFunction fn, void *arg)
+{
+    vector<IndexedTask>& tasks = *takeTasks(count);
+    TaskGroup group;
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        tasks[i].fn = fn;
+        tasks[i].arg = arg;
+        tasks[i].index = i;
+        submit(group, runIndexed, &tasks[i]);
+    }
+    wait(group);
+    returnTasks(&tasks);
+}
+
+/**************************** ThreadPool::runTeam *************************
+ * void ThreadPool::runTeam(IndexedTaskFunction fn, void *arg)
+ *
+ * Description: Runs fn(arg, worker) once per worker, all at the same
+ * time, and waits for them.  Team members may synchronize with a Barrier
+ * of size() threads.
+ *
+ * NOTES:
+ * - Teams are serialized so two teams can never each hold part of the
+ *   workers and deadlock in their barriers.
+ * - Must not be called from a pool worker.
+ **************************************************************************/
+void ThreadPool::runTeam(IndexedTaskFunction fn, void *arg)
+{
+    vector<IndexedTask>& tasks = *takeTasks(size());
+    TaskGroup group;
+    int t;
+    pthread_mutex_lock(&teamMutex);
+    for (t = 0; t < size(); t++)
+    {
+        tasks[t].fn = fn;
+        tasks[t].arg = arg;
+        tasks[t].index = t;
+        submit(group, runIndexed, &tasks[t]);
+    }
+    // No helping here, every member must run on its own worker
+    pthread_mutex_lock(&mutex);
+    while (group.pending > 0)
+        pthread_cond_wait(&workDone, &mutex);
+    pthread_mutex_unlock(&mutex);
+    pthread_mutex_unlock(&teamMutex);
+    returnTasks(&tasks);
+}
@@ -0,0 +1,97 @@
+/***********************************************************************************
+ * threadPool.hpp written by Timothy Hennessy
+ *
+ * Description: Long-lived pthread worker pool.  Threads are created once
+ * and reused for every iteration and every image, so the thread spawn
+ * cost is paid once per process instead of once per iteration.
+ *
+ * Two ways of using the pool:
+ * - submit/wait: queue independent tasks into a TaskGroup and wait for
+ *   that group.  Several callers may share one pool concurrently.
+ * - runTeam: run one task on every worker at the same time, e.g. to run
+ *   all n iterations with a Barrier between them.  Teams are exclusive.
+ *
+ * The queue is a ring that only grows, and parallelFor and runTeam take
+ * their task arrays from a free list, so once a workload has reached its
+ * widest call queueing allocates nothing.
+ *********************************************************************************/
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+#include <pthread.h>
+#include <vector>
+
+typedef void (*TaskFunction)(void *arg);
+typedef void (*IndexedTaskFunction)(void *arg, int index);
+
+/********************************* Barrier ********************************
+ * Reusable barrier for count threads.  pthread_barrier_t is not available
+ * on every platform (e.g. OS X), so it is built from a mutex and condition.
+ **************************************************************************/
+class Barrier
+{
+public:
+    Barrier(int count);
+    ~Barrier();
+    void wait();
+private:
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int count, waiting;
+    unsigned long generation;
+};
+
+/******************************** TaskGroup *******************************
+ * Tracks the tasks submitted together so a caller can wait for just its
+ * own work.  Only ThreadPool touches the counter.
+ **************************************************************************/
+struct TaskGroup
+{
+    TaskGroup() : pending(0) {}
+    int pending;
+};
+
+class ThreadPool
+{
+public:
+    ThreadPool(int numThreads);
+    ~ThreadPool();
+    int size() const;
+    void submit(TaskGroup& group, TaskFunction fn, void *arg);
+    void wait(TaskGroup& group);
+    void parallelFor(int count, IndexedTaskFunction fn, void *arg);
+    void runTeam(IndexedTaskFunction fn, void *arg);
+private:
+    struct Task
+    {
+        TaskFunction fn;
+        void *arg;
+        TaskGroup *group;
+    };
+    struct IndexedTask
+    {
+        IndexedTaskFunction fn;
+        void *arg;
+        int index;
+    };
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+    static void *workerMain(void *p);
+    static void runIndexed(void *p);
+    bool runOne(bool block);
+    void reserve(size_t count);
+    void push(const Task& task);
+    std::vector<IndexedTask> *takeTasks(int count);
+    void returnTasks(std::vector<IndexedTask> *tasks);
+
+    std::vector<pthread_t> threads;
+    std::vector<Task> ring;         // queued tasks, ring.size() is the capacity
+    size_t head, queued;            // oldest task and number of tasks in ring
+    std::vector<std::vector<IndexedTask> *> freeTasks;  // idle task arrays
+    pthread_mutex_t mutex;
+    pthread_cond_t workReady;       // signalled when a task is queued
+    pthread_cond_t workDone;        // signalled when a group drains
+    pthread_mutex_t teamMutex;      // serializes runTeam callers
+    bool stopping;
+};
+
+#endif
@@ -0,0 +1,217 @@
+/***********************************************************************************
+ * tileScheduler.cpp written by Timothy Hennessy
+ *
+ * Description: Work-stealing tile scheduler and Chase-Lev deque.
+ *
+ * NOTES:
+ * - All atomics use the default sequentially consistent ordering.  The
+ *   cost is negligible next to averaging a tile and it keeps the deque
+ *   easy to reason about.
+ *********************************************************************************/
+#include <iomanip>
+#include "tileScheduler.hpp"
+#include "timer.hpp"
+using namespace std;
+
+WorkStealingDeque::WorkStealingDeque() : top(0), bottom(0)
+{
+}
+
+/************************* WorkStealingDeque::reset ***********************
+ * Description: Empties the deque.  Owner only, while no thief can run.
+ **************************************************************************/
+void WorkStealingDeque::reset(int capacity)
+{
+    if ((int) items.size() < capacity)
+        items.resize(capacity);
+    top = 0;
+    bottom = 0;
+}
+
+void WorkStealingDeque::push(int tile)
+{
+    long b = bottom.load();
+    items[b % items.size()] = tile;
+    bottom.store(b + 1);
+}
+
+/************************** WorkStealingDeque::pop ************************
+ * bool WorkStealingDeque::pop(int& tile)
+ *
+ * Description: Takes the most recently pushed tile.  When only one tile
+ * is left the owner races thieves for it with a compare-and-swap on top.
+ **************************************************************************/
+bool WorkStealingDeque::pop(int& tile)
+{
+    long b = bottom.load() - 1;
+    bottom.store(b);
+    long t = top.load();
+    if (t > b)                              // empty
+    {
+        bottom.store(b + 1);
+        return false;
+    }
+    tile = items[b % items.size()];
+    if (t == b)                             // last tile, race thieves
+    {
+        bool won = top.compare_exchange_strong(t, t + 1);
+        bottom.store(b + 1);
+        return won;
+    }
+    return true;
+}
+
+/************************* WorkStealingDeque::steal ***********************
+ * bool WorkStealingDeque::steal(int& tile)
+ *
+ * Description: Takes the oldest tile.  Returns false if the deque is
+ * empty or another thread won the race for the same tile.
+ **************************************************************************/
+bool WorkStealingDeque::steal(int& tile)
+{
+    long t = top.load();
+    long b = bottom.load();
+    if (t >= b)
+        return false;
+    tile = items[t % items.size()];
+    return top.compare_exchange_strong(t, t + 1);
+}
+
+TileScheduler::TileScheduler(int numWorkers) : deques(numWorkers),
+    workers(numWorkers), remaining(0)
+{
+    int w;
+    for (w = 0; w < numWorkers; w++)
+    {
+        deques[w] = new WorkStealingDeque();
+        workers[w].busySecs = workers[w].idleSecs = 0.0;
+        workers[w].tiles = workers[w].steals = 0;
+        workers[w].passStart = workers[w].tileStart = workers[w].passBusy = 0.0;
+    }
+}
+
+TileScheduler::~TileScheduler()
+{
+    size_t w;
+    for (w = 0; w < deques.size(); w++)
+        delete deques[w];
+}
+
+int TileScheduler::size() const
+{
+    return (int) deques.size();
+}
+
+/************************* TileScheduler::beginPass ***********************
+ * void TileScheduler::beginPass(int worker, int numTiles)
+ *
+ * Description: Called by every worker at the start of a pass.  Fills the
+ * worker's deque with its contiguous share of [0, numTiles).
+ *
+ * NOTES:
+ * - Every worker must call beginPass, then all must meet at a barrier,
+ *   before anyone calls next.
+ * - Tiles are pushed in descending order so the owner runs its share in
+ *   row-major order and thieves take from the far end.
+ **************************************************************************/
+void TileScheduler::beginPass(int worker, int numTiles)
+{
+    int workerCount = size();
+    int first = (int) ((long) numTiles * worker / workerCount);
+    int end = (int) ((long) numTiles * (worker + 1) / workerCount);
+    int i;
+    WorkerStats& s = workers[worker];
+    s.passStart = monotonicSeconds();
+    s.tileStart = -1.0;
+    s.passBusy = 0.0;
+    deques[worker]->reset(numTiles);
+    for (i = end - 1; i >= first; i--)
+        deques[worker]->push(i);
+    if (worker == 0)
+        remaining = numTiles;
+}
+
+/**************************** TileScheduler::next *************************
+ * bool TileScheduler::next(int worker, int& tile)
+ *
+ * Description: Finishes timing the previous tile and claims the next one,
+ * first from the worker's own deque, then by stealing round-robin from the
+ * other workers.  Returns false once every tile of the pass is claimed.
+ **************************************************************************/
+bool TileScheduler::next(int worker, int& tile)
+{
+    WorkerStats& s = workers[worker];
+    double now = monotonicSeconds();
+    int workerCount = size();
+    int v;
+    if (s.tileStart >= 0.0)
+    {
+        s.passBusy += now - s.tileStart;
+        s.tileStart = -1.0;
+    }
+    if (deques[worker]->pop(tile))
+    {
+        remaining--;
+        s.tiles++;
+        s.tileStart = monotonicSeconds();
+        return true;
+    }
+    while (remaining > 0)
+    {
+        for (v = 1; v < workerCount; v++)
+        {
+            if (deques[(worker + v) % workerCount]->steal(tile))
+            {
+                remaining--;
+                s.tiles++;
+                s.steals++;
+                s.tileStart = monotonicSeconds();
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*************************** TileScheduler::endPass ***********************
+ * void TileScheduler::endPass(int worker)
+ *
+ * Description: Called by every worker after the end-of-pass barrier.
+ * Whatever part of the pass was not spent running tiles is idle time.
+ **************************************************************************/
+void TileScheduler::endPass(int worker)
+{
+    WorkerStats& s = workers[worker];
+    s.busySecs += s.passBusy;
+    s.idleSecs += monotonicSeconds() - s.passStart - s.passBusy;
+}
+
+const WorkerStats& TileScheduler::stats(int worker) const
+{
+    return workers[worker];
+}
+
+/************************** TileScheduler::printStats *********************
+ * void TileScheduler::printStats(ostream& out) const
+ *
+ * Description: Prints busy/idle seconds, tiles and steals for every
+ * worker, followed by the ratio of the busiest worker to the mean.  A
+ * ratio near 1 means the load is balanced.
+ **************************************************************************/
+void TileScheduler::printStats(ostream& out) const
+{
+    double totalBusy = 0.0, maxBusy = 0.0;
+    int w;
+    out << "thread : busy_secs : idle_secs : tiles : steals" << endl;
+    for (w = 0; w < size(); w++)
+    {
+        const WorkerStats& s = workers[w];
+        out << w << " : " << fixed << setprecision(6) << s.busySecs << " : ";
+        out << s.idleSecs << " : " << s.tiles << " : " << s.steals << endl;
+        totalBusy += s.busySecs;
+        maxBusy = max(maxBusy, s.busySecs);
+    }
+    out.unsetf(ios::floatfield);
+    if (totalBusy > 0.0)
+        out << "imbalance (max/mean busy): " << maxBusy / (totalBusy / size()) << endl;
+}
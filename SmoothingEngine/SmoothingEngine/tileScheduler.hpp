@@ -0,0 +1,65 @@
+/***********************************************************************************
+ * tileScheduler.hpp written by Timothy Hennessy
+ *
+ * Description: Work-stealing tile scheduler.  Every pass is split into 2D
+ * tiles and each worker starts with a contiguous share of them in its own
+ * lock-free deque.  A worker takes tiles from the bottom of its own deque
+ * and, once it runs dry, steals from the top of the other workers' deques,
+ * so uneven tile costs or a worker losing its core to another process no
+ * longer stall the whole pass.
+ *
+ * Per-worker busy and idle time is recorded so imbalance can be measured.
+ *********************************************************************************/
+#ifndef TILE_SCHEDULER_HPP
+#define TILE_SCHEDULER_HPP
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+/*************************** WorkStealingDeque ****************************
+ * Chase-Lev deque of tile indices.  push and pop are owner only, steal may
+ * be called by any thread.  Capacity is fixed by reset and is never
+ * exceeded because a pass never holds more tiles than the image has.
+ **************************************************************************/
+class WorkStealingDeque
+{
+public:
+    WorkStealingDeque();
+    void reset(int capacity);
+    void push(int tile);
+    bool pop(int& tile);
+    bool steal(int& tile);
+private:
+    std::vector<int> items;
+    std::atomic<long> top, bottom;
+};
+
+struct WorkerStats
+{
+    double busySecs;     // time spent running tiles
+    double idleSecs;     // time spent stealing or waiting for the pass
+    long tiles;          // tiles run
+    long steals;         // tiles taken from another worker
+    double passStart, tileStart;
+    double passBusy;
+    char pad[64];        // keep workers' stats on separate cache lines
+};
+
+class TileScheduler
+{
+public:
+    TileScheduler(int numWorkers);
+    ~TileScheduler();
+    int size() const;
+    void beginPass(int worker, int numTiles);
+    bool next(int worker, int& tile);
+    void endPass(int worker);
+    const WorkerStats& stats(int worker) const;
+    void printStats(std::ostream& out) const;
+private:
+    std::vector<WorkStealingDeque *> deques;
+    std::vector<WorkerStats> workers;
+    std::atomic<int> remaining;   // tiles not yet claimed this pass
+};
+
+#endif
@@ -0,0 +1,23 @@
+/***********************************************************************************
+ * timer.hpp written by Timothy Hennessy
+ *
+ * Description: Monotonic wall-clock timer.  clock() reports CPU time summed
+ * over all threads, which is useless for timing parallel code.
+ *********************************************************************************/
+#ifndef TIMER_HPP
+#define TIMER_HPP
+#include <chrono>
+
+/**************************** monotonicSeconds ****************************
+ * double monotonicSeconds()
+ *
+ * Description: Seconds since an arbitrary fixed point.  Only differences
+ * between two calls are meaningful.
+ **************************************************************************/
+inline double monotonicSeconds()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif
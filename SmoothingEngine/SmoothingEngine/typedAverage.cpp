@@ -0,0 +1,320 @@
+/***********************************************************************************
+ * typedAverage.cpp written by Timothy Hennessy
+ *
+ * Description: Compile-time specialized neighborhood average kernels and
+ * their dispatch table.
+ *********************************************************************************/
+#include <algorithm>
+#include "typedAverage.hpp"
+using namespace cv;
+using namespace std;
+
+/******************************** PixelSum ********************************
+ * Accumulator type of a depth, how a sum becomes a pixel and where the
+ * sums live in an AverageScratch.  Integer depths truncate, the same as
+ * the 8-bit engine.
+ **************************************************************************/
+template <typename T> struct PixelSum;
+
+template <> struct PixelSum<uchar>
+{
+    typedef int Type;
+    static uchar average(int sum, int count) { return (uchar) (sum / count); }
+    static int *sums(AverageScratch& scratch, size_t n) { return scratchBuffer(scratch.intSums, n); }
+};
+
+template <> struct PixelSum<ushort>
+{
+    typedef long long Type;   // 65535 * (2 * radius + 1)^2 overflows int past radius 90
+    static ushort average(long long sum, int count) { return (ushort) (sum / count); }
+    static long long *sums(AverageScratch& scratch, size_t n) { return scratchBuffer(scratch.longSums, n); }
+};
+
+template <> struct PixelSum<float>
+{
+    typedef double Type;      // running sums add and subtract, double keeps the drift negligible
+    static float average(double sum, int count) { return (float) (sum / count); }
+    static double *sums(AverageScratch& scratch, size_t n) { return scratchBuffer(scratch.doubleSums, n); }
+};
+
+/****************************** averageBorder *****************************
+ * Averages pixel (row, col), whose neighborhood may be clipped by the
+ * image border, over the cells that are inside the image.
+ **************************************************************************/
+template <typename T, int CN, int R>
+static void averageBorder(const Mat& src, Mat& dst, int row, int col)
+{
+    typedef typename PixelSum<T>::Type Sum;
+    int r0 = max(row - R, 0), r1 = min(row + R, src.rows - 1);
+    int c0 = max(col - R, 0), c1 = min(col + R, src.cols - 1);
+    int count = (r1 - r0 + 1) * (c1 - c0 + 1);
+    Sum sum[CN];
+    int i, j, k;
+    for (k = 0; k < CN; k++)
+        sum[k] = 0;
+    for (i = r0; i <= r1; i++)
+    {
+        const T *p = src.ptr<T>(i);
+        for (j = c0 * CN; j <= c1 * CN; j += CN)
+            for (k = 0; k < CN; k++)
+                sum[k] += p[j + k];
+    }
+    T *out = dst.ptr<T>(row) + col * CN;
+    for (k = 0; k < CN; k++)
+        out[k] = PixelSum<T>::average(sum[k], count);
+}
+
+/***************************** slideColumnSums ****************************
+ * Adds row enter of src to colSum and, if leave >= 0, subtracts row
+ * leave, over the span columns [startCol - R, endCol + R).  Priming the
+ * window and then sliding it costs two rows per output row, whatever R.
+ **************************************************************************/
+template <typename T, int CN, int R>
+static void slideColumnSums(const Mat& src, int enter, int leave, int startCol,
+                            int endCol, typename PixelSum<T>::Type *colSum)
+{
+    const int span = (endCol - startCol + 2 * R) * CN;
+    const T *in = src.ptr<T>(enter) + (startCol - R) * CN;
+    const T *out = leave >= 0 ? src.ptr<T>(leave) + (startCol - R) * CN : NULL;
+    int x;
+    if (out)
+        for (x = 0; x < span; x++)
+            colSum[x] += (typename PixelSum<T>::Type) in[x] - out[x];
+    else
+        for (x = 0; x < span; x++)
+            colSum[x] += in[x];
+}
+
+/***************************** averageInterior ****************************
+ * Averages columns [startCol, endCol) of row, all of whose neighborhoods
+ * lie inside the image, from the vertical window sums in colSum.  Adds
+ * 2 * R + 1 column sums per pixel with no bounds checks and a constant
+ * divisor, with R fixed the window loop unrolls.
+ **************************************************************************/
+template <typename T, int CN, int R>
+static void averageInterior(Mat& dst, int row, int startCol, int endCol,
+                            const typename PixelSum<T>::Type *colSum)
+{
+    typedef typename PixelSum<T>::Type Sum;
+    const int side = 2 * R + 1;
+    const int count = side * side;
+    T *out = dst.ptr<T>(row) + startCol * CN;
+    Sum sum[CN];
+    int c, k, dx;
+    for (c = 0; c < endCol - startCol; c++)
+    {
+        for (k = 0; k < CN; k++)
+            sum[k] = 0;
+        for (dx = 0; dx < side * CN; dx += CN)
+            for (k = 0; k < CN; k++)
+                sum[k] += colSum[c * CN + dx + k];
+        for (k = 0; k < CN; k++)
+            out[c * CN + k] = PixelSum<T>::average(sum[k], count);
+    }
+}
+
+/******************************* averageRect ******************************
+ * void averageRect<T, CN, R>(const Mat& src, Mat& dst, int radius,
+ *                            const Rect& outRect, AverageScratch& scratch)
+ *
+ * Description: Kernel of the table for radius R.  Averages outRect of
+ * src into dst.  Rows whose neighborhoods are inside the image keep one
+ * set of vertical window sums that slides down a row at a time and hand
+ * their interior span to averageInterior, the remaining pixels go to
+ * averageBorder.  radius is ignored, it is R.  The window sums live in
+ * scratch.
+ **************************************************************************/
+template <typename T, int CN, int R>
+static void averageRect(const Mat& src, Mat& dst, int radius, const Rect& outRect,
+                        AverageScratch& scratch)
+{
+    typedef typename PixelSum<T>::Type Sum;
+    int endCol = outRect.x + outRect.width, endRow = outRect.y + outRect.height;
+    int innerStart = max(outRect.x, R), innerEnd = min(endCol, src.cols - R);
+    int innerTop = max(outRect.y, R), innerBottom = min(endRow, src.rows - R);
+    size_t width = (size_t) max(innerEnd - innerStart + 2 * R, 0) * CN;
+    Sum *colSum = PixelSum<T>::sums(scratch, width);
+    int row, c, i;
+    for (row = outRect.y; row < endRow; row++)
+    {
+        if (row < innerTop || row >= innerBottom || innerStart >= innerEnd)
+        {
+            for (c = outRect.x; c < endCol; c++)
+                averageBorder<T, CN, R>(src, dst, row, c);
+            continue;
+        }
+        if (row == innerTop)
+        {
+            fill(colSum, colSum + width, 0);
+            for (i = row - R; i <= row + R; i++)
+                slideColumnSums<T, CN, R>(src, i, -1, innerStart, innerEnd, colSum);
+        }
+        else
+            slideColumnSums<T, CN, R>(src, row + R, row - R - 1, innerStart, innerEnd, colSum);
+        for (c = outRect.x; c < innerStart; c++)
+            averageBorder<T, CN, R>(src, dst, row, c);
+        averageInterior<T, CN, R>(dst, row, innerStart, innerEnd, colSum);
+        for (c = innerEnd; c < endCol; c++)
+            averageBorder<T, CN, R>(src, dst, row, c);
+    }
+}
+
+/***************************** horizontalSums *****************************
+ * Sums every channel of row over [c - radius, c + radius], clipped to the
+ * row, for each column c in [startCol, endCol), sliding the window one
+ * pixel at a time.
+ **************************************************************************/
+template <typename T, int CN>
+static void horizontalSums(const T *row, int cols, int radius, int startCol, int endCol,
+                           typename PixelSum<T>::Type *out)
+{
+    int c, k, first = max(startCol - radius, 0), last = min(startCol + radius, cols - 1);
+    for (k = 0; k < CN; k++)
+        out[k] = 0;
+    for (c = first; c <= last; c++)
+        for (k = 0; k < CN; k++)
+            out[k] += row[c * CN + k];
+    for (c = startCol + 1; c < endCol; c++)
+    {
+        typename PixelSum<T>::Type *curr = out + (c - startCol) * CN;
+        for (k = 0; k < CN; k++)
+            curr[k] = curr[k - CN];
+        if (c + radius < cols)      // pixel entering the window
+            for (k = 0; k < CN; k++)
+                curr[k] += row[(c + radius) * CN + k];
+        if (c - radius - 1 >= 0)    // pixel leaving the window
+            for (k = 0; k < CN; k++)
+                curr[k] -= row[(c - radius - 1) * CN + k];
+    }
+}
+
+/*************************** runningAverageRect ***************************
+ * void runningAverageRect<T, CN>(const Mat& src, Mat& dst, int radius,
+ *                                const Rect& outRect, AverageScratch& scratch)
+ *
+ * Description: Kernel of the table for radii above MAX_FIXED_RADIUS.
+ * Separable running sums, the same algorithm as the 8-bit boxAverageRect:
+ * every row is summed horizontally by sliding the window, and the rows
+ * are summed vertically by adding the entering and subtracting the
+ * leaving row, so the cost per pixel does not grow with radius.  Clipped
+ * neighborhoods are divided by the cells inside the image.  The row and
+ * window sums live in scratch.
+ **************************************************************************/
+template <typename T, int CN>
+static void runningAverageRect(const Mat& src, Mat& dst, int radius, const Rect& outRect,
+                               AverageScratch& scratch)
+{
+    typedef typename PixelSum<T>::Type Sum;
+    int startRow = outRect.y, endRow = outRect.y + outRect.height;
+    int startCol = outRect.x, endCol = outRect.x + outRect.width;
+    int width = outRect.width * CN;
+    Sum *rowSum = PixelSum<T>::sums(scratch, 2 * (size_t) width);
+    Sum *colSum = rowSum + width;
+    int *colCount = scratchBuffer(scratch.counts, outRect.width);
+    int i, j, k, r, count;
+
+    fill(colSum, colSum + width, 0);
+
+    for (j = startCol; j < endCol; j++)
+        colCount[j - startCol] = min(j + radius, src.cols - 1) - max(j - radius, 0) + 1;
+
+    // Prime vertical sums with rows [startRow - radius, startRow + radius)
+    for (i = max(startRow - radius, 0); i < min(startRow + radius, src.rows); i++)
+    {
+        horizontalSums<T, CN>(src.ptr<T>(i), src.cols, radius, startCol, endCol, rowSum);
+        for (j = 0; j < width; j++)
+            colSum[j] += rowSum[j];
+    }
+
+    for (r = startRow; r < endRow; r++)
+    {
+        T *out = dst.ptr<T>(r) + startCol * CN;
+        if (r + radius < src.rows)  // row entering the window
+        {
+            horizontalSums<T, CN>(src.ptr<T>(r + radius), src.cols, radius, startCol, endCol, rowSum);
+            for (j = 0; j < width; j++)
+                colSum[j] += rowSum[j];
+        }
+        count = min(r + radius, src.rows - 1) - max(r - radius, 0) + 1;
+        for (i = 0, j = 0; i < outRect.width; i++)
+            for (k = 0; k < CN; k++, j++)
+                out[j] = PixelSum<T>::average(colSum[j], colCount[i] * count);
+        if (r - radius >= 0)        // row leaving the window
+        {
+            horizontalSums<T, CN>(src.ptr<T>(r - radius), src.cols, radius, startCol, endCol, rowSum);
+            for (j = 0; j < width; j++)
+                colSum[j] -= rowSum[j];
+        }
+    }
+}
+
+// One table row per depth and channel count, indexed by radius, 0 = any
+// radius above MAX_FIXED_RADIUS
+#define KERNEL_ROW(T, CN) \
+    { runningAverageRect<T, CN>, averageRect<T, CN, 1>, averageRect<T, CN, 2>, averageRect<T, CN, 3> }
+
+static const AverageKernel KERNELS[3][3][MAX_FIXED_RADIUS + 1] =
+{
+    { KERNEL_ROW(uchar, 1),  KERNEL_ROW(uchar, 3),  KERNEL_ROW(uchar, 4) },
+    { KERNEL_ROW(ushort, 1), KERNEL_ROW(ushort, 3), KERNEL_ROW(ushort, 4) },
+    { KERNEL_ROW(float, 1),  KERNEL_ROW(float, 3),  KERNEL_ROW(float, 4) }
+};
+
+/*************************** selectAverageKernel **************************
+ * AverageKernel selectAverageKernel(int type, int radius)
+ *
+ * Description: Looks up the kernel for an OpenCV type and radius.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * type          in          Mat type, e.g. CV_16UC1.
+ * radius        in          neighborhood radius, >= 1.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * AverageKernel value       NULL if the depth or channel count has no
+ *                           kernel or radius < 1.
+ **************************************************************************/
+AverageKernel selectAverageKernel(int type, int radius)
+{
+    int depth = CV_MAT_DEPTH(type), cn = CV_MAT_CN(type), d, c;
+    if (radius < 1)
+        return NULL;
+    if (depth == CV_8U)
+        d = 0;
+    else if (depth == CV_16U)
+        d = 1;
+    else if (depth == CV_32F)
+        d = 2;
+    else
+        return NULL;
+    if (cn == 1)
+        c = 0;
+    else if (cn == 3)
+        c = 1;
+    else if (cn == 4)
+        c = 2;
+    else
+        return NULL;
+    return KERNELS[d][c][radius <= MAX_FIXED_RADIUS ? radius : 0];
+}
+
+/***************************** typedAverageRect ***************************
+ * bool typedAverageRect(const Mat& src, Mat& dst, int radius,
+ *                       const Rect& outRect, AverageScratch& scratch)
+ *
+ * Description: Averages outRect of src into dst, which must be allocated
+ * with the same size and type and must not alias src.  Returns false if
+ * no kernel handles the type.
+ **************************************************************************/
+bool typedAverageRect(const Mat& src, Mat& dst, int radius, const Rect& outRect,
+                      AverageScratch& scratch)
+{
+    AverageKernel kernel = selectAverageKernel(src.type(), radius);
+    if (kernel == NULL)
+        return false;
+    CV_Assert(dst.size() == src.size() && dst.type() == src.type());
+    if (outRect.width > 0 && outRect.height > 0)
+        kernel(src, dst, radius, outRect, scratch);
+    return true;
+}
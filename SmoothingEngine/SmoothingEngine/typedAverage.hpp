@@ -0,0 +1,62 @@
+/***********************************************************************************
+ * typedAverage.hpp written by Timothy Hennessy
+ *
+ * Description: Neighborhood average kernels specialized at compile time on
+ * pixel depth (8U, 16U, 32F), channel count (1, 3, 4) and radius (1, 2, 3,
+ * or any radius given at run time).  Grayscale, BGR and BGRA images of any
+ * of these depths are averaged without per pixel type or channel branches.
+ *
+ * The radius 1 to 3 kernels split their rectangle into the interior, where
+ * the whole neighborhood is inside the image and the divisor is the
+ * constant (2 * radius + 1)^2, and the border, where the neighborhood is
+ * clipped and divided by the number of cells inside, as everywhere else in
+ * the engine.  The interior loop has no bounds checks at all.  Larger
+ * radii use separable running sums, whose cost per pixel is flat in the
+ * radius.
+ *
+ * selectAverageKernel picks the kernel from a table once per image.  The
+ * kernels keep their row sums in an AverageScratch owned by the caller,
+ * so a caller that holds one per thread across passes allocates nothing
+ * once it has seen its widest rectangle.
+ * Integer depths truncate like the 8-bit path, so 8U results are byte for
+ * byte the same as boxAverage.
+ *********************************************************************************/
+#ifndef TYPED_AVERAGE_HPP
+#define TYPED_AVERAGE_HPP
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// Largest radius with its own compile-time kernel, larger radii share one
+#define MAX_FIXED_RADIUS 3
+
+/***************************** AverageScratch *****************************
+ * Row sums and cell counts of one kernel call.  Not shared between
+ * threads.  The vectors only grow, one per accumulator type.
+ **************************************************************************/
+struct AverageScratch
+{
+    std::vector<int> intSums;           // 8U
+    std::vector<long long> longSums;    // 16U
+    std::vector<double> doubleSums;     // 32F
+    std::vector<int> counts;            // valid columns per output column
+};
+
+typedef void (*AverageKernel)(const cv::Mat& src, cv::Mat& dst, int radius,
+                              const cv::Rect& outRect, AverageScratch& scratch);
+
+AverageKernel selectAverageKernel(int type, int radius);
+bool typedAverageRect(const cv::Mat& src, cv::Mat& dst, int radius, const cv::Rect& outRect,
+                      AverageScratch& scratch);
+
+/****************************** scratchBuffer *****************************
+ * Grows buffer to at least n entries and returns its first entry.
+ **************************************************************************/
+template <typename V>
+inline V *scratchBuffer(std::vector<V>& buffer, size_t n)
+{
+    if (buffer.size() < n || buffer.empty())
+        buffer.resize(n ? n : 1);
+    return &buffer[0];
+}
+
+#endif
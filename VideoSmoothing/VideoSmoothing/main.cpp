@@ -0,0 +1,404 @@
+/***********************************************************************************
+ * main.c written by Timothy Hennessy
+ *
+ * Description: Smooths a video or a numbered image sequence frame by frame.
+ * Several frames are smoothed at once, each by its own SmoothingContext on
+ * one shared pool, so the tiles of every frame run in parallel as well.
+ * Finished frames go through a bounded reorder buffer and are written in
+ * order, through cv::VideoWriter or as a numbered image sequence.
+ *
+ * Input and output are image sequences when the path holds a printf
+ * pattern such as frames/%05d.png (or .bgr), and videos otherwise.  A
+ * pattern must hold exactly one %d conversion, checked before the
+ * pipeline starts.
+ *
+ * compile: see README.txt for details.
+ * execute: ./a.out [-r radius] [-j threads] [-F frames] [-q depth] [-b reorder]
+ *          [-s start] [-f fps] [-M idle_mb] [-v] <num> path/<input_video_or_pattern> path/<output_video_or_pattern>
+ *********************************************************************************/
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <pthread.h>
+#include <unistd.h>
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include "boundedQueue.hpp"
+#include "bufferPool.hpp"
+#include "cpuTopology.hpp"
+#include "profile.hpp"
+#include "rawImage.hpp"
+#include "reorderBuffer.hpp"
+#include "smoothingContext.hpp"
+#include "threadPool.hpp"
+#include "timer.hpp"
+using namespace cv;
+using namespace std;
+
+struct Frame
+{
+    long index;                       // position in the stream
+    Mat image, result;
+    shared_ptr<MappedImage> mapping;  // keeps a .bgr frame mapped
+    double decoded;                   // monotonicSeconds() after decoding
+};
+
+int NUM_AVERAGES = 0;                 // averaging operations per frame
+int RADIUS = 1;                       // neighborhood is (2 * RADIUS + 1)^2
+ThreadPool *POOL;                     // shared by every frame worker
+BoundedQueue<Frame> *DECODED;         // frames waiting for a worker
+ReorderBuffer<Frame> *FINISHED;       // smoothed frames waiting to be written
+BufferPool *BUFFERS;                  // decoded and smoothed frames
+
+bool isPattern(const string& path)
+{
+    return path.find('%') != string::npos;
+}
+
+/***************************** patternConversion ***************************
+ * size_t patternConversion(const string& pattern)
+ *
+ * Description: Finds the one integer conversion of a sequence pattern,
+ * %d with an optional 0 flag and width such as %05d.  %% is a literal
+ * percent sign.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * size_t        value       position of the conversion's d, or npos if
+ *                           pattern holds no conversion, more than one, or
+ *                           any other (%s, %x, %ld, %*d, ...).
+ **************************************************************************/
+size_t patternConversion(const string& pattern)
+{
+    size_t i, found = string::npos;
+    for (i = 0; i < pattern.size(); i++)
+    {
+        if (pattern[i] != '%')
+            continue;
+        if (++i < pattern.size() && pattern[i] == '%')
+            continue;
+        while (i < pattern.size() && isdigit((unsigned char) pattern[i]))
+            i++;
+        if (i == pattern.size() || pattern[i] != 'd' || found != string::npos)
+            return string::npos;
+        found = i;
+    }
+    return found;
+}
+
+/******************************** framePath *******************************
+ * string framePath(const string& pattern, long index)
+ *
+ * Description: Path of frame index of a pattern that passed
+ * patternConversion.  The conversion is widened to %ld so the whole long
+ * index is printed.
+ **************************************************************************/
+string framePath(const string& pattern, long index)
+{
+    size_t d = patternConversion(pattern);
+    string format = pattern.substr(0, d) + "l" + pattern.substr(d);
+    char path[4096];
+    snprintf(path, sizeof(path), format.c_str(), index);
+    return path;
+}
+
+/******************************* smoothFrames *****************************
+ * void *smoothFrames(void *p)
+ *
+ * Description: Frame worker.  Smooths every frame it takes from DECODED
+ * with its own context into a result buffer from BUFFERS, hands the
+ * decoded buffer back and the frame on to FINISHED.  A frame that cannot
+ * be smoothed is passed on without a result so the sequence has no gap.
+ **************************************************************************/
+void *smoothFrames(void *p)
+{
+    SmoothingContext context(*POOL);
+    Frame frame;
+    context.params.radius = RADIUS;
+    context.params.iterations = NUM_AVERAGES;
+    while (DECODED->pop(frame))
+    {
+        frame.result = BUFFERS->acquire(frame.image.rows, frame.image.cols, frame.image.type());
+        if (!context.smooth(frame.image, frame.result))
+            BUFFERS->release(frame.result);
+        BUFFERS->release(frame.image);
+        frame.mapping.reset();
+        FINISHED->put(frame.index, frame);
+    }
+    return NULL;
+}
+
+/*********************************** writer *******************************
+ * Output side, run by its own thread.  Writes frames in order, opening
+ * the VideoWriter on the first frame, hands every result buffer back to
+ * BUFFERS and records per frame latency.
+ **************************************************************************/
+struct Writer
+{
+    string path;
+    double fps;
+    bool verbose;
+    VideoWriter video;
+    vector<double> latencies;         // decode to written, per frame
+    double firstWritten, lastWritten;
+    long written, failed;
+};
+
+void *writeFrames(void *p)
+{
+    Writer& writer = *(Writer *) p;
+    Frame frame;
+    bool ok;
+    double now;
+    while (FINISHED->take(frame))
+    {
+        ok = frame.result.data != NULL;
+        if (ok && isPattern(writer.path))
+            ok = writeImage(framePath(writer.path, frame.index), frame.result);
+        else if (ok)
+        {
+            if (!writer.video.isOpened())
+            {
+                string ext = writer.path.substr(min(writer.path.size(), writer.path.find_last_of('.')));
+                int fourcc = ext == ".avi" ? VideoWriter::fourcc('M', 'J', 'P', 'G')
+                                           : VideoWriter::fourcc('m', 'p', '4', 'v');
+                writer.video.open(writer.path, fourcc, writer.fps, frame.result.size(),
+                                  frame.result.channels() == 3);
+            }
+            ok = writer.video.isOpened();
+            PROFILE_SCOPE("encode");
+            if (ok)
+                writer.video.write(frame.result);
+        }
+        BUFFERS->release(frame.result);
+        now = monotonicSeconds();
+        if (!ok)
+        {
+            cout << "Could not smooth or write frame " << frame.index << endl;
+            writer.failed++;
+            continue;
+        }
+        if (writer.written++ == 0)
+            writer.firstWritten = now;
+        writer.lastWritten = now;
+        writer.latencies.push_back(now - frame.decoded);
+        if (writer.verbose)
+            cout << "frame " << frame.index << " latency " << now - frame.decoded << " s" << endl;
+    }
+    return NULL;
+}
+
+/******************************** readFrames ******************************
+ * long readFrames(const string& input, long start, double *fps)
+ *
+ * Description: Decodes frames in order into DECODED until the input ends.
+ * Blocks whenever the queue is full, which is what bounds the frames in
+ * flight.  Video frames are decoded into buffers from BUFFERS shaped like
+ * the previous frame, image sequences are read as usual.
+ *
+ * Parameter     Direction   Description
+ * ------------------------------------------------------------------------
+ * input         in          video path or image sequence pattern.
+ * start         in          first number of an image sequence.
+ * fps           out         frame rate of a video input, unchanged for a
+ *                           sequence.
+ *
+ * Returns       Method      Description
+ * ------------------------------------------------------------------------
+ * long          value       frames read, -1 if the input could not be
+ *                           opened.
+ **************************************************************************/
+long readFrames(const string& input, long start, double *fps)
+{
+    VideoCapture capture;
+    Frame frame;
+    Mat buffer;
+    long count = 0;
+    int rows = 0, cols = 0, type = -1;    // previous video frame
+    if (!isPattern(input))
+    {
+        if (!capture.open(input))
+            return -1;
+        if (capture.get(CAP_PROP_FPS) > 0.0)
+            *fps = capture.get(CAP_PROP_FPS);
+    }
+    while (true)
+    {
+        frame.index = count;
+        frame.image = Mat();          // the last buffer is in flight
+        frame.mapping.reset(new MappedImage());
+        if (isPattern(input))
+            frame.image = readImage(framePath(input, start + count), *frame.mapping);
+        else
+        {
+            PROFILE_SCOPE("decode");
+            if (type >= 0)
+                frame.image = BUFFERS->acquire(rows, cols, type);
+            buffer = frame.image;
+            if (!capture.read(frame.image))
+                frame.image = Mat();
+            if (buffer.data && frame.image.data != buffer.data)
+                BUFFERS->release(buffer);       // end of input, or reallocated
+            rows = frame.image.rows;
+            cols = frame.image.cols;
+            type = frame.image.type();
+        }
+        if (!frame.image.data)
+            break;
+        frame.decoded = monotonicSeconds();
+        DECODED->push(frame);
+        count++;
+    }
+    return count == 0 && isPattern(input) ? -1 : count;
+}
+
+int main(int argc, char** argv)
+{
+    int opt, t;
+    int threads = hardwareThreads();  // -j, pool threads
+    int frameWorkers = 0;             // -F, frames smoothed at once
+    int depth = 0;                    // -q, decoded frames waiting
+    int reorder = 0;                  // -b, finished frames waiting
+    long start = 0;                   // -s, first sequence number
+    int idleMegabytes = DEFAULT_IDLE_LIMIT_MB;  // -M, free pool blocks kept
+    Writer writer;
+    writer.fps = 30.0;
+    writer.verbose = false;
+    writer.firstWritten = writer.lastWritten = 0.0;
+    writer.written = writer.failed = 0;
+
+    while ((opt = getopt(argc, argv, "r:j:F:q:b:s:f:M:v")) != -1)
+    {
+        if (opt == 'r')
+            RADIUS = atoi(optarg);
+        else if (opt == 'j')
+            threads = atoi(optarg);
+        else if (opt == 'F')
+            frameWorkers = atoi(optarg);
+        else if (opt == 'q')
+            depth = atoi(optarg);
+        else if (opt == 'b')
+            reorder = atoi(optarg);
+        else if (opt == 's')
+            start = atol(optarg);
+        else if (opt == 'f')
+            writer.fps = atof(optarg);
+        else if (opt == 'M')
+            idleMegabytes = atoi(optarg);
+        else if (opt == 'v')
+            writer.verbose = true;
+        else
+        {
+            cout << "usage: " << argv[0];
+            cout << " [-r radius] [-j threads] [-F frames] [-q depth] [-b reorder] [-s start] [-f fps] [-M idle_mb] [-v]";
+            cout << " number_of_avgs input_video_or_pattern output_video_or_pattern" << endl;
+            return -1;
+        }
+    }
+
+    // Ensure command line arguments were read successfully
+    if (argc - optind != 3)
+    {
+        cout << "usage: " << argv[0];
+        cout << " [-r radius] [-j threads] [-F frames] [-q depth] [-b reorder] [-s start] [-f fps] [-M idle_mb] [-v]";
+        cout << " number_of_avgs input_video_or_pattern output_video_or_pattern" << endl;
+        return -1;
+    }
+    NUM_AVERAGES = atoi(argv[optind]);
+    string input = argv[optind + 1];
+    writer.path = argv[optind + 2];
+
+    // Enough frames at once to hide the serial decode and encode, every
+    // frame still gets a share of the pool
+    if (frameWorkers == 0)
+        frameWorkers = max(2, min(threads / 4, 8));
+    if (depth == 0)
+        depth = frameWorkers;
+    if (reorder == 0)
+        reorder = 2 * frameWorkers;
+
+    if (RADIUS < 1)
+    {
+        cout << "Radius must be > 0\n " << endl;
+        return -1;
+    }
+    else if (NUM_AVERAGES < 0)
+    {
+        cout << "Number of averaging iterations must be > 0\n " << endl;
+        return -1;
+    }
+    else if (threads < 1 || frameWorkers < 1 || depth < 1 || reorder < 1 || writer.fps <= 0.0)
+    {
+        cout << "Threads, frames, queue depths and fps must be > 0\n " << endl;
+        return -1;
+    }
+    else if (idleMegabytes < 0)
+    {
+        cout << "Idle buffer limit must be >= 0\n " << endl;
+        return -1;
+    }
+    else if ((isPattern(input) && patternConversion(input) == string::npos)
+             || (isPattern(writer.path) && patternConversion(writer.path) == string::npos))
+    {
+        cout << "A sequence pattern needs exactly one %d conversion, e.g. frames/%05d.png\n " << endl;
+        return -1;
+    }
+
+    // At most depth + frameWorkers + reorder frames are in memory
+    ThreadPool pool(threads);
+    BoundedQueue<Frame> decoded(depth);
+    ReorderBuffer<Frame> finished(reorder);
+    BufferPool buffers((size_t) idleMegabytes * 1048576);
+    POOL = &pool;
+    DECODED = &decoded;
+    FINISHED = &finished;
+    BUFFERS = &buffers;
+    vector<pthread_t> workers(frameWorkers);
+    pthread_t writerThread;
+
+    double begin = monotonicSeconds();
+    for (t = 0; t < frameWorkers; t++)
+        pthread_create(&workers[t], NULL, smoothFrames, NULL);
+    pthread_create(&writerThread, NULL, writeFrames, &writer);
+    long frames = readFrames(input, start, &writer.fps);
+
+    // Workers drain the queue, then the writer drains the reorder buffer
+    decoded.close();
+    for (t = 0; t < frameWorkers; t++)
+        pthread_join(workers[t], NULL);
+    finished.close(max(frames, 0L));
+    pthread_join(writerThread, NULL);
+    writer.video.release();
+    double elapsed_secs = monotonicSeconds() - begin;
+
+    if (frames < 0)
+    {
+        cout << "Could not open input: " << input << endl;
+        return -1;
+    }
+    cout << writer.written << " of " << frames << " frames smoothed (" << NUM_AVERAGES;
+    cout << " averages each, " << frameWorkers << " at once on " << threads << " threads) in ";
+    cout << elapsed_secs << " seconds" << endl;
+    if (writer.written > 1 && writer.lastWritten > writer.firstWritten)
+    {
+        // Sustained rate leaves out the pipeline filling up for frame 0
+        cout << "fps: " << writer.written / elapsed_secs << " overall, ";
+        cout << (writer.written - 1) / (writer.lastWritten - writer.firstWritten) << " sustained" << endl;
+    }
+    if (!writer.latencies.empty())
+    {
+        sort(writer.latencies.begin(), writer.latencies.end());
+        size_t n = writer.latencies.size();
+        cout << "latency (decoded to written): median " << writer.latencies[n / 2];
+        cout << " s, p95 " << writer.latencies[min(n - 1, n * 95 / 100)];
+        cout << " s, max " << writer.latencies[n - 1] << " s" << endl;
+    }
+    buffers.printStats(cout);
+    PROFILE_REPORT("VideoSmoothing");
+
+    return writer.failed > 0 || frames < 0 ? -1 : 0;
+}
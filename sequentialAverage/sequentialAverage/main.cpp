@@ -6,89 +6,224 @@
  * versions.  This version is sequential.
  *
  * compile: see README.txt for details.
- * execute: ./a.out <num> path/<input_image_name>.jpg path/<output_image_name>.jpg
+ * execute: ./a.out [-r radius] [-u] [-i] [-W r1,r2,...] [-t tile] [-k iters] [-p] [-c] [-d] [-s] [-C cache_dir] [-L cache_mb] [-P period] [-U prev_input,prev_output] [-R x,y,w,h] [-w every[,dir[,drop|block[,ext]]]] <num> path/<input_image_name>.jpg path/<output_image_name>.jpg
  ********************************************************************************/
 #include <ctime>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
 #include <opencv2/opencv.hpp>
 #include <iostream>
+#include "benchmark.hpp"
+#include "boxAverage.hpp"
+#include "bufferPool.hpp"
+#include "compositeKernel.hpp"
+#include "imageDiff.hpp"
+#include "incrementalSmooth.hpp"
+#include "integralImage.hpp"
+#include "planarLayout.hpp"
+#include "profile.hpp"
+#include "rawImage.hpp"
+#include "resultCache.hpp"
+#include "snapshotWriter.hpp"
+#include "stripStream.hpp"
+#include "typedAverage.hpp"
+#include "temporalBlocking.hpp"
 using namespace std;
 using namespace cv;
 
-/*********************** neighborhoodAverage ******************************
- * void neighborhoodAverage(const Mat& img, Mat& result, int r, int c)
+/*************************** windowOutputPath *****************************
+ * string windowOutputPath(const string& outImage, int radius)
  *
- * Description: Computes average of a neighborhood centered at (r,c) and
- * stores average into result.
+ * Description: Derives the output path for one window size by inserting
+ * _r<radius> before the file extension, e.g. out.jpg -> out_r4.jpg.
+ **************************************************************************/
+string windowOutputPath(const string& outImage, int radius)
+{
+    size_t slash = outImage.find_last_of('/');
+    size_t dot = outImage.find_last_of('.');
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+        dot = outImage.size();
+    return outImage.substr(0, dot) + "_r" + to_string(radius) + outImage.substr(dot);
+}
+
+// Argument of boxPass, the scratch is reused by every pass of a run
+struct BoxPassArg
+{
+    int radius;
+    AverageScratch scratch;
+};
+
+/******************************** boxPass *********************************
+ * Description: PassFunction (see benchmark.hpp) of one box average, arg
+ * points to a BoxPassArg.
+ **************************************************************************/
+void boxPass(void *arg, const Mat& src, Mat& dst)
+{
+    BoxPassArg *pass = (BoxPassArg *) arg;
+    boxAverage(src, dst, pass->radius, pass->scratch);
+}
+
+/***************************** smoothWindows ******************************
+ * void smoothWindows(const Mat& image, int n, const vector<int>& radii,
+ *                    const string& outImage)
+ *
+ * Description: Performs n averaging operations for every window radius in
+ * radii using the summed-area table backend and writes one image per
+ * radius.
  *
  * Process:
- * 1.) Set up variables for readability, computation, and indexing.
- * 2.) Assigns starting and ending values for indexes of neighborhood.
- * 3.) Iterate through neighborhood summing together every valid cell.
- * 4.) Compute each average and store in result.
+ * 1.) Build the summed-area table of the input once.
+ * 2.) For every radius, run the first pass from the shared table and the
+ *     remaining n - 1 passes from a table of the previous pass.
+ * 3.) Write the result to windowOutputPath(outImage, radius).
  *
  * Parameter     Direction   Description
  * ------------------------------------------------------------------------
- * img           in          OpenCV Mat data structure, contains pointer to
- *                           2D array containing image pixels.
- * result        out         OpenCV Mat data structure used to store result
- *                           of neighborhood average.
- * r             in          Row value for cell at center of neighborhood.
- * c             in          Col value for cell at center of neighborhood.
- *
- * NOTES:
- * - Assumes the values for r and c are viable.  This function will not go
- *   out of bounds, but it will still try to compute the neighborhood
- *   centered at (r,c)
+ * image         in          Input image.
+ * n             in          Number of averaging operations per radius.
+ * radii         in          Window radii to produce.
+ * outImage      in          Output path the per radius names derive from.
  **************************************************************************/
-void neighborhoodAverage(const Mat& img, Mat& result, int r, int c)
+void smoothWindows(const Mat& image, int n, const vector<int>& radii, const string& outImage)
 {
-    CV_Assert(img.depth() == CV_8U);        // ensures pixel value range [0..255]
-    int startRow, endRow, startCol, endCol; // readability vars
-    int sumBlue = 0, sumGreen = 0,          // averaging computation
-    sumRed = 0, avgBlue, avgGreen, avgRed;
-    int count = 0;
-    Vec3b intensity;                        // stores 3-channel pixel data
-    int i, j;                               // loop indices
-    startRow = r - 1;
-    endRow   = r + 1;
-    startCol = c - 1;
-    endCol   = c + 1;
-    for (i = startRow; i <= endRow; i++)
-        for (j = startCol; j <= endCol; j++)
-        {
-            if (i < 0 || i > img.rows - 1) break;     // avoid out of bounds rows
-            if (j < 0 || j > img.cols - 1) continue;  // avoid out of bounds cols
-            intensity = img.template at<Vec3b>(i, j); // store channels in 3 element vector BGR
-            sumBlue  = sumBlue  + intensity.val[0];
-            sumGreen = sumGreen + intensity.val[1];
-            sumRed   = sumRed   + intensity.val[2];
-            count++; // keeps count of total values used in sum
-        }
-    avgBlue  = saturate_cast<uchar>(sumBlue / count);
-    avgGreen = saturate_cast<uchar>(sumGreen / count);
-    avgRed   = saturate_cast<uchar>(sumRed / count);
-    result.template at<Vec3b>(r,c)[0] = avgBlue;
-    result.template at<Vec3b>(r,c)[1] = avgGreen;
-    result.template at<Vec3b>(r,c)[2] = avgRed;
+    SummedAreaTable inputTable, table;
+    Mat buffers[2];            // pass t writes buffers[t % 2]
+    int averageOps;
+    size_t w;
+    buildSummedAreaTable(image, inputTable);
+    for (w = 0; w < radii.size(); w++)
+    {
+        for (averageOps = 0; averageOps < n; averageOps++)
+        {
+            if (averageOps == 0)
+                integralAverage(inputTable, buffers[0], radii[w], radii[w]);
+            else
+            {
+                buildSummedAreaTable(buffers[(averageOps - 1) % 2], table);
+                integralAverage(table, buffers[averageOps % 2], radii[w], radii[w]);
+            }
+        }
+        writeImage(windowOutputPath(outImage, radii[w]), n > 0 ? buffers[(n - 1) % 2] : image);
+    }
 }
 
 int main(int argc, char** argv)
 {
-    int i, j, averageOps = 0;
-    int n = atoi(argv[1]);     // num of averaging ops
-    char *imageName = argv[2]; // input image
-    char *outImage = argv[3];  // output image
-    char buffer[100];          // used for intermediate images
+    int opt, block, averageOps = 0;
+    int radius = 1;            // neighborhood is (2 * radius + 1)^2
+    bool useIntegral = false;  // summed-area table backend
+    int readFlags = 1;         // 8-bit BGR unless -u keeps the file's type
+    vector<int> windows;       // radii for multi-window output
+    bool tiled = false;        // temporal cache blocking
+    bool planar = false;       // iterate on deinterleaved channel planes
+    bool composite = false;    // n iterations in one approximate pass
+    bool deviation = false;    // report composite deviation from exact
+    bool streaming = false;    // scanline PPM/PGM streaming
+    char *cacheDir = NULL;     // result cache, off unless given
+    size_t cacheMegabytes = 1024;
+    int checkpointEvery = 50;  // iterations between cached checkpoints
+    int startOps = 0;          // iterations taken from the cache
+    unsigned long long hash = 0;
+    ResultCache *cache = NULL;
+    MappedImage cachedMap;
+    char *previousInput = NULL;    // incremental update of an earlier run
+    char *previousOutput = NULL;
+    bool regionGiven = false;  // changed region from -R instead of a diff
+    Rect changed, recomputed;
+    TileConfig tiles = DEFAULT_TILE_CONFIG;
+    TileWork work;
+    PlanarWork planarWork;
+    char *snapshotSpec = NULL; // -w, progress snapshots
+    SnapshotConfig snapshotConfig = DEFAULT_SNAPSHOT_CONFIG;
+    SnapshotWriter *snapshots = NULL;
+    char *token;
     Mat image, averagedImage;
+    MappedImage inputMap, outputMap;   // .bgr files are used in place
+    BufferPool buffers;
+    Mat scratch;               // second ping-pong buffer
+    const Mat *src;            // last result, image before the first pass
+    Mat *dst;                  // next result, averagedImage or scratch
+    SummedAreaTable table;
     
-    // Read in image used in averaging operation
-    image = imread(imageName, 1);
+    while ((opt = getopt(argc, argv, "r:uiW:t:k:pcdsC:L:P:U:R:w:")) != -1)
+    {
+        if (opt == 'r')
+            radius = atoi(optarg);
+        else if (opt == 'u')
+            readFlags = IMREAD_UNCHANGED;
+        else if (opt == 'i')
+            useIntegral = true;
+        else if (opt == 'W')
+        {
+            for (token = strtok(optarg, ","); token; token = strtok(NULL, ","))
+                windows.push_back(atoi(token));
+        }
+        else if (opt == 't')
+        {
+            tiles.tileRows = tiles.tileCols = atoi(optarg);
+            tiled = true;
+        }
+        else if (opt == 'k')
+        {
+            tiles.blockIters = atoi(optarg);
+            tiled = true;
+        }
+        else if (opt == 'p')
+            planar = true;
+        else if (opt == 'c')
+            composite = true;
+        else if (opt == 'd')
+            composite = deviation = true;
+        else if (opt == 's')
+            streaming = true;
+        else if (opt == 'C')
+            cacheDir = optarg;
+        else if (opt == 'L')
+            cacheMegabytes = (size_t) atol(optarg);
+        else if (opt == 'P')
+            checkpointEvery = atoi(optarg);
+        else if (opt == 'U')
+        {
+            previousInput = strtok(optarg, ",");
+            previousOutput = strtok(NULL, ",");
+        }
+        else if (opt == 'R')
+        {
+            if (sscanf(optarg, "%d,%d,%d,%d", &changed.x, &changed.y,
+                       &changed.width, &changed.height) != 4)
+                changed = Rect(0, 0, -1, -1);
+            regionGiven = true;
+        }
+        else if (opt == 'w')
+            snapshotSpec = optarg;
+        else
+        {
+            cout << "usage: " << argv[0];
+            cout << " [-r radius] [-u] [-i] [-W r1,r2,...] [-t tile] [-k iters] [-p] [-c] [-d] [-s] [-C cache_dir] [-L cache_mb] [-P period] [-U prev_input,prev_output] [-R x,y,w,h] [-w every[,dir[,drop|block[,ext]]]] number_of_avgs path_to_image path_to_output" << endl;
+            return -1;
+        }
+    }
     
     // Ensure command line arguments were read successfully
-    if (argc != 4)
+    if (argc - optind != 3)
     {
         cout << "usage: " << argv[0];
-        cout << " number_of_avgs path_to_image path_to_output" << endl;
+        cout << " [-r radius] [-u] [-i] [-W r1,r2,...] [-t tile] [-k iters] [-p] [-c] [-d] [-s] [-C cache_dir] [-L cache_mb] [-P period] [-U prev_input,prev_output] [-R x,y,w,h] [-w every[,dir[,drop|block[,ext]]]] number_of_avgs path_to_image path_to_output" << endl;
+        return -1;
+    }
+    int n = atoi(argv[optind]);         // num of averaging ops
+    char *imageName = argv[optind + 1]; // input image
+    char *outImage = argv[optind + 2];  // output image
+    
+    // Read in image used in averaging operation, streaming never holds it
+    if (!streaming)
+        image = readImage(imageName, inputMap, readFlags);
+    
+    if (radius < 1)
+    {
+        cout << "Radius must be > 0\n " << endl;
         return -1;
     }
     else if (n < 0)
@@ -96,48 +231,347 @@ int main(int argc, char** argv)
         cout << "Number of averaging iterations must be > 0\n " << endl;
         return -1;
     }
-    else if (!imageName || !image.data)
+    else if (tiled && (tiles.tileRows < 1 || tiles.blockIters < 1))
+    {
+        cout << "Tile size and iterations per tile must be > 0\n " << endl;
+        return -1;
+    }
+    else if (tiled && (useIntegral || !windows.empty()))
+    {
+        cout << "Tiling cannot be combined with -i or -W\n " << endl;
+        return -1;
+    }
+    else if (planar && (tiled || useIntegral || !windows.empty() || composite || streaming))
+    {
+        cout << "-p cannot be combined with -i, -W, -t, -k, -c or -s\n " << endl;
+        return -1;
+    }
+    else if (composite && (tiled || useIntegral || !windows.empty()))
+    {
+        cout << "-c cannot be combined with -i, -W, -t or -k\n " << endl;
+        return -1;
+    }
+    else if (streaming && (composite || tiled || useIntegral || !windows.empty() || readFlags != 1))
+    {
+        cout << "-s cannot be combined with -u, -i, -W, -t, -k or -c\n " << endl;
+        return -1;
+    }
+    else if (cacheDir && (streaming || !windows.empty() || deviation))
+    {
+        cout << "-C cannot be combined with -s, -W or -d\n " << endl;
+        return -1;
+    }
+    else if (image.data && image.depth() != CV_8U
+             && (useIntegral || composite || !windows.empty() || previousInput))
+    {
+        cout << "-i, -W, -c and -U need an 8-bit image\n " << endl;
+        return -1;
+    }
+    else if (image.data && image.depth() != CV_8U && !selectAverageKernel(image.type(), radius))
+    {
+        cout << "Image must be 8-bit, or 16-bit or float with 1, 3 or 4 channels\n " << endl;
+        return -1;
+    }
+    else if (previousInput && (streaming || !windows.empty() || composite || cacheDir))
+    {
+        cout << "-U cannot be combined with -s, -W, -c or -C\n " << endl;
+        return -1;
+    }
+    else if ((previousInput && !previousOutput) || (regionGiven && !previousInput)
+             || changed.width < 0 || changed.height < 0)
+    {
+        cout << "-U needs both previous images, -R needs -U and x,y,w,h >= 0\n " << endl;
+        return -1;
+    }
+    else if (snapshotSpec && !parseSnapshotConfig(snapshotSpec, snapshotConfig))
+    {
+        cout << "-w needs every[,dir[,drop|block[,ext]]] with every > 0\n " << endl;
+        return -1;
+    }
+    else if (snapshotSpec && (streaming || !windows.empty() || composite || previousInput))
+    {
+        cout << "-w cannot be combined with -s, -W, -c or -U\n " << endl;
+        return -1;
+    }
+    else if (checkpointEvery < 1)
+    {
+        cout << "Checkpoint period must be > 0\n " << endl;
+        return -1;
+    }
+    else if (!imageName || (!streaming && !image.data))
     {
         cout << "No image data \n" << endl;
         cout << "usage: " << argv[0];
-        cout << " number_of_avgs path_to_image path_to_output" << endl;
+        cout << " [-r radius] [-u] [-i] [-W r1,r2,...] [-t tile] [-k iters] [-p] [-c] [-d] [-s] [-C cache_dir] [-L cache_mb] [-P period] [-U prev_input,prev_output] [-R x,y,w,h] [-w every[,dir[,drop|block[,ext]]]] number_of_avgs path_to_image path_to_output" << endl;
         return -1;
     }
     else if (!outImage)
     {
         cout << "Could not read output path\n" << endl;
         cout << "usage: " << argv[0];
-        cout << " number_of_avgs path_to_image path_to_output" << endl;
+        cout << " [-r radius] [-u] [-i] [-W r1,r2,...] [-t tile] [-k iters] [-p] [-c] [-d] [-s] [-C cache_dir] [-L cache_mb] [-P period] [-U prev_input,prev_output] [-R x,y,w,h] [-w every[,dir[,drop|block[,ext]]]] number_of_avgs path_to_image path_to_output" << endl;
         return -1;
     }
     
-    // Initialize structure to hold resulting image
-    averagedImage = image.clone();
+    // Rows flow from the input file through n levels to the output file
+    if (streaming)
+    {
+        size_t peakBytes = 0;
+        clock_t begin = clock();
+        if (!streamSmooth(imageName, outImage, radius, n, &peakBytes))
+        {
+            cout << "Could not stream " << imageName << " to " << outImage;
+            cout << ", both must be binary PPM or PGM" << endl;
+            return -1;
+        }
+        double elapsed_secs = double(clock() - begin) / CLOCKS_PER_SEC;
+        cout << n << " streamed averages took: " << elapsed_secs;
+        cout << " seconds, peak buffer " << peakBytes << " bytes" << endl;
+        PROFILE_REPORT("sequentialAverage");
+        return 0;
+    }
+    
+    for (size_t w = 0; w < windows.size(); w++)
+    {
+        if (windows[w] < 1)
+        {
+            cout << "Radius must be > 0\n " << endl;
+            return -1;
+        }
+    }
+    
+    // Several window sizes share one summed-area table of the input
+    if (!windows.empty())
+    {
+        clock_t begin = clock();
+        smoothWindows(image, n, windows, outImage);
+        double elapsed_secs = double(clock() - begin) / CLOCKS_PER_SEC;
+        cout << windows.size() << " window sizes of " << n << " averages took: ";
+        cout << elapsed_secs << " seconds" << endl;
+        PROFILE_REPORT("sequentialAverage");
+        return 0;
+    }
+    
+    // Only the area a local edit can reach is recomputed
+    if (previousInput)
+    {
+        MappedImage previousInputMap, previousOutputMap;
+        Mat previousIn = readImage(previousInput, previousInputMap);
+        Mat previousOut = readImage(previousOutput, previousOutputMap);
+        if (!previousOut.data || (!regionGiven && !previousIn.data))
+        {
+            cout << "Could not read previous images" << endl;
+            return -1;
+        }
+        if (!regionGiven)
+        {
+            DiffReport report;
+            ThreadPool pool(1);
+            if (previousIn.size() != image.size() || previousIn.type() != image.type()
+                || image.depth() != CV_8U || image.channels() > 4)
+            {
+                cout << "Previous input does not match " << imageName << endl;
+                return -1;
+            }
+            diffImages(previousIn, image, pool, false, report);
+            changed = report.bounds;
+        }
+        clock_t begin = clock();
+        if (!incrementalSmooth(image, previousOut, changed, radius, n, averagedImage, &recomputed))
+        {
+            cout << "Previous output does not match " << imageName << endl;
+            return -1;
+        }
+        double elapsed_secs = double(clock() - begin) / CLOCKS_PER_SEC;
+        cout << n << " incremental averages took: " << elapsed_secs << " seconds, recomputed ";
+        cout << recomputed.width << " x " << recomputed.height << " of " << image.size() << endl;
+        writeImage(outImage, averagedImage);
+        PROFILE_REPORT("sequentialAverage");
+        return 0;
+    }
+    
+    // Results are keyed by the decoded pixels, not the file
+    const char *engine = composite ? "composite" : tiled ? "tiled" : useIntegral ? "integral" : "box";
+    ResultCache resultCache(cacheDir ? cacheDir : "", cacheMegabytes << 20);
+    if (cacheDir)
+    {
+        cache = &resultCache;
+        hash = pixelHash(image);
+    }
+    
+    // One approximate pass instead of n exact ones
+    if (composite)
+    {
+        // The composite kernel cannot resume, only an exact hit counts
+        if (cache && cache->lookup(hash, engine, radius, n, startOps, cachedMap) && startOps == n)
+        {
+            cout << n << " composite averages found in cache" << endl;
+            writeImage(outImage, cachedMap.mat);
+            PROFILE_REPORT("sequentialAverage");
+            return 0;
+        }
+        clock_t begin = clock();
+        compositeAverage(image, averagedImage, radius, n);
+        double elapsed_secs = double(clock() - begin) / CLOCKS_PER_SEC;
+        cout << n << " averages in one composite pass took: " << elapsed_secs;
+        cout << " seconds" << endl;
+        if (deviation)
+        {
+            Mat exact, spare;
+            BoxPassArg pass;
+            pass.radius = radius;
+            runPasses(boxPass, &pass, image, exact, spare, n);
+            DeviationReport report = compareDeviation(exact, averagedImage);
+            cout << "deviation from iterative path: max " << report.maxAbs;
+            cout << " mean " << report.meanAbs << endl;
+        }
+        if (cache)
+            cache->store(hash, engine, radius, n, averagedImage);
+        writeImage(outImage, averagedImage);
+        PROFILE_REPORT("sequentialAverage");
+        return 0;
+    }
+    
+    // Initialize structure to hold resulting image, a .bgr output is
+    // written in place through its mapping and renamed into place at the
+    // end, so it may be the input file itself
+    if (isRawImagePath(outImage))
+    {
+        if (!createMappedImage(outImage, image.rows, image.cols, image.type(), outputMap))
+        {
+            cout << "Could not create output " << outImage << endl;
+            return -1;
+        }
+        averagedImage = outputMap.mat;
+        image.copyTo(averagedImage);
+    }
+    else
+        averagedImage = image.clone();
+    
+    // Resume from the furthest cached checkpoint of this input
+    if (cache && cache->lookup(hash, engine, radius, n, startOps, cachedMap))
+    {
+        cout << "resuming from " << startOps << " cached averages" << endl;
+        cachedMap.mat.copyTo(averagedImage);
+        image = cachedMap.mat;
+        averageOps = startOps;
+    }
+    
+    // Snapshots are copied and encoded off the compute loop
+    if (snapshotSpec)
+        snapshots = new SnapshotWriter(snapshotConfig);
+    
+    // Ping-pong between the output and scratch, image is only read
+    scratch = buffers.acquire(image.rows, image.cols, image.type());
+    src = &image;
+    dst = &averagedImage;
     
     // Perform n averaging operations against image
     clock_t begin = clock();
-    while (averageOps++ < n)
+    while (tiled && averageOps < n)
+    {
+        // Run k iterations per tile, ending blocks on snapshot and
+        // checkpoint boundaries
+        block = min(tiles.blockIters, n - averageOps);
+        if (snapshots)
+            block = min(block, snapshotConfig.every - averageOps % snapshotConfig.every);
+        if (cache)
+            block = min(block, checkpointEvery - averageOps % checkpointEvery);
+        {
+            PROFILE_SCOPE("average");
+            smoothTiles(*src, *dst, radius, block, tiles, 0,
+                        tileCount(image.size(), tiles), work);
+        }
+        averageOps += block;
+        if (snapshots && snapshots->due(averageOps))
+            snapshots->submit(averageOps, *dst);
+        if (cache && averageOps % checkpointEvery == 0)
+        {
+            PROFILE_SCOPE("checkpoint");
+            cache->store(hash, engine, radius, averageOps, *dst);
+        }
+        src = dst;
+        dst = dst == &averagedImage ? &scratch : &averagedImage;
+    }
+    while (planar && averageOps < n)
+    {
+        // Planes are interleaved again only on snapshot and checkpoint
+        // boundaries
+        block = n - averageOps;
+        if (snapshots)
+            block = min(block, snapshotConfig.every - averageOps % snapshotConfig.every);
+        if (cache)
+            block = min(block, checkpointEvery - averageOps % checkpointEvery);
+        {
+            PROFILE_SCOPE("average");
+            smoothPlanar(*src, *dst, radius, block, planarWork);
+        }
+        averageOps += block;
+        if (snapshots && snapshots->due(averageOps))
+            snapshots->submit(averageOps, *dst);
+        if (cache && averageOps % checkpointEvery == 0)
+        {
+            PROFILE_SCOPE("checkpoint");
+            cache->store(hash, engine, radius, averageOps, *dst);
+        }
+        src = dst;
+        dst = dst == &averagedImage ? &scratch : &averagedImage;
+    }
+    while (!tiled && !planar && averageOps++ < n)
     {
-        for (i = 0; i < image.rows; i++)
-            for (j = 0; j < image.cols; j++)
-                neighborhoodAverage(image, averagedImage, i, j);
+        {
+            PROFILE_SCOPE("average");
+            if (useIntegral)
+            {
+                buildSummedAreaTable(*src, table);
+                integralAverage(table, *dst, radius, radius);
+            }
+            else
+                boxAverage(*src, *dst, radius, work.scratch);
+        }
         // Used for printing the image out periodically
-        if (averageOps % 25 == 0)
+        if (snapshots && snapshots->due(averageOps))
+            snapshots->submit(averageOps, *dst);
+        if (cache && averageOps % checkpointEvery == 0)
         {
-            sprintf(buffer, "/Users/Hennessy/Desktop/Images/after_%d_averages.jpg", averageOps);
-            //cout << buffer << endl;
-            imwrite(buffer, averagedImage);
+            PROFILE_SCOPE("checkpoint");
+            cache->store(hash, engine, radius, averageOps, *dst);
         }
-
-        image = averagedImage.clone();
+        src = dst;
+        dst = dst == &averagedImage ? &scratch : &averagedImage;
     }
+    if (src == &scratch)
+    {
+        PROFILE_SCOPE("copy");
+        scratch.copyTo(averagedImage);
+    }
+    buffers.release(scratch);
     clock_t end = clock();
     double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
     cout << n << " averages took: " << elapsed_secs;
     cout << " seconds" << endl;
     cout << averagedImage.size() << endl;
+    if (snapshots)
+    {
+        snapshots->close();
+        cout << "snapshots written: " << snapshots->written() << " dropped: " << snapshots->dropped();
+        cout << " failed: " << snapshots->failed() << endl;
+        delete snapshots;
+    }
+    if (cache && n > startOps && n % checkpointEvery != 0)
+        cache->store(hash, engine, radius, n, averagedImage);
 
-    imwrite(outImage, averagedImage);
+    if (!isRawImagePath(outImage))
+    {
+        PROFILE_SCOPE("write");
+        imwrite(outImage, averagedImage);
+    }
+    else if (!outputMap.commit())
+    {
+        cout << "Could not write output " << outImage << endl;
+        return -1;
+    }
+    PROFILE_REPORT("sequentialAverage");
     
     return 0;
 }